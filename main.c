@@ -29,6 +29,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <utils/config.h>
+#include <utils/file_store.h>
 #include <utils/kill_others.h>
 #include <utils/net_utils.h>
 #include <utils/utils.h>
@@ -60,6 +61,9 @@
 #define MAX_TEXT_LENGTH 4194304L     // 4 MiB
 #define MAX_FILE_SIZE 68719476736LL  // 64 GiB
 
+// seconds to keep the files of an interrupted upload to resume it
+#define RESUME_GRACE_PERIOD 86400  // 1 day
+
 #define ERROR_LOG_FILE "server_err.log"
 #define CONFIG_FILE "clipshare.conf"
 
@@ -201,6 +205,8 @@ static inline void _apply_default_conf(void) {
     if (configuration.max_text_length <= 0) configuration.max_text_length = MAX_TEXT_LENGTH;
     if (configuration.max_file_size <= 0) configuration.max_file_size = MAX_FILE_SIZE;
     if (configuration.cut_sent_files < 0) configuration.cut_sent_files = 0;
+    if (configuration.resume_grace_period < 0) configuration.resume_grace_period = RESUME_GRACE_PERIOD;
+    if (configuration.dedup_store_size < 0) configuration.dedup_store_size = 0;
     if (configuration.client_selects_display < 0) configuration.client_selects_display = 0;
     if (configuration.display <= 0) configuration.display = 1;
 
@@ -519,6 +525,11 @@ int main(int argc, char **argv) {
     }
 #endif
 
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+    // one store is shared by the plain and the TLS servers, since both receive files into the same directory
+    file_store_init();
+#endif
+
 #if defined(__linux__) || defined(__APPLE__)
     pid_t p_clip = 0;
     pid_t p_clip_ssl = 0;
@@ -27,7 +27,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <utils/compress.h>
+#include <utils/delta.h>
+#include <utils/file_store.h>
+#include <utils/file_stream.h>
+#include <utils/file_writer.h>
+#include <utils/hash.h>
 #include <utils/net_utils.h>
+#include <utils/read_ahead.h>
+#include <utils/text_history.h>
 #include <utils/utils.h>
 
 #ifndef __GLIBC__
@@ -41,10 +49,47 @@
 // status codes
 #define STATUS_OK 1
 #define STATUS_NO_DATA 2
+#define STATUS_NOT_MODIFIED 5
+#define STATUS_CHANGED 6
+#define STATUS_CORRUPTED 7
 
 #define FILE_BUF_SZ 65536L  // 64 KiB
 #define MAX_FILE_NAME_LENGTH 2048
 #define MAX_IMAGE_SIZE 1073741824UL  // 1 GiB
+#define MAX_STREAM_FPS 60
+// length of the name of a directory to receive files into, including the terminating '\0'
+#define RECEIVE_DIR_NAME_LEN 17
+// files up to this size are packed into batch frames with other files
+#define PACK_SMALL_FILE_SIZE 262144L  // 256 KiB
+// a batch frame is sent once the contents of its files reach this size
+#define PACK_FRAME_SIZE 1048576L  // 1 MiB
+#define PACK_MAX_FRAME_FILES 4096
+// received frames with contents up to this size are read at once
+#define PACK_MAX_FRAME_READ 16777216L  // 16 MiB
+
+// bytes before the offset of a resumed file that the client hashes, to show that it has the same file
+#define RESUME_CHECK_SIZE 65536L  // 64 KiB
+// name of a directory keeping the files of a resumable upload, which is followed by the hash of the upload in hex
+#define RESUME_DIR_PREFIX ".clipshare-resume-"
+// length of the path of that directory, including the terminating '\0'
+#define RESUME_DIR_NAME_LEN 37
+
+// maximum number of blocks of all the files that the client has, of which it sends the checksums
+#define DELTA_MAX_BLOCKS 1048576L
+
+// largest index prefixed to the name of a received file when the name is taken
+#define MAX_NAME_INDEX 999999U
+
+// compression argument to send file contents as they are, without the framing of a compressed stream
+#define SEND_RAW -1
+// compression argument to send file contents as they are, followed by their XXH64 hash
+#define SEND_HASHED -2
+// compression argument to send file contents as extents of data and holes
+#define SEND_SPARSE -3
+
+// ways of sending the text in get_text_delta
+#define TEXT_FULL 0
+#define TEXT_DELTA 1
 
 #define MIN(x, y) (x < y ? x : y)
 
@@ -74,14 +119,22 @@ static inline int _send_data(socket_t *socket, int64_t length, const char *data)
 }
 
 /*
- * Common function to get files in v1 and v2.
+ * Common function to get files in v1, v2, v3, and v4.
+ * File contents are sent as compressed streams with the given compression, or as they are if it is SEND_RAW.
  */
-static int _get_files_common(int version, socket_t *socket, list2 *file_list, size_t path_len);
+static int _get_files_common(int version, socket_t *socket, list2 *file_list, size_t path_len, int compression);
 
 /*
- * Common function to save files in send_files method of v1, v2, and v3.
+ * Send the number of files followed by the files in the list, and free the list.
  */
-static int _save_file_common(int version, socket_t *socket, const char *file_name);
+static int _send_file_list(int version, socket_t *socket, list2 *file_list, size_t path_len, int compression);
+
+/*
+ * Common function to save files in send_files method of v1, v2, and v3. The contents of a regular file are framed as
+ * SEND_RAW, SEND_HASHED, or SEND_SPARSE. With SEND_HASHED, a file that does not match its hash is removed and sets
+ * *corrupted_p.
+ */
+static int _save_file_common(int version, socket_t *socket, const char *file_name, int framing, int *corrupted_p);
 
 /*
  * Common function to get image in v1 and v3.
@@ -96,9 +149,34 @@ static inline int _get_image_common(socket_t *socket, int mode, uint16_t disp);
  */
 static inline int _is_valid_fname(const char *fname, size_t name_length);
 
-static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len);
+static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len,
+                                 int compression);
 
-int get_text_v1(socket_t *socket) {
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+/*
+ * Send the rest of the file, which has file_size bytes, as a compressed stream. Files that are already compressed are
+ * sent without compressing again.
+ */
+static int _send_file_compressed(socket_t *socket, FILE *fp, int64_t file_size, int compression);
+
+/*
+ * Send the rest of the file, which has file_size bytes, as extents. A data extent is sent as its length followed by its
+ * bytes, and a hole is sent as its length negated.
+ */
+static int _send_file_extents(socket_t *socket, FILE *fp, int64_t file_size);
+
+/*
+ * Receive the file_size bytes of a file sent as extents into file, leaving holes where the extents are holes.
+ */
+static int _receive_file_extents(socket_t *socket, FILE *file, int64_t file_size);
+#endif
+
+/*
+ * Get the copied text with LF line endings.
+ * returns the text, which should be freed by the caller, and sets *len_ptr to its length, or returns NULL if there
+ * is no text to send.
+ */
+static char *_get_text_lf(int64_t *len_ptr) {
     uint32_t length = 0;
     char *buf = NULL;
     if (get_clipboard_text(&buf, &length) != EXIT_SUCCESS || length <= 0 ||
@@ -106,10 +184,8 @@ int get_text_v1(socket_t *socket) {
 #ifdef DEBUG_MODE
         printf("clipboard read text failed. len = %" PRIu32 "\n", length);
 #endif
-        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
         if (buf) free(buf);
-        close_socket_no_wait(socket);
-        return EXIT_SUCCESS;
+        return NULL;
     }
 #ifdef DEBUG_MODE
     printf("Len = %" PRIu32 "\n", length);
@@ -118,16 +194,28 @@ int get_text_v1(socket_t *socket) {
         puts("");
     }
 #endif
-    int64_t new_len = convert_eol(&buf, 1);
+    const int64_t new_len = convert_eol_len(&buf, length, 1, 0);
     if (new_len <= 0) {
+        if (buf) free(buf);
+        return NULL;
+    }
+    *len_ptr = new_len;
+    return buf;
+}
+
+int get_text_v1(socket_t *socket) {
+    int64_t length;
+    char *buf = _get_text_lf(&length);
+    if (!buf) {
         write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
         return EXIT_SUCCESS;
     }
     if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
         free(buf);
         return EXIT_FAILURE;
     }
-    if (_send_data(socket, new_len, buf) != EXIT_SUCCESS) {
+    if (_send_data(socket, length, buf) != EXIT_SUCCESS) {
         free(buf);
         return EXIT_FAILURE;
     }
@@ -154,25 +242,76 @@ int send_text_v1(socket_t *socket) {
         return EXIT_FAILURE;
     }
     data[length] = 0;
-    if (u8_check((uint8_t *)data, (size_t)length)) {
+#ifdef DEBUG_MODE
+    if (length < 1024) puts(data);
+#endif
+    // validates UTF-8 while converting
+    length = convert_eol_len(&data, (size_t)length, 0, 1);
+    if (length < 0) {
 #ifdef DEBUG_MODE
         fputs("Invalid UTF-8\n", stderr);
 #endif
-        free(data);
         return EXIT_FAILURE;
     }
-#ifdef DEBUG_MODE
-    if (length < 1024) puts(data);
-#endif
-    length = convert_eol(&data, 0);
-    if (length < 0) return EXIT_FAILURE;
     close_socket_no_wait(socket);
     put_clipboard_text(data, (uint32_t)length);
     free(data);
     return EXIT_SUCCESS;
 }
 
-static int _transfer_regular_file(socket_t *socket, const char *file_path, const char *filename, size_t fname_len) {
+/*
+ * Send file_size bytes from the buffers of the reader, and stop the reader. The bytes sent are fed into the hash state if
+ * it is not NULL.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _send_file_data_pipelined(socket_t *socket, file_reader *reader, int64_t file_size, hash64_state *hash) {
+    int status = EXIT_SUCCESS;
+    while (file_size > 0) {
+        size_t len;
+        const char *buf = file_reader_next(reader, &len);
+        if (!buf || write_sock(socket, buf, len) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        // hashed while the reader reads the next buffers
+        if (hash) hash64_update(hash, buf, len);
+        file_size -= (int64_t)len;
+    }
+    file_reader_stop(reader);
+    return status;
+}
+
+/*
+ * Send the rest of the file, which has file_size bytes, as it is. The bytes sent are fed into the hash state if it is
+ * not NULL, in which case they are not sent directly from the file.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _send_file_data(socket_t *socket, FILE *fp, int64_t file_size, hash64_state *hash) {
+    if (!hash) {
+        const int direct_status = write_sock_from_file(socket, fp, file_size);
+        if (direct_status != DIRECT_IO_UNAVAILABLE) return direct_status;
+    }
+    // large files are read in a separate thread, so that sending does not wait on the disk and vice versa
+    if (file_size > FILE_READER_BUF_SIZE) {
+        file_reader *reader = file_reader_start(fp, file_size);
+        if (reader) return _send_file_data_pipelined(socket, reader, file_size, hash);
+    }
+    char data[FILE_BUF_SZ];
+    while (file_size > 0) {
+        // the data may be followed by more of the file, which is not sent
+        size_t read = fread(data, 1, (size_t)MIN(file_size, FILE_BUF_SZ), fp);
+        if (read == 0) continue;
+        if (write_sock(socket, data, read) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        if (hash) hash64_update(hash, data, read);
+        file_size -= (ssize_t)read;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int _transfer_regular_file(socket_t *socket, const char *file_path, const char *filename, size_t fname_len,
+                                  int compression) {
     FILE *fp = open_file(file_path, "rb");
     if (!fp) {
         error("Couldn't open some files");
@@ -197,18 +336,32 @@ static int _transfer_regular_file(socket_t *socket, const char *file_path, const
         return EXIT_FAILURE;
     }
 
-    char data[FILE_BUF_SZ];
-    while (file_size > 0) {
-        size_t read = fread(data, 1, FILE_BUF_SZ, fp);
-        if (read == 0) continue;
-        if (write_sock(socket, data, read) != EXIT_SUCCESS) {
-            fclose(fp);
-            return EXIT_FAILURE;
-        }
-        file_size -= (ssize_t)read;
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+    if (compression == SEND_HASHED) {
+        hash64_state hash;
+        hash64_init(&hash, 0);
+        int status = _send_file_data(socket, fp, file_size, &hash);
+        fclose(fp);
+        if (status == EXIT_SUCCESS) status = send_size(socket, (int64_t)hash64_digest(&hash));
+        return status;
+    }
+    if (compression == SEND_SPARSE) {
+        const int status = _send_file_extents(socket, fp, file_size);
+        fclose(fp);
+        return status;
+    }
+    if (compression != SEND_RAW) {
+        const int status = _send_file_compressed(socket, fp, file_size, compression);
+        fclose(fp);
+        return status;
     }
+#else
+    (void)compression;
+#endif
+
+    const int status = _send_file_data(socket, fp, file_size, NULL);
     fclose(fp);
-    return EXIT_SUCCESS;
+    return status;
 }
 
 #if PROTOCOL_MAX >= 3
@@ -223,7 +376,12 @@ static int _transfer_directory(socket_t *socket, const char *filename, size_t fn
 }
 #endif
 
-static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len) {
+/*
+ * Get the name of the file to send to the client. The name has / as the path separator for versions above 1, and ends
+ * with / if the file is a directory.
+ * returns the name allocated with malloc, and sets its length at len_p, on success or NULL on failure.
+ */
+static char *_get_send_name(int version, const char *file_path, size_t path_len, size_t *len_p) {
     const char *tmp_fname;
     switch (version) {
 #if PROTOCOL_MIN <= 1
@@ -237,7 +395,7 @@ static int _transfer_single_file(int version, socket_t *socket, const char *file
             break;
         }
 #endif
-#if (PROTOCOL_MIN <= 3) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
         case 2:
         case 3: {
             tmp_fname = file_path + path_len;
@@ -247,16 +405,17 @@ static int _transfer_single_file(int version, socket_t *socket, const char *file
         (void)path_len;
 #endif
         default: {
-            return EXIT_FAILURE;
+            return NULL;
         }
     }
 
     const size_t fname_len = strnlen(tmp_fname, MAX_FILE_NAME_LENGTH);
     if (fname_len <= 0 || fname_len > MAX_FILE_NAME_LENGTH) {
         error("Invalid file name length.");
-        return EXIT_FAILURE;
+        return NULL;
     }
-    char filename[fname_len + 1];
+    char *filename = malloc(fname_len + 1);
+    if (!filename) return NULL;
     strncpy(filename, tmp_fname, fname_len);
     filename[fname_len] = 0;
 
@@ -269,16 +428,30 @@ static int _transfer_single_file(int version, socket_t *socket, const char *file
     }
 #endif
 
+    *len_p = fname_len;
+    return filename;
+}
+
+static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len,
+                                 int compression) {
+    size_t fname_len;
+    char *filename = _get_send_name(version, file_path, path_len, &fname_len);
+    if (!filename) return EXIT_FAILURE;
+    int status;
 #if PROTOCOL_MAX >= 3
     if (filename[fname_len - 1] == '/') {  // filename is converted to have / as path separator on all platforms
         filename[fname_len - 1] = 0;
-        return _transfer_directory(socket, filename, fname_len - 1);
+        status = _transfer_directory(socket, filename, fname_len - 1);
+        free(filename);
+        return status;
     }
 #endif
-    return _transfer_regular_file(socket, file_path, filename, fname_len);
+    status = _transfer_regular_file(socket, file_path, filename, fname_len, compression);
+    free(filename);
+    return status;
 }
 
-static int _get_files_common(int version, socket_t *socket, list2 *file_list, size_t path_len) {
+static int _get_files_common(int version, socket_t *socket, list2 *file_list, size_t path_len, int compression) {
     if (!file_list || file_list->len == 0 || file_list->len >= 0xFFFFFFFFUL) {
         write_sock(socket, &(char){STATUS_NO_DATA}, 1);
         if (file_list) free_list(file_list);
@@ -286,40 +459,119 @@ static int _get_files_common(int version, socket_t *socket, list2 *file_list, si
         return EXIT_SUCCESS;
     }
 
-    uint32_t file_cnt = file_list->len;
-    char **files = (char **)file_list->array;
-#ifdef DEBUG_MODE
-    printf("%" PRIu32 "file(s)\n", file_cnt);
-#endif
     if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
         free_list(file_list);
         return EXIT_FAILURE;
     }
+    return _send_file_list(version, socket, file_list, path_len, compression);
+}
 
+static int _send_file_list(int version, socket_t *socket, list2 *file_list, size_t path_len, int compression) {
+    uint32_t file_cnt = file_list->len;
+    char **files = (char **)file_list->array;
+#ifdef DEBUG_MODE
+    printf("%" PRIu32 "file(s)\n", file_cnt);
+#endif
     if (send_size(socket, (int64_t)file_cnt) != EXIT_SUCCESS) {
         free_list(file_list);
         return EXIT_FAILURE;
     }
 
+    // the next files are opened and read ahead while a file is being sent
+    file_prefetch *prefetch = file_prefetch_start();
+    for (uint32_t i = 1; i < file_cnt && i < FILE_PREFETCH_AHEAD; i++) file_prefetch_add(prefetch, files[i]);
+    int status = EXIT_SUCCESS;
     for (uint32_t i = 0; i < file_cnt; i++) {
         const char *file_path = files[i];
 #ifdef DEBUG_MODE
         printf("file name = %s\n", file_path);
 #endif
+        if (file_cnt - i > FILE_PREFETCH_AHEAD) file_prefetch_add(prefetch, files[i + FILE_PREFETCH_AHEAD]);
 
-        if (_transfer_single_file(version, socket, file_path, path_len) != EXIT_SUCCESS) {
+        if (_transfer_single_file(version, socket, file_path, path_len, compression) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
             puts("Transfer failed");
 #endif
-            free_list(file_list);
-            return EXIT_FAILURE;
+            status = EXIT_FAILURE;
+            break;
         }
     }
+    if (prefetch) file_prefetch_stop(prefetch);
     free_list(file_list);
+    return status;
+}
+
+/*
+ * Read file_size bytes of the file contents from the socket into the buffers of the writer, and finish the writer. The
+ * bytes received are fed into the hash state if it is not NULL.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _receive_file_data_pipelined(socket_t *socket, file_writer *writer, int64_t file_size,
+                                        hash64_state *hash) {
+    int status = EXIT_SUCCESS;
+    while (file_size) {
+        char *buf = file_writer_buffer(writer);
+        if (!buf) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        size_t read_len = file_size < FILE_WRITER_BUF_SIZE ? (size_t)file_size : FILE_WRITER_BUF_SIZE;
+        if (read_sock(socket, buf, read_len) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+            puts("recieve error");
+#endif
+            status = EXIT_FAILURE;
+            break;
+        }
+        // hashed while the writer writes the previous buffers
+        if (hash) hash64_update(hash, buf, read_len);
+        file_writer_submit(writer, read_len);
+        file_size -= (int64_t)read_len;
+    }
+    if (file_writer_finish(writer) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    return status;
+}
+
+/*
+ * Read file_size bytes of the file contents from the socket and write them to the file in order, so that the file has
+ * no gaps if the transfer is interrupted. The bytes received are fed into the hash state if it is not NULL.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _receive_file_data_in_order(socket_t *socket, FILE *file, int64_t file_size, hash64_state *hash) {
+    // large files are written in a separate thread, so that receiving does not wait on the disk and vice versa
+    if (file_size > FILE_WRITER_BUF_SIZE) {
+        file_writer *writer = file_writer_start(file);
+        if (writer) return _receive_file_data_pipelined(socket, writer, file_size, hash);
+    }
+    char data[FILE_BUF_SZ];
+    while (file_size) {
+        size_t read_len = file_size < FILE_BUF_SZ ? (size_t)file_size : FILE_BUF_SZ;
+        if (read_sock(socket, data, read_len) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+            puts("recieve error");
+#endif
+            return EXIT_FAILURE;
+        }
+        if (fwrite(data, 1, read_len, file) < read_len) {
+            return EXIT_FAILURE;
+        }
+        if (hash) hash64_update(hash, data, read_len);
+        file_size -= (int64_t)read_len;
+    }
     return EXIT_SUCCESS;
 }
 
-static int _save_file_common(int version, socket_t *socket, const char *file_name) {
+/*
+ * Read file_size bytes of the file contents from the socket and write them to the file.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _receive_file_data(socket_t *socket, FILE *file, int64_t file_size) {
+    const int direct_status = read_sock_to_file(socket, file, file_size);
+    if (direct_status != DIRECT_IO_UNAVAILABLE) return direct_status;
+    return _receive_file_data_in_order(socket, file, file_size, NULL);
+}
+
+static int _save_file_common(int version, socket_t *socket, const char *file_name, int framing, int *corrupted_p) {
     int64_t file_size;
     if (read_size(socket, &file_size) != EXIT_SUCCESS) return EXIT_FAILURE;
 #ifdef DEBUG_MODE
@@ -329,7 +581,7 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
         return EXIT_FAILURE;
     }
 
-#if (PROTOCOL_MIN <= 3) && (3 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 4) && (3 <= PROTOCOL_MAX)
     if (file_size == -1 && version == 3) {
         return mkdirs(file_name);
     }
@@ -346,23 +598,41 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
         return EXIT_FAILURE;
     }
 
-    char data[FILE_BUF_SZ];
-    while (file_size) {
-        size_t read_len = file_size < FILE_BUF_SZ ? (size_t)file_size : FILE_BUF_SZ;
-        if (read_sock(socket, data, read_len) != EXIT_SUCCESS) {
-#ifdef DEBUG_MODE
-            puts("recieve error");
-#endif
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+    if (framing == SEND_SPARSE) {
+        const int status = _receive_file_extents(socket, file, file_size);
+        fclose(file);
+        if (status != EXIT_SUCCESS) remove_file(file_name);
+        return status;
+    }
+    if (framing == SEND_HASHED) {
+        hash64_state hash;
+        hash64_init(&hash, 0);
+        int64_t expected_hash;
+        if (_receive_file_data_in_order(socket, file, file_size, &hash) != EXIT_SUCCESS ||
+            read_size(socket, &expected_hash) != EXIT_SUCCESS) {
             fclose(file);
             remove_file(file_name);
             return EXIT_FAILURE;
         }
-        if (fwrite(data, 1, read_len, file) < read_len) {
-            fclose(file);
+        fclose(file);
+        if (hash64_digest(&hash) != (uint64_t)expected_hash) {
+#ifdef DEBUG_MODE
+            printf("hash mismatch : %s\n", file_name);
+#endif
             remove_file(file_name);
-            return EXIT_FAILURE;
+            *corrupted_p = 1;
         }
-        file_size -= (int64_t)read_len;
+        return EXIT_SUCCESS;
+    }
+#else
+    (void)framing;
+    (void)corrupted_p;
+#endif
+    if (_receive_file_data(socket, file, file_size) != EXIT_SUCCESS) {
+        fclose(file);
+        remove_file(file_name);
+        return EXIT_FAILURE;
     }
 
     fclose(file);
@@ -424,7 +694,7 @@ static inline int _rename_if_exists(char *file_name, size_t max_len) {
 
 int get_files_v1(socket_t *socket) {
     list2 *file_list = get_copied_files();
-    return _get_files_common(1, socket, file_list, 0);
+    return _get_files_common(1, socket, file_list, 0, SEND_RAW);
 }
 
 int send_file_v1(socket_t *socket) {
@@ -465,7 +735,7 @@ int send_file_v1(socket_t *socket) {
     // if file already exists, use a different file name
     if (_rename_if_exists(file_name, name_max_len) != EXIT_SUCCESS) return EXIT_FAILURE;
 
-    if (_save_file_common(1, socket, file_name) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (_save_file_common(1, socket, file_name, SEND_RAW, NULL) != EXIT_SUCCESS) return EXIT_FAILURE;
     close_socket_no_wait(socket);
 
     int status = EXIT_SUCCESS;
@@ -524,7 +794,7 @@ int info_v1(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
-#if (PROTOCOL_MIN <= 3) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
 /*
  * Make parent directories for path
  */
@@ -540,30 +810,18 @@ static inline int _make_directories(const char *path) {
     return EXIT_SUCCESS;
 }
 
-static int save_file(int version, socket_t *socket, const char *dirname) {
-    int64_t fname_size;
-    if (read_size(socket, &fname_size) != EXIT_SUCCESS) return EXIT_FAILURE;
-#ifdef DEBUG_MODE
-    printf("name_len = %" PRId64 "\n", fname_size);
-#endif
-    // limit file name length to 1024 chars
-    if (fname_size <= 0 || fname_size > MAX_FILE_NAME_LENGTH) return EXIT_FAILURE;
-
-    const size_t name_length = (size_t)fname_size;
-    char file_name[name_length + 1];
-    if (read_sock(socket, file_name, name_length) != EXIT_SUCCESS) {
-#ifdef DEBUG_MODE
-        fputs("Read file name failed\n", stderr);
-#endif
-        return EXIT_FAILURE;
-    }
-
-    file_name[name_length] = 0;
+/*
+ * Validate the file name of name_length bytes, received from the client, and convert it to a path in the directory
+ * dirname. The file name is modified, and must be followed by a terminating '\0'.
+ * returns the path allocated with malloc on success or NULL on failure.
+ */
+static char *_file_path_from_name(char *file_name, size_t name_length, const char *dirname) {
+    if (name_length == 0 || name_length > MAX_FILE_NAME_LENGTH) return NULL;
     if (_is_valid_fname(file_name, name_length) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
         printf("Invalid filename \'%s\'\n", file_name);
 #endif
-        return EXIT_FAILURE;
+        return NULL;
     }
     if (file_name[name_length - 1] == '/') file_name[name_length - 1] = 0;  // remove trailing /
 
@@ -572,64 +830,140 @@ static int save_file(int version, socket_t *socket, const char *dirname) {
     for (size_t ind = 0; ind < name_length; ind++) {
         if (file_name[ind] == '/') {
             file_name[ind] = PATH_SEP;
-            if (ind > 0 && file_name[ind - 1] == PATH_SEP) return EXIT_FAILURE;  // "//" in path not allowed
+            if (ind > 0 && file_name[ind - 1] == PATH_SEP) return NULL;  // "//" in path not allowed
         }
     }
 #endif
 
-    char new_path[name_length + 20];
+    // the directories that files are received into have names no longer than that of a resumable upload
+    const size_t path_max_len = name_length + RESUME_DIR_NAME_LEN + 2;
+    char new_path[path_max_len];
     if (file_name[0] == PATH_SEP) {
-        if (snprintf_check(new_path, name_length + 20, "%s%s", dirname, file_name)) return EXIT_FAILURE;
+        if (snprintf_check(new_path, path_max_len, "%s%s", dirname, file_name)) return NULL;
     } else {
-        if (snprintf_check(new_path, name_length + 20, "%s%c%s", dirname, PATH_SEP, file_name)) return EXIT_FAILURE;
+        if (snprintf_check(new_path, path_max_len, "%s%c%s", dirname, PATH_SEP, file_name)) return NULL;
     }
 
     // path must not contain /../ (go to parent dir)
-    if (strstr(new_path, bad_path)) return EXIT_FAILURE;
+    if (strstr(new_path, bad_path)) return NULL;
+
+    return strdup(new_path);
+}
+
+/*
+ * Read a file name from the socket and validate it.
+ * returns the path to save the file in the directory dirname, allocated with malloc, on success or NULL on failure.
+ */
+static char *_read_file_path(socket_t *socket, const char *dirname) {
+    int64_t fname_size;
+    if (read_size(socket, &fname_size) != EXIT_SUCCESS) return NULL;
+#ifdef DEBUG_MODE
+    printf("name_len = %" PRId64 "\n", fname_size);
+#endif
+    // limit file name length to 1024 chars
+    if (fname_size <= 0 || fname_size > MAX_FILE_NAME_LENGTH) return NULL;
+
+    const size_t name_length = (size_t)fname_size;
+    char file_name[name_length + 1];
+    if (read_sock(socket, file_name, name_length) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        fputs("Read file name failed\n", stderr);
+#endif
+        return NULL;
+    }
+
+    file_name[name_length] = 0;
+    return _file_path_from_name(file_name, name_length, dirname);
+}
+
+static int save_file(int version, socket_t *socket, const char *dirname, int framing, int *corrupted_p) {
+    char *new_path = _read_file_path(socket, dirname);
+    if (!new_path) return EXIT_FAILURE;
 
+    int status = EXIT_SUCCESS;
     // make parent directories
-    if (_make_directories(new_path) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (_make_directories(new_path) != EXIT_SUCCESS) status = EXIT_FAILURE;
 
     // check if file exists
-    if (file_exists(new_path)) return EXIT_FAILURE;
+    if (status == EXIT_SUCCESS && file_exists(new_path)) status = EXIT_FAILURE;
+
+    if (status == EXIT_SUCCESS) status = _save_file_common(version, socket, new_path, framing, corrupted_p);
+    free(new_path);
+    return status;
+}
+
+/*
+ * Write the path in the working directory to try for the received entry filename into new_path. The index 0 is the
+ * name itself, and the other indices prefix the name with "<index>_".
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _indexed_path(char *new_path, size_t max_len, const char *filename, unsigned index) {
+    // "./" is important to prevent file names like "C:\path"
+    if (index == 0) return snprintf_check(new_path, max_len, ".%c%s", PATH_SEP, filename);
+    return snprintf_check(new_path, max_len, ".%c%u_%s", PATH_SEP, index, filename);
+}
 
-    return _save_file_common(version, socket, new_path);
+/*
+ * Find an index above *index_p, at most MAX_NAME_INDEX, of which the path is free, and write the path into new_path and
+ * the index into *index_p. The index is doubled until a free path is found, and then halved back with a binary search,
+ * so that only O(log n) paths are checked when n copies of the name exist.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _find_free_index(char *new_path, size_t max_len, const char *filename, unsigned *index_p) {
+    unsigned low = *index_p;
+    if (low >= MAX_NAME_INDEX) return EXIT_FAILURE;
+    unsigned high = low + 1;
+    while (1) {
+        if (_indexed_path(new_path, max_len, filename, high)) return EXIT_FAILURE;
+        if (!file_exists(new_path)) break;
+        if (high == MAX_NAME_INDEX) return EXIT_FAILURE;
+        low = high;
+        high = MIN(high * 2, MAX_NAME_INDEX);
+    }
+    // the path of low is taken and the path of high is free
+    while (high - low > 1) {
+        const unsigned mid = low + (high - low) / 2;
+        if (_indexed_path(new_path, max_len, filename, mid)) return EXIT_FAILURE;
+        if (file_exists(new_path)) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    *index_p = high;
+    return _indexed_path(new_path, max_len, filename, high);
 }
 
-static char *_check_and_rename(const char *filename, const char *dirname) {
-    const size_t name_len = strnlen(filename, MAX_FILE_NAME_LENGTH);
+/*
+ * Move the received entry filename from dir to the working directory, renaming it if its name is taken.
+ * returns the absolute path of the moved entry, which should be freed by the caller, or NULL on failure.
+ */
+static char *_move_received_entry(received_dir *dir, const char *filename) {
+    const size_t name_len = strnlen(filename, MAX_FILE_NAME_LENGTH + 1);
     if (name_len > MAX_FILE_NAME_LENGTH) {
         error("Too long file name.");
         return NULL;
     }
     const size_t name_max_len = name_len + 20;
-    char old_path[name_max_len];
-    if (snprintf_check(old_path, name_max_len, "%s%c%s", dirname, PATH_SEP, filename)) return NULL;
-
     char new_path[name_max_len];
-    if (configuration.working_dir != NULL || strcmp(filename, "clipshare.conf")) {
-        // "./" is important to prevent file names like "C:\path"
-        if (snprintf_check(new_path, name_max_len, ".%c%s", PATH_SEP, filename)) return NULL;
-    } else {
-        // do not create file named clipshare.conf. "./" is important to prevent file names like "C:\path"
-        if (snprintf_check(new_path, name_max_len, ".%c1_%s", PATH_SEP, filename)) return NULL;
-    }
 
-    // if new_path already exists, use a different file name
-    int n = 1;
-    while (file_exists(new_path)) {
-        if (n > 999999L) return NULL;
-        if (snprintf_check(new_path, name_max_len, ".%c%i_%s", PATH_SEP, n++, filename)) return NULL;
-    }
-
-    if (rename_file(old_path, new_path)) {
+    // do not create file named clipshare.conf
+    unsigned index = (configuration.working_dir != NULL || strcmp(filename, "clipshare.conf")) ? 0 : 1;
+    if (_indexed_path(new_path, name_max_len, filename, index)) return NULL;
+    while (1) {
+        const int status = move_received_entry(dir, filename, new_path);
+        if (status == EXIT_SUCCESS) break;
+        // the path may have been taken after it was found to be free. The search continues above it
+        if (status != MOVE_EXISTS || _find_free_index(new_path, name_max_len, filename, &index) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
-        printf("Rename failed : %s\n", new_path);
+            printf("Rename failed : %s\n", new_path);
 #endif
-        return NULL;
+            return NULL;
+        }
     }
 
     char *path = (char *)malloc(cwd_len + name_max_len + 2);  // for PATH_SEP and null terminator
+    if (!path) return NULL;
     strncpy(path, cwd, cwd_len + 1);
     size_t p_len = cwd_len;
     path[p_len++] = PATH_SEP;
@@ -638,44 +972,51 @@ static char *_check_and_rename(const char *filename, const char *dirname) {
     return path;
 }
 
-static int _send_files_dirs(int version, socket_t *socket) {
-    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
-    int64_t cnt;
-    if (read_size(socket, &cnt) != EXIT_SUCCESS) return EXIT_FAILURE;
-    if (cnt <= 0 || cnt >= 0xFFFFFFFFLL) return EXIT_FAILURE;
-    char dirname[17];
+/*
+ * Create a new directory with a random name, in the working directory, to receive files into. dirname must have space
+ * for RECEIVE_DIR_NAME_LEN bytes.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _make_receive_dir(char *dirname) {
     unsigned id = (unsigned)time(NULL);
     do {
-        if (snprintf_check(dirname, 17, ".%c%x", PATH_SEP, id)) return EXIT_FAILURE;
+        if (snprintf_check(dirname, RECEIVE_DIR_NAME_LEN, ".%c%x", PATH_SEP, id)) return EXIT_FAILURE;
         id = (unsigned)rand();
     } while (file_exists(dirname));
 
-    if (mkdirs(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
-
-    for (int64_t file_num = 0; file_num < cnt; file_num++) {
-        if (save_file(version, socket, dirname) != EXIT_SUCCESS) {
-            return EXIT_FAILURE;
-        }
-    }
-    close_socket_no_wait(socket);
+    return mkdirs(dirname);
+}
 
+/*
+ * Move the files received into the directory dirname to the working directory, renaming them if their names are
+ * taken, and remove the directory. Cuts the moved files to the clipboard if configuration.cut_sent_files is set.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _move_received_files(const char *dirname) {
+    received_dir *dir = open_received_dir(dirname);
+    if (!dir) return EXIT_FAILURE;
     list2 *files = list_dir(dirname);
-    if (!files) return EXIT_FAILURE;
+    if (!files) {
+        close_received_dir(dir);
+        return EXIT_FAILURE;
+    }
     int status = EXIT_SUCCESS;
     list2 *dest_files = init_list(files->len);
     if (!dest_files) {
         free_list(files);
+        close_received_dir(dir);
         return EXIT_FAILURE;
     }
     for (uint32_t i = 0; i < files->len; i++) {
         const char *filename = files->array[i];
-        char *new_path = _check_and_rename(filename, dirname);
+        char *new_path = _move_received_entry(dir, filename);
         if (new_path)
             append(dest_files, new_path);
         else
             status = EXIT_FAILURE;
     }
     free_list(files);
+    close_received_dir(dir);
     if (status == EXIT_SUCCESS && remove_directory(dirname)) status = EXIT_FAILURE;
     if (configuration.cut_sent_files && status == EXIT_SUCCESS && set_clipboard_cut_files(dest_files) != EXIT_SUCCESS)
         status = EXIT_FAILURE;
@@ -683,16 +1024,34 @@ static int _send_files_dirs(int version, socket_t *socket) {
     return status;
 }
 
-#endif
+static int _send_files_dirs(int version, socket_t *socket, int framing) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t cnt;
+    if (read_size(socket, &cnt) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (cnt <= 0 || cnt >= 0xFFFFFFFFLL) return EXIT_FAILURE;
+    char dirname[RECEIVE_DIR_NAME_LEN];
+    if (_make_receive_dir(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
 
-#if (PROTOCOL_MIN <= 2) && (2 <= PROTOCOL_MAX)
-int get_files_v2(socket_t *socket) {
-    dir_files copied_dir_files;
-    get_copied_dirs_files(&copied_dir_files, 0);
-    return _get_files_common(2, socket, copied_dir_files.lst, copied_dir_files.path_len);
+    for (int64_t file_num = 0; file_num < cnt; file_num++) {
+        if (save_file(version, socket, dirname, framing, NULL) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    close_socket_no_wait(socket);
+
+    return _move_received_files(dirname);
+}
+
+#endif
+
+#if (PROTOCOL_MIN <= 2) && (2 <= PROTOCOL_MAX)
+int get_files_v2(socket_t *socket) {
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, 0);
+    return _get_files_common(2, socket, copied_dir_files.lst, copied_dir_files.path_len, SEND_RAW);
 }
 
-int send_files_v2(socket_t *socket) { return _send_files_dirs(2, socket); }
+int send_files_v2(socket_t *socket) { return _send_files_dirs(2, socket, SEND_RAW); }
 #endif
 
 #if (PROTOCOL_MIN <= 3) && (3 <= PROTOCOL_MAX)
@@ -705,12 +1064,1741 @@ int get_screenshot_v3(socket_t *socket) {
     if (disp <= 0 || disp > 65536L) disp = 0;
     return _get_image_common(socket, IMG_SCRN_ONLY, (uint16_t)disp);
 }
+#endif
 
+#if (PROTOCOL_MIN <= 4) && (3 <= PROTOCOL_MAX)
 int get_files_v3(socket_t *socket) {
     dir_files copied_dir_files;
     get_copied_dirs_files(&copied_dir_files, 1);
-    return _get_files_common(3, socket, copied_dir_files.lst, copied_dir_files.path_len);
+    return _get_files_common(3, socket, copied_dir_files.lst, copied_dir_files.path_len, SEND_RAW);
+}
+
+int send_files_v3(socket_t *socket) { return _send_files_dirs(3, socket, SEND_RAW); }
+#endif
+
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+
+/*
+ * State of sending an image in chunks. The STATUS_OK is sent with the first chunk.
+ */
+typedef struct _image_chunk_sender {
+    socket_t *socket;
+    uint64_t total;
+    int started;
+    const uint64_t *hash;  // if not NULL, the hash is sent after the STATUS_OK
+} image_chunk_sender;
+
+static int _send_image_chunk(void *arg, const char *data, size_t len) {
+    image_chunk_sender *sender = (image_chunk_sender *)arg;
+    if (len == 0) return EXIT_SUCCESS;
+    sender->total += len;
+    if (sender->total > MAX_IMAGE_SIZE) return EXIT_FAILURE;
+    if (!sender->started) {
+        if (write_sock(sender->socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (sender->hash && send_size(sender->socket, (int64_t)*(sender->hash)) != EXIT_SUCCESS) return EXIT_FAILURE;
+        sender->started = 1;
+    }
+    return _send_data(sender->socket, (int64_t)len, data);
+}
+
+/*
+ * Send the image as a sequence of chunks, each having its size followed by the data, while it is being encoded.
+ * A chunk size of 0 marks the end of the image, and -1 marks that the image was aborted after sending some chunks.
+ */
+static int _get_image_chunked_common(socket_t *socket, int mode, uint16_t disp, const capture_region *region) {
+    image_chunk_sender sender = {.socket = socket, .total = 0, .started = 0};
+    int status = get_image_chunked(mode, disp, region, &_send_image_chunk, &sender);
+    if (!sender.started) {
+#ifdef DEBUG_MODE
+        printf("get image failed. len = %" PRIu64 "\n", sender.total);
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+#ifdef DEBUG_MODE
+    printf("Len = %" PRIu64 "\n", sender.total);
+#endif
+    if (status != EXIT_SUCCESS) {
+        send_size(socket, -1);
+        return EXIT_FAILURE;
+    }
+    return send_size(socket, 0);
+}
+
+int get_image_v4(socket_t *socket) { return _get_image_chunked_common(socket, IMG_ANY, 0, NULL); }
+
+int get_copied_image_v4(socket_t *socket) { return _get_image_chunked_common(socket, IMG_COPIED_ONLY, 0, NULL); }
+
+int get_screenshot_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t disp;
+    if (read_size(socket, &disp) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (disp <= 0 || disp > 65536L) disp = 0;
+    return _get_image_chunked_common(socket, IMG_SCRN_ONLY, (uint16_t)disp, NULL);
+}
+
+int get_screenshot_delta_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t disp;
+    if (read_size(socket, &disp) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (disp <= 0 || disp > 65536L) disp = 0;
+    int64_t base_frame;
+    if (read_size(socket, &base_frame) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (base_frame < 0) base_frame = 0;
+
+    screenshot_delta delta;
+    if (get_screenshot_delta((uint16_t)disp, (uint64_t)base_frame, &delta) != EXIT_SUCCESS || !delta.tiles) {
+#ifdef DEBUG_MODE
+        puts("get screenshot delta failed");
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    list2 *tiles = delta.tiles;
+#ifdef DEBUG_MODE
+    printf("frame = %" PRIu64 ", base = %" PRIu64 ", tiles = %" PRIu32 "\n", delta.frame_id, delta.base_id, tiles->len);
+#endif
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS || send_size(socket, (int64_t)delta.frame_id) ||
+        send_size(socket, (int64_t)delta.base_id) || send_size(socket, (int64_t)delta.width) ||
+        send_size(socket, (int64_t)delta.height) || send_size(socket, SCREENSHOT_TILE_SIZE) ||
+        send_size(socket, (int64_t)tiles->len)) {
+        free_list(tiles);
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < tiles->len; i++) {
+        const img_tile *tile = (const img_tile *)tiles->array[i];
+        if (send_size(socket, (int64_t)tile->col) || send_size(socket, (int64_t)tile->row) ||
+            _send_data(socket, (int64_t)tile->len, tile->data) != EXIT_SUCCESS) {
+            free_list(tiles);
+            return EXIT_FAILURE;
+        }
+    }
+    free_list(tiles);
+    return EXIT_SUCCESS;
+}
+
+int stream_screen_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t disp;
+    if (read_size(socket, &disp) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (disp <= 0 || disp > 65536L) disp = 0;
+    int64_t fps;
+    if (read_size(socket, &fps) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (fps <= 0) fps = 1;
+    if (fps > MAX_STREAM_FPS) fps = MAX_STREAM_FPS;
+
+    screen_stream *stream = start_screen_stream((uint16_t)disp, (uint32_t)fps);
+    if (!stream) {
+#ifdef DEBUG_MODE
+        puts("start screen stream failed");
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
+        stop_screen_stream(stream);
+        return EXIT_FAILURE;
+    }
+
+    const int interval_ms = (int)(1000 / fps);
+    int status = EXIT_SUCCESS;
+    while (1) {
+        const int sock_status = poll_sock(socket, interval_ms);
+        // the client stops the stream by sending a byte or closing the connection
+        if (sock_status < 0 || (sock_status & SOCK_READABLE)) break;
+        // the client is not keeping up. frames captured meanwhile are dropped
+        if (!(sock_status & SOCK_WRITABLE)) continue;
+
+        uint32_t length = 0;
+        char *buf = NULL;
+        if (get_stream_frame(stream, &buf, &length) != EXIT_SUCCESS || length == 0 || length > MAX_IMAGE_SIZE) {
+            if (buf) free(buf);
+            // a frame of size 0 marks the end of the stream
+            if (send_size(socket, 0) != EXIT_SUCCESS) status = EXIT_FAILURE;
+            break;
+        }
+        if (_send_data(socket, (int64_t)length, buf) != EXIT_SUCCESS) {
+            free(buf);
+            status = EXIT_FAILURE;
+            break;
+        }
+        free(buf);
+    }
+    stop_screen_stream(stream);
+    return status;
+}
+
+int get_screenshot_region_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t disp;
+    if (read_size(socket, &disp) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (disp <= 0 || disp > 65536L) disp = 0;
+    // x, y, width, height, max_width, and max_height
+    int64_t params[6];
+    for (int i = 0; i < 6; i++) {
+        if (read_size(socket, &(params[i])) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (params[i] < 0 || params[i] > 65536L) params[i] = 0;
+    }
+    capture_region region = {.x = (uint32_t)params[0],
+                             .y = (uint32_t)params[1],
+                             .width = (uint32_t)params[2],
+                             .height = (uint32_t)params[3],
+                             .max_width = (uint32_t)params[4],
+                             .max_height = (uint32_t)params[5]};
+    return _get_image_chunked_common(socket, IMG_SCRN_ONLY, (uint16_t)disp, &region);
+}
+
+int list_displays_v4(socket_t *socket) {
+    list2 *displays = get_displays();
+    if (!displays || displays->len == 0) {
+#ifdef DEBUG_MODE
+        puts("get displays failed");
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (displays) free_list(displays);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS || send_size(socket, displays->len) != EXIT_SUCCESS) {
+        free_list(displays);
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < displays->len; i++) {
+        const display_info *display = (const display_info *)displays->array[i];
+        if (_send_data(socket, (int64_t)strnlen(display->name, MAX_DISPLAY_NAME_LEN), display->name) != EXIT_SUCCESS ||
+            send_size(socket, display->x) != EXIT_SUCCESS || send_size(socket, display->y) != EXIT_SUCCESS ||
+            send_size(socket, display->width) != EXIT_SUCCESS || send_size(socket, display->height) != EXIT_SUCCESS ||
+            send_size(socket, display->primary) != EXIT_SUCCESS) {
+            free_list(displays);
+            return EXIT_FAILURE;
+        }
+    }
+    free_list(displays);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Send the image in the buffer as a sequence of chunks, as in _get_image_chunked_common. The status must have been sent
+ * already.
+ */
+static int _send_image_buffer(socket_t *socket, const char *buf, uint32_t length) {
+    image_chunk_sender sender = {.socket = socket, .total = 0, .started = 1};
+    for (uint32_t offset = 0; offset < length; offset += IMAGE_CHUNK_SIZE) {
+        const uint32_t cnt = length - offset < IMAGE_CHUNK_SIZE ? length - offset : IMAGE_CHUNK_SIZE;
+        if (_send_image_chunk(&sender, buf + offset, cnt) != EXIT_SUCCESS) {
+            send_size(socket, -1);
+            return EXIT_FAILURE;
+        }
+    }
+    return send_size(socket, 0);
+}
+
+int get_copied_image_native_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t formats;
+    if (read_size(socket, &formats) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (formats < 0 || formats > 0xFFFF) formats = 0;
+
+    int format = 0;
+    uint32_t length = 0;
+    char *buf = NULL;
+    if (get_copied_image_native((int)formats, &format, &buf, &length) != EXIT_SUCCESS || length == 0 ||
+        length > MAX_IMAGE_SIZE) {  // do not change the order
+#ifdef DEBUG_MODE
+        printf("get copied image failed. len = %" PRIu32 "\n", length);
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (buf) free(buf);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+#ifdef DEBUG_MODE
+    printf("Format = %d, Len = %" PRIu32 "\n", format, length);
+#endif
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS || send_size(socket, format) != EXIT_SUCCESS) {
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    const int status = _send_image_buffer(socket, buf, length);
+    free(buf);
+    return status;
+}
+
+static int _send_chunk(void *arg, const char *data, size_t len) {
+    return _send_data((socket_t *)arg, (int64_t)len, data);
+}
+
+/*
+ * Finish the compressed stream if status is EXIT_SUCCESS, and free the compressor.
+ * Sends the chunk size 0 to mark the end of the stream, or -1 if the stream was aborted.
+ */
+static int _end_compressed_stream(socket_t *socket, compressor *comp, int status) {
+    if (status == EXIT_SUCCESS) status = compressor_finish(comp);
+    compressor_free(comp);
+    if (status != EXIT_SUCCESS) {
+        send_size(socket, -1);
+        return EXIT_FAILURE;
+    }
+    return send_size(socket, 0);
+}
+
+static int _send_file_compressed(socket_t *socket, FILE *fp, int64_t file_size, int compression) {
+    char data[FILE_BUF_SZ];
+    size_t read_len = 0;
+    if (file_size > 0) {
+        read_len = fread(data, 1, (size_t)MIN(file_size, FILE_BUF_SZ), fp);
+        if (read_len == 0) return EXIT_FAILURE;
+    }
+    if (read_len == 0 || !is_compressible(data, read_len)) compression = COMPRESSION_NONE;
+    if (send_size(socket, compression) != EXIT_SUCCESS) return EXIT_FAILURE;
+    compressor *comp = compressor_new(compression, &_send_chunk, socket);
+    if (!comp) {
+        send_size(socket, -1);
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    while (read_len > 0) {
+        if (compressor_write(comp, data, read_len) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        file_size -= (int64_t)read_len;
+        if (file_size <= 0) break;
+        read_len = fread(data, 1, (size_t)MIN(file_size, FILE_BUF_SZ), fp);
+        // the file was truncated while reading
+        if (read_len == 0) status = EXIT_FAILURE;
+    }
+    return _end_compressed_stream(socket, comp, status);
+}
+
+int get_text_compressed_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t accepted;
+    if (read_size(socket, &accepted) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    int64_t length;
+    char *buf = _get_text_lf(&length);
+    if (!buf) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    const int compression = choose_compression(accepted);
+#ifdef DEBUG_MODE
+    printf("Compression = %d\n", compression);
+#endif
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS || send_size(socket, length) != EXIT_SUCCESS ||
+        send_size(socket, compression) != EXIT_SUCCESS) {
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    compressor *comp = compressor_new(compression, &_send_chunk, socket);
+    if (!comp) {
+        free(buf);
+        send_size(socket, -1);
+        return EXIT_FAILURE;
+    }
+    const int status = compressor_write(comp, buf, (size_t)length);
+    free(buf);
+    return _end_compressed_stream(socket, comp, status);
+}
+
+int get_files_compressed_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t accepted;
+    if (read_size(socket, &accepted) != EXIT_SUCCESS) return EXIT_FAILURE;
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, 1);
+    return _get_files_common(3, socket, copied_dir_files.lst, copied_dir_files.path_len,
+                             choose_compression(accepted));
+}
+
+/*
+ * Read the hash of the content the client already has. A hash of 0 never matches.
+ */
+static inline int _read_known_hash(socket_t *socket, uint64_t *hash_p) {
+    int64_t known;
+    if (read_size(socket, &known) != EXIT_SUCCESS) return EXIT_FAILURE;
+    *hash_p = (uint64_t)known;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Send STATUS_NOT_MODIFIED if hash is the hash the client already has, or STATUS_OK followed by the hash otherwise.
+ * Sets *modified_p to 1 if the content needs to be sent, or 0 otherwise.
+ */
+static int _send_hash_status(socket_t *socket, uint64_t known_hash, uint64_t hash, int *modified_p) {
+    *modified_p = (known_hash == 0 || hash != known_hash);
+    if (!*modified_p) {
+#ifdef DEBUG_MODE
+        puts("Not modified");
+#endif
+        write_sock(socket, &(char){STATUS_NOT_MODIFIED}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    return send_size(socket, (int64_t)hash);
+}
+
+int get_text_if_changed_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    uint64_t known_hash;
+    if (_read_known_hash(socket, &known_hash) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    int64_t length;
+    char *buf = _get_text_lf(&length);
+    if (!buf) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    const uint64_t hash = hash64(buf, (size_t)length, 0);
+    // the client may ask for a delta against this text later
+    text_history_add(buf, (uint32_t)length, hash);
+    int modified;
+    if (_send_hash_status(socket, known_hash, hash, &modified) != EXIT_SUCCESS) {
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    const int status = modified ? _send_data(socket, length, buf) : EXIT_SUCCESS;
+    free(buf);
+    return status;
+}
+
+/*
+ * Hash the relative paths of the files in the list together with their sizes and modification times. The contents of
+ * the files are not read.
+ */
+static uint64_t _hash_file_list(const list2 *file_list, size_t path_len) {
+    hash64_state state;
+    hash64_init(&state, (uint64_t)file_list->len);
+    for (uint32_t i = 0; i < file_list->len; i++) {
+        const char *file_path = (const char *)file_list->array[i];
+        const char *rel_path = strlen(file_path) > path_len ? file_path + path_len : file_path;
+        // the terminating '\0' separates the path from the next fields
+        hash64_update(&state, rel_path, strlen(rel_path) + 1);
+        int64_t stat_vals[2];
+        if (get_file_stat(file_path, &(stat_vals[0]), &(stat_vals[1])) != EXIT_SUCCESS) {
+            stat_vals[0] = -1;
+            stat_vals[1] = -1;
+        }
+        hash64_update(&state, stat_vals, sizeof(stat_vals));
+    }
+    return hash64_digest(&state);
+}
+
+int get_files_if_changed_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    uint64_t known_hash;
+    if (_read_known_hash(socket, &known_hash) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, 1);
+    list2 *file_list = copied_dir_files.lst;
+    if (!file_list || file_list->len == 0 || file_list->len >= 0xFFFFFFFFUL) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (file_list) free_list(file_list);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    int modified;
+    const uint64_t hash = _hash_file_list(file_list, copied_dir_files.path_len);
+    if (_send_hash_status(socket, known_hash, hash, &modified) != EXIT_SUCCESS) {
+        free_list(file_list);
+        return EXIT_FAILURE;
+    }
+    if (!modified) {
+        free_list(file_list);
+        return EXIT_SUCCESS;
+    }
+    return _send_file_list(3, socket, file_list, copied_dir_files.path_len, SEND_RAW);
+}
+
+int get_copied_image_if_changed_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    uint64_t known_hash;
+    if (_read_known_hash(socket, &known_hash) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    uint32_t length = 0;
+    char *buf = NULL;
+    if (get_image(&buf, &length, IMG_COPIED_ONLY, 0) != EXIT_SUCCESS || length == 0 ||
+        length > MAX_IMAGE_SIZE) {  // do not change the order
+#ifdef DEBUG_MODE
+        printf("get copied image failed. len = %" PRIu32 "\n", length);
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (buf) free(buf);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    int modified;
+    if (_send_hash_status(socket, known_hash, hash64(buf, length, 0), &modified) != EXIT_SUCCESS) {
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    const int status = modified ? _send_image_buffer(socket, buf, length) : EXIT_SUCCESS;
+    free(buf);
+    return status;
+}
+
+int get_screenshot_if_changed_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t disp;
+    if (read_size(socket, &disp) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (disp <= 0 || disp > 65536L) disp = 0;
+    uint64_t known_hash;
+    if (_read_known_hash(socket, &known_hash) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    uint64_t hash = 0;
+    image_chunk_sender sender = {.socket = socket, .total = 0, .started = 0, .hash = &hash};
+    int status = get_screenshot_if_changed((uint16_t)disp, known_hash, &hash, &_send_image_chunk, &sender);
+    if (!sender.started) {
+        // the writer is not called only when the screenshot is not modified. known_hash 0 always gets the screenshot
+        if (status == EXIT_SUCCESS && known_hash != 0 && hash == known_hash) {
+            int modified;
+            return _send_hash_status(socket, known_hash, hash, &modified);
+        }
+#ifdef DEBUG_MODE
+        printf("get screenshot failed. len = %" PRIu64 "\n", sender.total);
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    if (status != EXIT_SUCCESS) {
+        send_size(socket, -1);
+        return EXIT_FAILURE;
+    }
+    return send_size(socket, 0);
+}
+
+/*
+ * Compute a delta of the text against the text in the history with the hash base_hash.
+ * returns EXIT_SUCCESS if the delta is smaller to send than the text, or EXIT_FAILURE if the full text should be sent.
+ */
+static int _text_delta(uint64_t base_hash, const char *text, int64_t length, data_delta *dlt) {
+    uint32_t base_len = 0;
+    char *base = base_hash ? text_history_get(base_hash, &base_len) : NULL;
+    if (!base) return EXIT_FAILURE;
+    const int status = delta_compute(base, base_len, text, (size_t)length, dlt);
+    free(base);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+    // each copy is sent as two numeric values, and each insert as its length and the data
+    uint64_t delta_size = 8;
+    for (size_t i = 0; i < dlt->count && delta_size < (uint64_t)length; i++) {
+        delta_size += dlt->ops[i].copy ? 16 : 8 + dlt->ops[i].len;
+    }
+    if (delta_size >= (uint64_t)length) {
+        delta_free(dlt);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Send the operations of the delta. An insert is sent as its length followed by the data, and a copy is sent as its
+ * negated length followed by its offset in the base. A length of 0 marks the end.
+ */
+static int _send_delta(socket_t *socket, const char *text, const data_delta *dlt) {
+    for (size_t i = 0; i < dlt->count; i++) {
+        const delta_op *op = &(dlt->ops[i]);
+        if (op->copy) {
+            if (send_size(socket, -(int64_t)op->len) != EXIT_SUCCESS ||
+                send_size(socket, (int64_t)op->offset) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        } else if (_send_data(socket, (int64_t)op->len, text + op->offset) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    return send_size(socket, 0);
+}
+
+int get_text_delta_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    uint64_t base_hash;
+    if (_read_known_hash(socket, &base_hash) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    int64_t length;
+    char *buf = _get_text_lf(&length);
+    if (!buf) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    const uint64_t hash = hash64(buf, (size_t)length, 0);
+    text_history_add(buf, (uint32_t)length, hash);
+    int modified;
+    if (_send_hash_status(socket, base_hash, hash, &modified) != EXIT_SUCCESS) {
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    if (!modified) {
+        free(buf);
+        return EXIT_SUCCESS;
+    }
+    data_delta dlt;
+    const int kind = _text_delta(base_hash, buf, length, &dlt) == EXIT_SUCCESS ? TEXT_DELTA : TEXT_FULL;
+#ifdef DEBUG_MODE
+    printf("Len = %" PRIi64 ", delta = %d\n", length, kind);
+#endif
+    int status;
+    if (send_size(socket, length) != EXIT_SUCCESS || send_size(socket, kind) != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    } else if (kind == TEXT_DELTA) {
+        status = _send_delta(socket, buf, &dlt);
+    } else {
+        status = write_sock(socket, buf, (uint64_t)length);
+    }
+    if (kind == TEXT_DELTA) delta_free(&dlt);
+    free(buf);
+    return status;
+}
+
+/*
+ * Start prefetching the files of the stream that are already found after the next one. The caller should add the
+ * file FILE_PREFETCH_AHEAD places ahead each time it takes a file.
+ * returns the prefetch, or NULL on failure.
+ */
+static file_prefetch *_start_stream_prefetch(file_stream *stream) {
+    file_prefetch *prefetch = file_prefetch_start();
+    if (!prefetch) return NULL;
+    for (unsigned i = 0; i + 1 < FILE_PREFETCH_AHEAD; i++) file_prefetch_add(prefetch, file_stream_peek(stream, i));
+    return prefetch;
+}
+
+int get_files_streamed_v4(socket_t *socket) {
+    size_t path_len = 0;
+    file_stream *stream = file_stream_start(1, &path_len);
+    char *file_path = stream ? file_stream_next(stream) : NULL;
+    if (!file_path) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (stream) file_stream_stop(stream);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
+        free(file_path);
+        file_stream_stop(stream);
+        return EXIT_FAILURE;
+    }
+    // files are sent while the enumeration is still finding the next ones, and the next files are read ahead
+    file_prefetch *prefetch = _start_stream_prefetch(stream);
+    int status = EXIT_SUCCESS;
+    while (file_path) {
+#ifdef DEBUG_MODE
+        printf("file name = %s\n", file_path);
+#endif
+        file_prefetch_add(prefetch, file_stream_peek(stream, FILE_PREFETCH_AHEAD - 1));
+        status = _transfer_single_file(3, socket, file_path, path_len, SEND_RAW);
+        free(file_path);
+        if (status != EXIT_SUCCESS) break;
+        file_path = file_stream_next(stream);
+    }
+    if (prefetch) file_prefetch_stop(prefetch);
+    file_stream_stop(stream);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+    // a file name of length 0 marks the end of the list
+    return send_size(socket, 0);
+}
+
+/*
+ * An entry of the manifest sent before the files
+ */
+typedef struct _manifest_entry {
+    char *path;
+    int64_t size;   // -1 for a directory
+    uint64_t hash;  // XXH64 hash of the contents, if the manifest has hashes
+} manifest_entry;
+
+static void _free_manifest(manifest_entry *entries, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++) free(entries[i].path);
+    free(entries);
+}
+
+/*
+ * Read the manifest of cnt entries, where the size of each entry is followed by the hash of its contents if with_hash is
+ * set. Checks the size of each file, and the total size against the free disk space.
+ * returns the entries on success, or NULL on failure.
+ */
+static manifest_entry *_read_manifest(socket_t *socket, const char *dirname, size_t cnt, int with_hash) {
+    manifest_entry *entries = NULL;
+    size_t capacity = 0;
+    int64_t total_size = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        // the count from the client is not trusted for the allocation
+        if (i == capacity) {
+            const size_t new_cap = capacity ? capacity * 2 : 64;
+            manifest_entry *new_entries = realloc(entries, new_cap * sizeof(manifest_entry));
+            if (!new_entries) {
+                _free_manifest(entries, i);
+                return NULL;
+            }
+            entries = new_entries;
+            capacity = new_cap;
+        }
+        char *path = _read_file_path(socket, dirname);
+        if (!path) {
+            _free_manifest(entries, i);
+            return NULL;
+        }
+        int64_t size;
+        int64_t hash = 0;
+        if (read_size(socket, &size) != EXIT_SUCCESS || size < -1 || size > configuration.max_file_size ||
+            (size > 0 && size > INT64_MAX - total_size) || (with_hash && read_size(socket, &hash) != EXIT_SUCCESS)) {
+            free(path);
+            _free_manifest(entries, i);
+            return NULL;
+        }
+        entries[i].path = path;
+        entries[i].size = size;
+        entries[i].hash = (uint64_t)hash;
+        if (size > 0) total_size += size;
+    }
+    const int64_t free_space = get_free_space();
+    if (free_space >= 0 && total_size > free_space) {
+#ifdef DEBUG_MODE
+        printf("Not enough space. required = %" PRId64 ", available = %" PRId64 "\n", total_size, free_space);
+#endif
+        _free_manifest(entries, cnt);
+        return NULL;
+    }
+    return entries;
+}
+
+/*
+ * Create the directory or the empty file of the manifest entry, reserving the disk space for the file.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _create_manifest_file(const manifest_entry *entry) {
+    if (entry->size == -1) return mkdirs(entry->path);
+    if (_make_directories(entry->path) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (file_exists(entry->path)) return EXIT_FAILURE;
+    FILE *file = open_file(entry->path, "wb");
+    if (!file) {
+        error("Couldn't create some files");
+        return EXIT_FAILURE;
+    }
+    // failing to reserve the space does not prevent writing the file
+    (void)preallocate_file(file, entry->size);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Create the directories and the empty files of the manifest, reserving the disk space for each file.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _create_manifest_files(const manifest_entry *entries, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++) {
+        if (_create_manifest_file(&(entries[i])) != EXIT_SUCCESS) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Remove the files of the manifest from the entry at index start onwards, which would otherwise keep their reserved
+ * space.
+ */
+static void _remove_manifest_files(const manifest_entry *entries, size_t start, size_t cnt) {
+    for (size_t i = start; i < cnt; i++) {
+        if (entries[i].size >= 0) remove_file(entries[i].path);
+    }
+}
+
+int send_files_manifest_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t cnt_l;
+    if (read_size(socket, &cnt_l) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (cnt_l <= 0 || cnt_l >= 0xFFFFFFFFLL) return EXIT_FAILURE;
+    const size_t cnt = (size_t)cnt_l;
+    char dirname[RECEIVE_DIR_NAME_LEN];
+    if (_make_receive_dir(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    manifest_entry *entries = _read_manifest(socket, dirname, cnt, 0);
+    if (!entries) {
+        remove_directory(dirname);
+        return EXIT_FAILURE;
+    }
+    if (_create_manifest_files(entries, cnt) != EXIT_SUCCESS) {
+        _remove_manifest_files(entries, 0, cnt);
+        _free_manifest(entries, cnt);
+        return EXIT_FAILURE;
+    }
+    // the client sends the contents of the files only after the manifest is accepted
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
+        _remove_manifest_files(entries, 0, cnt);
+        _free_manifest(entries, cnt);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+        const manifest_entry *entry = &(entries[i]);
+        if (entry->size <= 0) continue;
+        // opened without truncating, to keep the reserved space
+        FILE *file = open_file(entry->path, "r+b");
+        if (!file || _receive_file_data(socket, file, entry->size) != EXIT_SUCCESS) {
+            if (file) fclose(file);
+            _remove_manifest_files(entries, i, cnt);
+            _free_manifest(entries, cnt);
+            return EXIT_FAILURE;
+        }
+        fclose(file);
+    }
+    _free_manifest(entries, cnt);
+    close_socket_no_wait(socket);
+
+    return _move_received_files(dirname);
+}
+
+/*
+ * A batch frame of files being packed. The table has the name length, name, and size of each file, as in the manifest
+ * of send_files_manifest_v4, and the contents of the regular files follow the table.
+ */
+typedef struct _pack_frame {
+    struct mem_file table;
+    struct mem_file contents;
+    uint32_t cnt;
+} pack_frame;
+
+/*
+ * Reserve space for len more bytes in the buffer.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _mem_reserve(struct mem_file *buf, size_t len) {
+    if (buf->size + len <= buf->capacity) return EXIT_SUCCESS;
+    size_t new_cap = buf->capacity ? buf->capacity : 4096;
+    while (new_cap < buf->size + len) new_cap *= 2;
+    char *new_buf = realloc(buf->buffer, new_cap);
+    if (!new_buf) return EXIT_FAILURE;
+    buf->buffer = new_buf;
+    buf->capacity = new_cap;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Append a numeric value to the buffer, encoded as in send_size.
+ */
+static int _mem_append_size(struct mem_file *buf, int64_t size) {
+    if (_mem_reserve(buf, 8) != EXIT_SUCCESS) return EXIT_FAILURE;
+    for (int i = 7; i >= 0; i--) {
+        buf->buffer[buf->size + (size_t)i] = (char)(size & 0xff);
+        size >>= 8;
+    }
+    buf->size += 8;
+    return EXIT_SUCCESS;
+}
+
+static int _pack_add_entry(pack_frame *frame, const char *name, size_t name_len, int64_t size) {
+    if (_mem_append_size(&(frame->table), (int64_t)name_len) != EXIT_SUCCESS ||
+        _mem_reserve(&(frame->table), name_len) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    memcpy(frame->table.buffer + frame->table.size, name, name_len);
+    frame->table.size += name_len;
+    if (_mem_append_size(&(frame->table), size) != EXIT_SUCCESS) return EXIT_FAILURE;
+    frame->cnt++;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Send the number of files, the table length, and the table of the frame, and clear the table.
+ */
+static int _send_pack_header(socket_t *socket, pack_frame *frame) {
+    if (send_size(socket, (int64_t)frame->cnt) != EXIT_SUCCESS ||
+        _send_data(socket, (int64_t)frame->table.size, frame->table.buffer) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    frame->cnt = 0;
+    frame->table.size = 0;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Send the frame with the contents of its files, if it has any files, and clear it.
+ */
+static int _send_pack_frame(socket_t *socket, pack_frame *frame) {
+    if (frame->cnt == 0) return EXIT_SUCCESS;
+    if (_send_pack_header(socket, frame) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (frame->contents.size > 0 &&
+        write_sock(socket, frame->contents.buffer, frame->contents.size) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    frame->contents.size = 0;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Add the file to the frame, reading all of it at once. Sends the frame when it is full. A large file is sent in a
+ * frame of its own, while reading it in parts.
+ */
+static int _pack_file(socket_t *socket, pack_frame *frame, const char *file_path, size_t path_len) {
+    size_t name_len;
+    char *name = _get_send_name(3, file_path, path_len, &name_len);
+    if (!name) return EXIT_FAILURE;
+    if (name[name_len - 1] == '/') {
+        const int status = _pack_add_entry(frame, name, name_len - 1, -1);
+        free(name);
+        return status;
+    }
+    FILE *fp = open_file(file_path, "rb");
+    if (!fp) {
+        error("Couldn't open some files");
+        free(name);
+        return EXIT_FAILURE;
+    }
+    const int64_t file_size = get_file_size(fp);
+    if (file_size < 0 || file_size > configuration.max_file_size) {
+        fclose(fp);
+        free(name);
+        return EXIT_FAILURE;
+    }
+    int status;
+    if (file_size > PACK_SMALL_FILE_SIZE) {
+        status = _send_pack_frame(socket, frame);
+        if (status == EXIT_SUCCESS) status = _pack_add_entry(frame, name, name_len, file_size);
+        if (status == EXIT_SUCCESS) status = _send_pack_header(socket, frame);
+        if (status == EXIT_SUCCESS) status = _send_file_data(socket, fp, file_size, NULL);
+    } else {
+        const size_t size = (size_t)file_size;
+        status = _mem_reserve(&(frame->contents), size);
+        if (status == EXIT_SUCCESS && fread(frame->contents.buffer + frame->contents.size, 1, size, fp) < size) {
+            status = EXIT_FAILURE;
+        }
+        if (status == EXIT_SUCCESS) status = _pack_add_entry(frame, name, name_len, file_size);
+        if (status == EXIT_SUCCESS) frame->contents.size += size;
+    }
+    fclose(fp);
+    free(name);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (frame->cnt >= PACK_MAX_FRAME_FILES || frame->contents.size >= PACK_FRAME_SIZE) {
+        return _send_pack_frame(socket, frame);
+    }
+    return EXIT_SUCCESS;
+}
+
+int get_files_packed_v4(socket_t *socket) {
+    size_t path_len = 0;
+    file_stream *stream = file_stream_start(1, &path_len);
+    char *file_path = stream ? file_stream_next(stream) : NULL;
+    if (!file_path) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (stream) file_stream_stop(stream);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
+        free(file_path);
+        file_stream_stop(stream);
+        return EXIT_FAILURE;
+    }
+    pack_frame frame = {.table = {.buffer = NULL, .capacity = 0, .size = 0},
+                        .contents = {.buffer = NULL, .capacity = 0, .size = 0},
+                        .cnt = 0};
+    file_prefetch *prefetch = _start_stream_prefetch(stream);
+    int status = EXIT_SUCCESS;
+    while (file_path) {
+        file_prefetch_add(prefetch, file_stream_peek(stream, FILE_PREFETCH_AHEAD - 1));
+        status = _pack_file(socket, &frame, file_path, path_len);
+        free(file_path);
+        if (status != EXIT_SUCCESS) break;
+        file_path = file_stream_next(stream);
+    }
+    if (prefetch) file_prefetch_stop(prefetch);
+    file_stream_stop(stream);
+    if (status == EXIT_SUCCESS) status = _send_pack_frame(socket, &frame);
+    if (frame.table.buffer) free(frame.table.buffer);
+    if (frame.contents.buffer) free(frame.contents.buffer);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+    // a frame of 0 files marks the end of the files
+    return send_size(socket, 0);
+}
+
+static inline int64_t _parse_size(const char *buf) {
+    uint64_t size = 0;
+    for (unsigned i = 0; i < 8; i++) {
+        size = (size << 8) | (unsigned char)buf[i];
+    }
+    return (int64_t)size;
+}
+
+/*
+ * Parse the table of a received frame of cnt files.
+ * returns the entries on success, or NULL if the table is not valid.
+ */
+static manifest_entry *_parse_pack_table(char *table, size_t table_len, const char *dirname, size_t cnt) {
+    manifest_entry *entries = malloc(cnt * sizeof(manifest_entry));
+    if (!entries) return NULL;
+    size_t pos = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        if (table_len - pos < 8) {
+            _free_manifest(entries, i);
+            return NULL;
+        }
+        const int64_t name_size = _parse_size(table + pos);
+        pos += 8;
+        if (name_size <= 0 || name_size > MAX_FILE_NAME_LENGTH || table_len - pos < (size_t)name_size + 8) {
+            _free_manifest(entries, i);
+            return NULL;
+        }
+        const size_t name_length = (size_t)name_size;
+        char file_name[name_length + 1];
+        memcpy(file_name, table + pos, name_length);
+        file_name[name_length] = 0;
+        pos += name_length;
+        const int64_t size = _parse_size(table + pos);
+        pos += 8;
+        char *path = _file_path_from_name(file_name, name_length, dirname);
+        if (!path || size < -1 || size > configuration.max_file_size) {
+            if (path) free(path);
+            _free_manifest(entries, i);
+            return NULL;
+        }
+        entries[i].path = path;
+        entries[i].size = size;
+    }
+    if (pos != table_len) {
+        _free_manifest(entries, cnt);
+        return NULL;
+    }
+    return entries;
+}
+
+/*
+ * Make the parent directories of the path, unless they are the same as those of the previous file, given by
+ * *made_dir_p. Files in a frame are mostly in the same directories as the ones before them.
+ */
+static int _make_parent_dirs_cached(char *path, char **made_dir_p) {
+    const char *sep = strrchr(path, PATH_SEP);
+    if (!sep) return EXIT_FAILURE;
+    const size_t dir_len = (size_t)(sep - path);
+    if (*made_dir_p && strlen(*made_dir_p) == dir_len && !strncmp(*made_dir_p, path, dir_len)) return EXIT_SUCCESS;
+    if (_make_directories(path) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (*made_dir_p) free(*made_dir_p);
+    *made_dir_p = malloc(dir_len + 1);
+    if (*made_dir_p) {
+        memcpy(*made_dir_p, path, dir_len);
+        (*made_dir_p)[dir_len] = 0;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Save the file of a received frame. The contents are taken from data if it is not NULL, or read from the socket
+ * otherwise.
+ */
+static int _save_pack_file(socket_t *socket, manifest_entry *entry, const char *data, char **made_dir_p) {
+    if (entry->size == -1) return mkdirs(entry->path);
+    if (_make_parent_dirs_cached(entry->path, made_dir_p) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (file_exists(entry->path)) return EXIT_FAILURE;
+    FILE *file = open_file(entry->path, "wb");
+    if (!file) {
+        error("Couldn't create some files");
+        return EXIT_FAILURE;
+    }
+    int status;
+    if (data) {
+        status = fwrite(data, 1, (size_t)entry->size, file) < (size_t)entry->size ? EXIT_FAILURE : EXIT_SUCCESS;
+    } else {
+        status = _receive_file_data(socket, file, entry->size);
+    }
+    fclose(file);
+    if (status != EXIT_SUCCESS) remove_file(entry->path);
+    return status;
+}
+
+/*
+ * Receive a frame of cnt files and save the files in the directory dirname.
+ */
+static int _receive_pack_frame(socket_t *socket, const char *dirname, size_t cnt, char **made_dir_p) {
+    int64_t table_len;
+    if (read_size(socket, &table_len) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (table_len <= 0 || (uint64_t)table_len > cnt * (MAX_FILE_NAME_LENGTH + 16)) return EXIT_FAILURE;
+    char *table = malloc((size_t)table_len);
+    if (!table) return EXIT_FAILURE;
+    if (read_sock(socket, table, (uint64_t)table_len) != EXIT_SUCCESS) {
+        free(table);
+        return EXIT_FAILURE;
+    }
+    manifest_entry *entries = _parse_pack_table(table, (size_t)table_len, dirname, cnt);
+    free(table);
+    if (!entries) return EXIT_FAILURE;
+
+    int64_t total_size = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        if (entries[i].size > 0) total_size += entries[i].size;
+        if (total_size > PACK_MAX_FRAME_READ) break;
+    }
+    // contents of the small files are read at once, and large files are read in parts while writing them
+    char *data = NULL;
+    if (total_size > 0 && total_size <= PACK_MAX_FRAME_READ) {
+        data = malloc((size_t)total_size);
+        if (!data || read_sock(socket, data, (uint64_t)total_size) != EXIT_SUCCESS) {
+            if (data) free(data);
+            _free_manifest(entries, cnt);
+            return EXIT_FAILURE;
+        }
+    }
+    int status = EXIT_SUCCESS;
+    size_t offset = 0;
+    for (size_t i = 0; i < cnt && status == EXIT_SUCCESS; i++) {
+        status = _save_pack_file(socket, &(entries[i]), data ? data + offset : NULL, made_dir_p);
+        if (entries[i].size > 0) offset += (size_t)entries[i].size;
+    }
+    if (data) free(data);
+    _free_manifest(entries, cnt);
+    return status;
+}
+
+int send_files_packed_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    char dirname[RECEIVE_DIR_NAME_LEN];
+    if (_make_receive_dir(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
+    char *made_dir = NULL;
+    int status = EXIT_SUCCESS;
+    while (status == EXIT_SUCCESS) {
+        int64_t cnt;
+        if (read_size(socket, &cnt) != EXIT_SUCCESS || cnt < 0 || cnt > PACK_MAX_FRAME_FILES) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        // a frame of 0 files marks the end of the files
+        if (cnt == 0) break;
+        status = _receive_pack_frame(socket, dirname, (size_t)cnt, &made_dir);
+    }
+    if (made_dir) free(made_dir);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+    close_socket_no_wait(socket);
+
+    return _move_received_files(dirname);
+}
+
+/*
+ * A copied file looked up by the name it is sent to the client with
+ */
+typedef struct _resume_lookup {
+    const char *name;
+    size_t name_len;
+    size_t path_len;
+    char *path;  // the path of the file if found, or NULL
+} resume_lookup;
+
+static int _match_send_name(void *arg, char *path) {
+    resume_lookup *lookup = (resume_lookup *)arg;
+    size_t name_len;
+    char *name = _get_send_name(3, path, lookup->path_len, &name_len);
+    const int found = name && name_len == lookup->name_len && !memcmp(name, lookup->name, name_len);
+    if (name) free(name);
+    if (!found) {
+        free(path);
+        return EXIT_SUCCESS;
+    }
+    lookup->path = path;
+    return EXIT_FAILURE;  // stops the walk
+}
+
+/*
+ * Check that the bytes of the file before the offset have the hash check_hash, which leaves the file at the offset.
+ * returns EXIT_SUCCESS if the hash matches and EXIT_FAILURE otherwise.
+ */
+static int _check_resume_point(FILE *fp, int64_t offset, uint64_t check_hash) {
+    const int64_t check_len = MIN(offset, RESUME_CHECK_SIZE);
+    if (seek_file(fp, offset - check_len) != EXIT_SUCCESS) return EXIT_FAILURE;
+    char data[RESUME_CHECK_SIZE];
+    if (check_len > 0 && fread(data, 1, (size_t)check_len, fp) != (size_t)check_len) return EXIT_FAILURE;
+    return hash64(data, (size_t)check_len, 0) == check_hash ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int get_file_resume_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t name_len;
+    if (read_size(socket, &name_len) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (name_len <= 0 || name_len > MAX_FILE_NAME_LENGTH) return EXIT_FAILURE;
+    char name[name_len];
+    int64_t known_size;
+    int64_t offset;
+    uint64_t check_hash;
+    if (read_sock(socket, name, (size_t)name_len) != EXIT_SUCCESS || read_size(socket, &known_size) != EXIT_SUCCESS ||
+        read_size(socket, &offset) != EXIT_SUCCESS || _read_known_hash(socket, &check_hash) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (offset < 0 || offset > known_size) return EXIT_FAILURE;
+
+    // only the copied files can be resumed
+    resume_lookup lookup = {.name = name, .name_len = (size_t)name_len, .path_len = 0, .path = NULL};
+    (void)walk_copied_dirs_files(0, &(lookup.path_len), &_match_send_name, &lookup);
+    FILE *fp = lookup.path ? open_file(lookup.path, "rb") : NULL;
+    if (lookup.path) free(lookup.path);
+    const int64_t file_size = fp ? get_file_size(fp) : -1;
+    if (file_size < 0 || file_size > configuration.max_file_size) {
+        if (fp) fclose(fp);
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    if (file_size != known_size || _check_resume_point(fp, offset, check_hash) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        puts("File changed");
+#endif
+        fclose(fp);
+        write_sock(socket, &(char){STATUS_CHANGED}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    int status = write_sock(socket, &(char){STATUS_OK}, 1);
+    if (status == EXIT_SUCCESS) status = _send_file_data(socket, fp, file_size - offset, NULL);
+    fclose(fp);
+    return status;
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+#define MTIME_PER_SEC 1000000000LL  // get_file_stat gives the modification time in nanoseconds
+#else
+#define MTIME_PER_SEC 1LL
+#endif
+
+static char *_child_path(const char *dir, const char *name) {
+    const size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = malloc(len);
+    if (!path) return NULL;
+    if (snprintf_check(path, len, "%s%c%s", dir, PATH_SEP, name)) {
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+/*
+ * Get the latest modification time of the directory at path and everything in it, as given by get_file_stat. Symbolic
+ * links are not followed.
+ */
+static int64_t _last_modified(const char *path) {
+    int64_t size;
+    int64_t mtime;
+    if (get_file_stat(path, &size, &mtime) != EXIT_SUCCESS) return 0;
+    if (!is_directory(path, 0)) return mtime;
+    list2 *files = list_dir(path);
+    if (!files) return mtime;
+    for (uint32_t i = 0; i < files->len; i++) {
+        char *child = _child_path(path, files->array[i]);
+        if (!child) continue;
+        const int64_t child_mtime = _last_modified(child);
+        if (child_mtime > mtime) mtime = child_mtime;
+        free(child);
+    }
+    free_list(files);
+    return mtime;
+}
+
+/*
+ * Remove the file or the directory at path with everything in it. Symbolic links are not followed.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _remove_tree(const char *path) {
+    if (!is_directory(path, 0)) return remove_file(path) ? EXIT_FAILURE : EXIT_SUCCESS;
+    list2 *files = list_dir(path);
+    if (!files) return EXIT_FAILURE;
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < files->len; i++) {
+        char *child = _child_path(path, files->array[i]);
+        if (!child || _remove_tree(child) != EXIT_SUCCESS) status = EXIT_FAILURE;
+        if (child) free(child);
+    }
+    free_list(files);
+    if (status == EXIT_SUCCESS && remove_directory(path)) status = EXIT_FAILURE;
+    return status;
+}
+
+/*
+ * Remove the directories of the resumable uploads in the working directory, in which nothing has changed for the
+ * grace period.
+ */
+static void _remove_expired_uploads(void) {
+    const int64_t now = (int64_t)time(NULL);
+    // uploads are not kept with a grace period of 0, and nothing expires with a grace period longer than the time
+    if (configuration.resume_grace_period <= 0 || configuration.resume_grace_period > now) return;
+    const int64_t expiry = (now - configuration.resume_grace_period) * MTIME_PER_SEC;
+    list2 *files = list_dir(".");
+    if (!files) return;
+    for (uint32_t i = 0; i < files->len; i++) {
+        const char *filename = files->array[i];
+        if (strncmp(filename, RESUME_DIR_PREFIX, sizeof(RESUME_DIR_PREFIX) - 1)) continue;
+        char *path = _child_path(".", filename);
+        if (!path) continue;
+        if (is_directory(path, 0) && _last_modified(path) < expiry) (void)_remove_tree(path);
+        free(path);
+    }
+    free_list(files);
+}
+
+/*
+ * Name the directory of the upload after the hash of the upload id and the manifest, so that an upload is resumed only
+ * with the same files. The paths of the entries start with dirname, in which the hash is written.
+ */
+static void _name_upload_dir(char *dirname, const manifest_entry *entries, size_t cnt, uint64_t upload_id) {
+    const size_t hash_pos = RESUME_DIR_NAME_LEN - 17;
+    hash64_state state;
+    hash64_init(&state, upload_id);
+    for (size_t i = 0; i < cnt; i++) {
+        const char *rel_path = entries[i].path + hash_pos + 16;
+        // the terminating '\0' separates the path from the size
+        hash64_update(&state, rel_path, strlen(rel_path) + 1);
+        hash64_update(&state, &(entries[i].size), sizeof(int64_t));
+    }
+    uint64_t hash = hash64_digest(&state);
+    for (size_t d = 16; d > 0; d--) {
+        dirname[hash_pos + d - 1] = "0123456789abcdef"[hash & 0xf];
+        hash >>= 4;
+    }
+    for (size_t i = 0; i < cnt; i++) memcpy(entries[i].path + hash_pos, dirname + hash_pos, 16);
+}
+
+/*
+ * Create the directories and the files of the manifest that are not in the directory of the upload yet, and set the
+ * number of bytes of each file already received in offsets. A file larger than in the manifest is received again.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _prepare_resumed_files(const manifest_entry *entries, int64_t *offsets, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++) {
+        const manifest_entry *entry = &(entries[i]);
+        offsets[i] = -1;
+        if (entry->size == -1) {
+            if (mkdirs(entry->path) != EXIT_SUCCESS) return EXIT_FAILURE;
+            continue;
+        }
+        if (_make_directories(entry->path) != EXIT_SUCCESS) return EXIT_FAILURE;
+        FILE *file = open_file(entry->path, "r+b");
+        int64_t received = file ? get_file_size(file) : -1;
+        if (received < 0 || received > entry->size) {
+            if (file) fclose(file);
+            file = open_file(entry->path, "wb");
+            if (!file) {
+                error("Couldn't create some files");
+                return EXIT_FAILURE;
+            }
+            // failing to reserve the space does not prevent writing the file
+            (void)preallocate_file(file, entry->size);
+            received = 0;
+        }
+        fclose(file);
+        offsets[i] = received;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Keep the files of an interrupted upload to resume it later, unless uploads are not kept, and free the manifest.
+ * returns EXIT_FAILURE
+ */
+static int _interrupt_upload(const char *dirname, manifest_entry *entries, size_t cnt, int64_t *offsets) {
+    if (configuration.resume_grace_period <= 0) (void)_remove_tree(dirname);
+    _free_manifest(entries, cnt);
+    if (offsets) free(offsets);
+    return EXIT_FAILURE;
+}
+
+/*
+ * Send the status OK followed by the offsets, encoded as numeric values.
+ */
+static int _send_resume_offsets(socket_t *socket, const int64_t *offsets, size_t cnt) {
+    struct mem_file reply = {.buffer = NULL, .capacity = 0, .size = 0};
+    int status = _mem_reserve(&reply, 1);
+    if (status == EXIT_SUCCESS) reply.buffer[reply.size++] = STATUS_OK;
+    for (size_t i = 0; status == EXIT_SUCCESS && i < cnt; i++) status = _mem_append_size(&reply, offsets[i]);
+    if (status == EXIT_SUCCESS) status = write_sock(socket, reply.buffer, reply.size);
+    if (reply.buffer) free(reply.buffer);
+    return status;
+}
+
+int send_files_resumable_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t upload_id;
+    int64_t cnt_l;
+    if (read_size(socket, &upload_id) != EXIT_SUCCESS || read_size(socket, &cnt_l) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (cnt_l <= 0 || cnt_l >= 0xFFFFFFFFLL) return EXIT_FAILURE;
+    const size_t cnt = (size_t)cnt_l;
+    // the paths are read with a placeholder for the hash in the name of the directory
+    char dirname[RESUME_DIR_NAME_LEN];
+    if (snprintf_check(dirname, RESUME_DIR_NAME_LEN, ".%c%s%016x", PATH_SEP, RESUME_DIR_PREFIX, 0U)) {
+        return EXIT_FAILURE;
+    }
+    manifest_entry *entries = _read_manifest(socket, dirname, cnt, 0);
+    if (!entries) return EXIT_FAILURE;
+    _name_upload_dir(dirname, entries, cnt, (uint64_t)upload_id);
+
+    _remove_expired_uploads();
+    int64_t *offsets = malloc(cnt * sizeof(int64_t));
+    if (!offsets || mkdirs(dirname) != EXIT_SUCCESS || _prepare_resumed_files(entries, offsets, cnt) != EXIT_SUCCESS ||
+        _send_resume_offsets(socket, offsets, cnt) != EXIT_SUCCESS) {
+        return _interrupt_upload(dirname, entries, cnt, offsets);
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+        const manifest_entry *entry = &(entries[i]);
+        if (entry->size <= 0 || offsets[i] == entry->size) continue;
+        FILE *file = open_file(entry->path, "r+b");
+        // written in order, so that the received part of the file can be resumed from if this is interrupted
+        if (!file || seek_file(file, offsets[i]) != EXIT_SUCCESS ||
+            _receive_file_data_in_order(socket, file, entry->size - offsets[i], NULL) != EXIT_SUCCESS) {
+            if (file) fclose(file);
+            return _interrupt_upload(dirname, entries, cnt, offsets);
+        }
+        fclose(file);
+    }
+    _free_manifest(entries, cnt);
+    free(offsets);
+    close_socket_no_wait(socket);
+
+    return _move_received_files(dirname);
+}
+
+/*
+ * The checksums of the blocks of a file that the client has, with the name the file is sent with
+ */
+typedef struct _file_signature {
+    char *name;
+    size_t name_len;
+    block_sig *sigs;
+    block_index index;
+} file_signature;
+
+static void _free_signatures(file_signature *sigs, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++) {
+        free(sigs[i].name);
+        free(sigs[i].sigs);
+        block_index_free(&(sigs[i].index));
+    }
+    free(sigs);
+}
+
+static int _compare_signatures(const void *a, const void *b) {
+    const file_signature *sig_a = (const file_signature *)a;
+    const file_signature *sig_b = (const file_signature *)b;
+    const size_t len = MIN(sig_a->name_len, sig_b->name_len);
+    const int cmp = memcmp(sig_a->name, sig_b->name, len);
+    if (cmp) return cmp;
+    return (sig_a->name_len > sig_b->name_len) - (sig_a->name_len < sig_b->name_len);
+}
+
+/*
+ * Read the name, the block size, the number of blocks, and the checksums of the blocks of a file that the client has,
+ * and index the blocks. *blocks_p has the number of blocks that may still be read, and is reduced by the blocks read.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _read_signature(socket_t *socket, file_signature *sig, int64_t *blocks_p) {
+    int64_t name_len;
+    if (read_size(socket, &name_len) != EXIT_SUCCESS || name_len <= 0 || name_len > MAX_FILE_NAME_LENGTH) {
+        return EXIT_FAILURE;
+    }
+    int64_t block_size;
+    int64_t block_cnt;
+    sig->name = malloc((size_t)name_len);
+    if (!sig->name || read_sock(socket, sig->name, (size_t)name_len) != EXIT_SUCCESS ||
+        read_size(socket, &block_size) != EXIT_SUCCESS || read_size(socket, &block_cnt) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    sig->name_len = (size_t)name_len;
+    if (block_size < DELTA_FILE_MIN_BLOCK || block_size > DELTA_FILE_MAX_BLOCK || block_cnt < 0 ||
+        block_cnt > *blocks_p) {
+        return EXIT_FAILURE;
+    }
+    *blocks_p -= block_cnt;
+    const size_t cnt = (size_t)block_cnt;
+    // each block has its weak checksum and its strong hash, encoded as numeric values
+    char *data = malloc(cnt * 16 + 1);
+    sig->sigs = malloc(cnt * sizeof(block_sig) + 1);
+    if (!data || !sig->sigs || read_sock(socket, data, cnt * 16) != EXIT_SUCCESS) {
+        if (data) free(data);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < cnt; i++) {
+        sig->sigs[i].weak = (uint32_t)_parse_size(data + i * 16);
+        sig->sigs[i].strong = (uint64_t)_parse_size(data + i * 16 + 8);
+    }
+    free(data);
+    return block_index_init(&(sig->index), sig->sigs, cnt, (size_t)block_size);
+}
+
+/*
+ * Read the cnt signatures of the files the client has, sorted by their names.
+ * returns the signatures on success, or NULL on failure.
+ */
+static file_signature *_read_signatures(socket_t *socket, size_t cnt) {
+    file_signature *sigs = NULL;
+    size_t capacity = 0;
+    int64_t blocks = DELTA_MAX_BLOCKS;
+    for (size_t i = 0; i < cnt; i++) {
+        // the count from the client is not trusted for the allocation
+        if (i == capacity) {
+            const size_t new_cap = capacity ? capacity * 2 : 16;
+            file_signature *new_sigs = realloc(sigs, new_cap * sizeof(file_signature));
+            if (!new_sigs) {
+                if (sigs) _free_signatures(sigs, i);
+                return NULL;
+            }
+            sigs = new_sigs;
+            capacity = new_cap;
+        }
+        sigs[i] = (file_signature){.name = NULL, .name_len = 0, .sigs = NULL, .index = {.table = NULL}};
+        if (_read_signature(socket, &(sigs[i]), &blocks) != EXIT_SUCCESS) {
+            _free_signatures(sigs, i + 1);
+            return NULL;
+        }
+    }
+    // an empty list is not NULL
+    if (!sigs) return calloc(1, sizeof(file_signature));
+    qsort(sigs, cnt, sizeof(file_signature), &_compare_signatures);
+    return sigs;
+}
+
+static int _send_delta_op(void *arg, const delta_op *op, const char *data) {
+    socket_t *socket = (socket_t *)arg;
+    if (!op->copy) return _send_data(socket, (int64_t)op->len, data);
+    if (send_size(socket, -(int64_t)op->len) != EXIT_SUCCESS) return EXIT_FAILURE;
+    return send_size(socket, (int64_t)op->offset);
+}
+
+/*
+ * Send the name and the size of the file, followed by the operations that produce the file from the blocks of the file
+ * the client has, as in _send_delta.
+ */
+static int _transfer_file_delta(socket_t *socket, const char *file_path, const char *filename, size_t fname_len,
+                                const file_signature *sig) {
+    FILE *fp = open_file(file_path, "rb");
+    if (!fp) {
+        error("Couldn't open some files");
+        return EXIT_FAILURE;
+    }
+    const int64_t file_size = get_file_size(fp);
+    if (file_size < 0 || file_size > configuration.max_file_size) {
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    if (_send_data(socket, (int64_t)fname_len, filename) != EXIT_SUCCESS ||
+        send_size(socket, file_size) != EXIT_SUCCESS ||
+        delta_stream_file(fp, file_size, &(sig->index), &_send_delta_op, socket) != EXIT_SUCCESS ||
+        send_size(socket, 0) != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    }
+    fclose(fp);
+    return status;
+}
+
+/*
+ * Send the file as a delta if the client has a file with the same name, or as it is otherwise.
+ */
+static int _transfer_file_or_delta(socket_t *socket, const char *file_path, size_t path_len,
+                                   const file_signature *sigs, size_t sig_cnt) {
+    size_t fname_len;
+    char *filename = _get_send_name(3, file_path, path_len, &fname_len);
+    if (!filename) return EXIT_FAILURE;
+    const file_signature key = {.name = filename, .name_len = fname_len};
+    const file_signature *sig = bsearch(&key, sigs, sig_cnt, sizeof(file_signature), &_compare_signatures);
+    int status;
+    if (sig && filename[fname_len - 1] != '/') {
+        status = _transfer_file_delta(socket, file_path, filename, fname_len, sig);
+    } else {
+        status = _transfer_single_file(3, socket, file_path, path_len, SEND_RAW);
+    }
+    free(filename);
+    return status;
+}
+
+int get_files_delta_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t sig_cnt;
+    if (read_size(socket, &sig_cnt) != EXIT_SUCCESS || sig_cnt < 0 || sig_cnt >= 0xFFFFFFFFLL) return EXIT_FAILURE;
+    file_signature *sigs = _read_signatures(socket, (size_t)sig_cnt);
+    if (!sigs) return EXIT_FAILURE;
+
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, 1);
+    list2 *file_list = copied_dir_files.lst;
+    if (!file_list || file_list->len == 0 || file_list->len >= 0xFFFFFFFFUL) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (file_list) free_list(file_list);
+        _free_signatures(sigs, (size_t)sig_cnt);
+        close_socket_no_wait(socket);
+        return EXIT_SUCCESS;
+    }
+    int status = write_sock(socket, &(char){STATUS_OK}, 1);
+    if (status == EXIT_SUCCESS) status = send_size(socket, (int64_t)file_list->len);
+    for (uint32_t i = 0; status == EXIT_SUCCESS && i < file_list->len; i++) {
+        status = _transfer_file_or_delta(socket, file_list->array[i], copied_dir_files.path_len, sigs,
+                                         (size_t)sig_cnt);
+    }
+    free_list(file_list);
+    _free_signatures(sigs, (size_t)sig_cnt);
+    return status;
+}
+
+/*
+ * Create the directories and the files of the manifest, taking the files that are in the file store from there, and
+ * set the number of bytes of each file the server already has in offsets, which is the whole file if it was taken.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _prepare_dedup_files(const manifest_entry *entries, int64_t *offsets, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++) {
+        const manifest_entry *entry = &(entries[i]);
+        offsets[i] = entry->size == -1 ? -1 : 0;
+        if (entry->size >= FILE_STORE_MIN_SIZE && _make_directories(entry->path) == EXIT_SUCCESS &&
+            !file_exists(entry->path) && file_store_take(entry->hash, entry->size, entry->path) == EXIT_SUCCESS) {
+            offsets[i] = entry->size;
+            continue;
+        }
+        if (_create_manifest_file(entry) != EXIT_SUCCESS) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int send_files_dedup_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t cnt_l;
+    if (read_size(socket, &cnt_l) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (cnt_l <= 0 || cnt_l >= 0xFFFFFFFFLL) return EXIT_FAILURE;
+    const size_t cnt = (size_t)cnt_l;
+    char dirname[RECEIVE_DIR_NAME_LEN];
+    if (_make_receive_dir(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    manifest_entry *entries = _read_manifest(socket, dirname, cnt, 1);
+    if (!entries) {
+        remove_directory(dirname);
+        return EXIT_FAILURE;
+    }
+    int64_t *offsets = malloc(cnt * sizeof(int64_t));
+    if (!offsets || _prepare_dedup_files(entries, offsets, cnt) != EXIT_SUCCESS ||
+        _send_resume_offsets(socket, offsets, cnt) != EXIT_SUCCESS) {
+        _remove_manifest_files(entries, 0, cnt);
+        _free_manifest(entries, cnt);
+        if (offsets) free(offsets);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+        const manifest_entry *entry = &(entries[i]);
+        if (entry->size <= 0 || offsets[i] == entry->size) continue;
+        // opened without truncating, to keep the reserved space
+        FILE *file = open_file(entry->path, "r+b");
+        if (!file || _receive_file_data(socket, file, entry->size) != EXIT_SUCCESS) {
+            if (file) fclose(file);
+            _remove_manifest_files(entries, i, cnt);
+            _free_manifest(entries, cnt);
+            free(offsets);
+            return EXIT_FAILURE;
+        }
+        fclose(file);
+    }
+    close_socket_no_wait(socket);
+
+    // the received files are checked against their hashes after the connection is closed, without keeping the client
+    for (size_t i = 0; i < cnt; i++) {
+        const manifest_entry *entry = &(entries[i]);
+        if (offsets[i] == 0) file_store_add(entry->path, entry->hash, entry->size);
+    }
+    _free_manifest(entries, cnt);
+    free(offsets);
+
+    return _move_received_files(dirname);
+}
+
+int get_files_verified_v4(socket_t *socket) {
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, 1);
+    return _get_files_common(3, socket, copied_dir_files.lst, copied_dir_files.path_len, SEND_HASHED);
+}
+
+int send_files_verified_v4(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int64_t cnt;
+    if (read_size(socket, &cnt) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (cnt <= 0 || cnt >= 0xFFFFFFFFLL) return EXIT_FAILURE;
+    char dirname[RECEIVE_DIR_NAME_LEN];
+    if (_make_receive_dir(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    // indices of the files that did not match their hashes, which are removed
+    struct mem_file corrupted = {.buffer = NULL, .capacity = 0, .size = 0};
+    int64_t corrupted_cnt = 0;
+    int status = EXIT_SUCCESS;
+    for (int64_t file_num = 0; status == EXIT_SUCCESS && file_num < cnt; file_num++) {
+        int file_corrupted = 0;
+        status = save_file(3, socket, dirname, SEND_HASHED, &file_corrupted);
+        if (status == EXIT_SUCCESS && file_corrupted) {
+            status = _mem_append_size(&corrupted, file_num);
+            corrupted_cnt++;
+        }
+    }
+    if (status == EXIT_SUCCESS && corrupted_cnt == 0) {
+        status = write_sock(socket, &(char){STATUS_OK}, 1);
+    } else if (status == EXIT_SUCCESS) {
+        status = write_sock(socket, &(char){STATUS_CORRUPTED}, 1);
+        if (status == EXIT_SUCCESS) status = send_size(socket, corrupted_cnt);
+        if (status == EXIT_SUCCESS) status = write_sock(socket, corrupted.buffer, corrupted.size);
+    }
+    if (corrupted.buffer) free(corrupted.buffer);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+    close_socket_no_wait(socket);
+
+    return _move_received_files(dirname);
+}
+
+static int _send_file_extents(socket_t *socket, FILE *fp, int64_t file_size) {
+    int64_t offset = 0;
+    while (offset < file_size) {
+        int64_t data_start;
+        int64_t data_end;
+        get_data_extent(fp, offset, file_size, &data_start, &data_end);
+        if (data_start > offset && send_size(socket, offset - data_start) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (data_end > data_start) {
+            if (send_size(socket, data_end - data_start) != EXIT_SUCCESS ||
+                seek_file(fp, data_start) != EXIT_SUCCESS ||
+                _send_file_data(socket, fp, data_end - data_start, NULL) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        }
+        offset = data_end;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int _receive_file_extents(socket_t *socket, FILE *file, int64_t file_size) {
+    // the holes would take disk space on Windows otherwise. The file is still correct if this fails
+    (void)set_sparse_file(file);
+    int64_t offset = 0;
+    while (offset < file_size) {
+        int64_t length;
+        if (read_size(socket, &length) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (length == 0 || length > file_size - offset || length < offset - file_size) {
+#ifdef DEBUG_MODE
+            printf("invalid extent length = %lli\n", (long long)length);
+#endif
+            return EXIT_FAILURE;
+        }
+        if (length > 0) {
+            if (seek_file(file, offset) != EXIT_SUCCESS || _receive_file_data(socket, file, length) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            offset += length;
+        } else {
+            // the new file is not written in holes, so they are not allocated
+            offset -= length;
+        }
+    }
+    // extends the file over a hole at its end
+    return set_file_size(file, file_size);
+}
+
+int get_files_sparse_v4(socket_t *socket) {
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, 1);
+    return _get_files_common(3, socket, copied_dir_files.lst, copied_dir_files.path_len, SEND_SPARSE);
 }
 
-int send_files_v3(socket_t *socket) { return _send_files_dirs(3, socket); }
+int send_files_sparse_v4(socket_t *socket) { return _send_files_dirs(3, socket, SEND_SPARSE); }
 #endif
@@ -38,11 +38,44 @@ extern int send_files_v2(socket_t *socket);
 #endif
 
 // Version 3 methods
-#if (PROTOCOL_MIN <= 3) && (3 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 4) && (3 <= PROTOCOL_MAX)
 extern int get_files_v3(socket_t *socket);
 extern int send_files_v3(socket_t *socket);
+#endif
+#if (PROTOCOL_MIN <= 3) && (3 <= PROTOCOL_MAX)
 extern int get_copied_image_v3(socket_t *socket);
 extern int get_screenshot_v3(socket_t *socket);
 #endif
 
+// Version 4 methods
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+extern int get_image_v4(socket_t *socket);
+extern int get_copied_image_v4(socket_t *socket);
+extern int get_screenshot_v4(socket_t *socket);
+extern int get_screenshot_delta_v4(socket_t *socket);
+extern int stream_screen_v4(socket_t *socket);
+extern int get_screenshot_region_v4(socket_t *socket);
+extern int list_displays_v4(socket_t *socket);
+extern int get_copied_image_native_v4(socket_t *socket);
+extern int get_text_compressed_v4(socket_t *socket);
+extern int get_files_compressed_v4(socket_t *socket);
+extern int get_text_if_changed_v4(socket_t *socket);
+extern int get_files_if_changed_v4(socket_t *socket);
+extern int get_copied_image_if_changed_v4(socket_t *socket);
+extern int get_screenshot_if_changed_v4(socket_t *socket);
+extern int get_text_delta_v4(socket_t *socket);
+extern int get_files_streamed_v4(socket_t *socket);
+extern int send_files_manifest_v4(socket_t *socket);
+extern int get_files_packed_v4(socket_t *socket);
+extern int send_files_packed_v4(socket_t *socket);
+extern int get_file_resume_v4(socket_t *socket);
+extern int send_files_resumable_v4(socket_t *socket);
+extern int get_files_delta_v4(socket_t *socket);
+extern int send_files_dedup_v4(socket_t *socket);
+extern int get_files_verified_v4(socket_t *socket);
+extern int send_files_verified_v4(socket_t *socket);
+extern int get_files_sparse_v4(socket_t *socket);
+extern int send_files_sparse_v4(socket_t *socket);
+#endif
+
 #endif  // PROTO_METHODS_H_
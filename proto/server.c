@@ -96,6 +96,12 @@ void server(socket_t *socket) {
             version_3(socket);
             break;
         }
+#endif
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+        case 4: {
+            version_4(socket);
+            break;
+        }
 #endif
         default:  // invalid or unknown version
             break;
@@ -32,6 +32,30 @@
 #define METHOD_GET_IMAGE 5
 #define METHOD_GET_COPIED_IMAGE 6
 #define METHOD_GET_SCREENSHOT 7
+#define METHOD_GET_SCREENSHOT_DELTA 8
+#define METHOD_STREAM_SCREEN 9
+#define METHOD_GET_SCREENSHOT_REGION 10
+#define METHOD_LIST_DISPLAYS 11
+#define METHOD_GET_COPIED_IMAGE_NATIVE 12
+#define METHOD_GET_TEXT_COMPRESSED 13
+#define METHOD_GET_FILES_COMPRESSED 14
+#define METHOD_GET_TEXT_IF_CHANGED 15
+#define METHOD_GET_FILES_IF_CHANGED 16
+#define METHOD_GET_COPIED_IMAGE_IF_CHANGED 17
+#define METHOD_GET_SCREENSHOT_IF_CHANGED 18
+#define METHOD_GET_TEXT_DELTA 19
+#define METHOD_GET_FILES_STREAMED 20
+#define METHOD_SEND_FILES_MANIFEST 21
+#define METHOD_GET_FILES_PACKED 22
+#define METHOD_SEND_FILES_PACKED 23
+#define METHOD_GET_FILE_RESUME 24
+#define METHOD_SEND_FILES_RESUMABLE 25
+#define METHOD_GET_FILES_DELTA 26
+#define METHOD_SEND_FILES_DEDUP 27
+#define METHOD_GET_FILES_VERIFIED 28
+#define METHOD_SEND_FILES_VERIFIED 29
+#define METHOD_GET_FILES_SPARSE 30
+#define METHOD_SEND_FILES_SPARSE 31
 #define METHOD_INFO 125
 
 // status codes
@@ -41,7 +65,10 @@
 static int check_method_enabled(socket_t *socket, int method) {
     char disabled = 0;
     switch (method) {
-        case METHOD_GET_TEXT: {
+        case METHOD_GET_TEXT:
+        case METHOD_GET_TEXT_COMPRESSED:
+        case METHOD_GET_TEXT_IF_CHANGED:
+        case METHOD_GET_TEXT_DELTA: {
             if (!configuration.method_enabled.get_text) disabled = 1;
             break;
         }
@@ -49,11 +76,25 @@ static int check_method_enabled(socket_t *socket, int method) {
             if (!configuration.method_enabled.send_text) disabled = 1;
             break;
         }
-        case METHOD_GET_FILE: {
+        case METHOD_GET_FILE:
+        case METHOD_GET_FILES_COMPRESSED:
+        case METHOD_GET_FILES_IF_CHANGED:
+        case METHOD_GET_FILES_STREAMED:
+        case METHOD_GET_FILES_PACKED:
+        case METHOD_GET_FILE_RESUME:
+        case METHOD_GET_FILES_DELTA:
+        case METHOD_GET_FILES_VERIFIED:
+        case METHOD_GET_FILES_SPARSE: {
             if (!configuration.method_enabled.get_files) disabled = 1;
             break;
         }
-        case METHOD_SEND_FILE: {
+        case METHOD_SEND_FILE:
+        case METHOD_SEND_FILES_MANIFEST:
+        case METHOD_SEND_FILES_PACKED:
+        case METHOD_SEND_FILES_RESUMABLE:
+        case METHOD_SEND_FILES_DEDUP:
+        case METHOD_SEND_FILES_VERIFIED:
+        case METHOD_SEND_FILES_SPARSE: {
             if (!configuration.method_enabled.send_files) disabled = 1;
             break;
         }
@@ -61,11 +102,18 @@ static int check_method_enabled(socket_t *socket, int method) {
             if (!configuration.method_enabled.get_image) disabled = 1;
             break;
         }
-        case METHOD_GET_COPIED_IMAGE: {
+        case METHOD_GET_COPIED_IMAGE:
+        case METHOD_GET_COPIED_IMAGE_NATIVE:
+        case METHOD_GET_COPIED_IMAGE_IF_CHANGED: {
             if (!configuration.method_enabled.get_copied_image) disabled = 1;
             break;
         }
-        case METHOD_GET_SCREENSHOT: {
+        case METHOD_GET_SCREENSHOT:
+        case METHOD_GET_SCREENSHOT_DELTA:
+        case METHOD_STREAM_SCREEN:
+        case METHOD_GET_SCREENSHOT_REGION:
+        case METHOD_LIST_DISPLAYS:
+        case METHOD_GET_SCREENSHOT_IF_CHANGED: {
             if (!configuration.method_enabled.get_screenshot) disabled = 1;
             break;
         }
@@ -220,3 +268,122 @@ int version_3(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 #endif
+
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+
+int version_4(socket_t *socket) {
+    unsigned char method;
+    if (read_sock(socket, (char *)&method, 1) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if (check_method_enabled(socket, method) != EXIT_SUCCESS) {
+        return EXIT_SUCCESS;
+    }
+
+    switch (method) {
+        case METHOD_GET_TEXT: {
+            return get_text_v1(socket);
+        }
+        case METHOD_SEND_TEXT: {
+            return send_text_v1(socket);
+        }
+        case METHOD_GET_FILE: {
+            return get_files_v3(socket);
+        }
+        case METHOD_SEND_FILE: {
+            return send_files_v3(socket);
+        }
+        case METHOD_GET_IMAGE: {
+            return get_image_v4(socket);
+        }
+        case METHOD_GET_COPIED_IMAGE: {
+            return get_copied_image_v4(socket);
+        }
+        case METHOD_GET_SCREENSHOT: {
+            return get_screenshot_v4(socket);
+        }
+        case METHOD_GET_SCREENSHOT_DELTA: {
+            return get_screenshot_delta_v4(socket);
+        }
+        case METHOD_STREAM_SCREEN: {
+            return stream_screen_v4(socket);
+        }
+        case METHOD_GET_SCREENSHOT_REGION: {
+            return get_screenshot_region_v4(socket);
+        }
+        case METHOD_LIST_DISPLAYS: {
+            return list_displays_v4(socket);
+        }
+        case METHOD_GET_COPIED_IMAGE_NATIVE: {
+            return get_copied_image_native_v4(socket);
+        }
+        case METHOD_GET_TEXT_COMPRESSED: {
+            return get_text_compressed_v4(socket);
+        }
+        case METHOD_GET_FILES_COMPRESSED: {
+            return get_files_compressed_v4(socket);
+        }
+        case METHOD_GET_TEXT_IF_CHANGED: {
+            return get_text_if_changed_v4(socket);
+        }
+        case METHOD_GET_FILES_IF_CHANGED: {
+            return get_files_if_changed_v4(socket);
+        }
+        case METHOD_GET_COPIED_IMAGE_IF_CHANGED: {
+            return get_copied_image_if_changed_v4(socket);
+        }
+        case METHOD_GET_SCREENSHOT_IF_CHANGED: {
+            return get_screenshot_if_changed_v4(socket);
+        }
+        case METHOD_GET_TEXT_DELTA: {
+            return get_text_delta_v4(socket);
+        }
+        case METHOD_GET_FILES_STREAMED: {
+            return get_files_streamed_v4(socket);
+        }
+        case METHOD_SEND_FILES_MANIFEST: {
+            return send_files_manifest_v4(socket);
+        }
+        case METHOD_GET_FILES_PACKED: {
+            return get_files_packed_v4(socket);
+        }
+        case METHOD_SEND_FILES_PACKED: {
+            return send_files_packed_v4(socket);
+        }
+        case METHOD_GET_FILE_RESUME: {
+            return get_file_resume_v4(socket);
+        }
+        case METHOD_SEND_FILES_RESUMABLE: {
+            return send_files_resumable_v4(socket);
+        }
+        case METHOD_GET_FILES_DELTA: {
+            return get_files_delta_v4(socket);
+        }
+        case METHOD_SEND_FILES_DEDUP: {
+            return send_files_dedup_v4(socket);
+        }
+        case METHOD_GET_FILES_VERIFIED: {
+            return get_files_verified_v4(socket);
+        }
+        case METHOD_SEND_FILES_VERIFIED: {
+            return send_files_verified_v4(socket);
+        }
+        case METHOD_GET_FILES_SPARSE: {
+            return get_files_sparse_v4(socket);
+        }
+        case METHOD_SEND_FILES_SPARSE: {
+            return send_files_sparse_v4(socket);
+        }
+        case METHOD_INFO: {
+            return info_v1(socket);
+        }
+        default: {  // unknown method
+            write_sock(socket, &(char){STATUS_UNKNOWN_METHOD}, 1);
+            close_socket_no_wait(socket);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+#endif
@@ -22,6 +22,9 @@
 #include <utils/config.h>
 #include <utils/net_utils.h>
 #include <utils/utils.h>
+#ifdef __linux__
+#include <utils/uring_io.h>
+#endif
 #if defined(__linux__) || defined(__APPLE__)
 #include <sys/socket.h>
 #include <unistd.h>
@@ -81,6 +84,11 @@ int clip_share(const int is_secure) {
         close_listener_socket(&listener);
         return EXIT_FAILURE;
     }
+    init_server_state();
+#ifdef __linux__
+    // io_uring is used only on plain sockets. Probing here lets each connection handler inherit the result
+    if (!is_secure) uring_probe();
+#endif
 
     while (1) {
         socket_t connect_sock;
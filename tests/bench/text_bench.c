@@ -0,0 +1,250 @@
+/*
+ * tests/bench/text_bench.c - microbenchmark for UTF-8 validation and line ending conversion
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the single pass kernels in utils/text_utils.c with the byte by byte validation and conversion passes they
+ * replaced, after checking that both give the same results.
+ * Usage: text_bench [size_in_MiB]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utils/text_utils.h>
+
+#define ROUNDS 5
+
+/*
+ * Byte by byte UTF-8 validation, decoding each code point
+ */
+static int _legacy_utf8_check(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        const unsigned char c = p[i];
+        uint32_t cp;
+        size_t n;
+        if (c < 0x80) {
+            i++;
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            cp = c & 0x1FU;
+            n = 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            cp = c & 0x0FU;
+            n = 3;
+        } else if ((c & 0xF8) == 0xF0) {
+            cp = c & 0x07U;
+            n = 4;
+        } else {
+            return EXIT_FAILURE;
+        }
+        if (i + n > len) return EXIT_FAILURE;
+        for (size_t j = 1; j < n; j++) {
+            if ((p[i + j] & 0xC0) != 0x80) return EXIT_FAILURE;
+            cp = (cp << 6) | (p[i + j] & 0x3FU);
+        }
+        if ((n == 2 && cp < 0x80) || (n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000)) return EXIT_FAILURE;
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return EXIT_FAILURE;
+        i += n;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int64_t _legacy_to_lf(char *str) {
+    const char *old_ptr = str;
+    char *new_ptr = str;
+    char c;
+    while ((c = *old_ptr)) {
+        old_ptr++;
+        if (c != '\r' || *old_ptr != '\n') {
+            *new_ptr = c;
+            new_ptr++;
+        }
+    }
+    *new_ptr = '\0';
+    return new_ptr - str;
+}
+
+static int64_t _legacy_to_crlf(char **str_p) {
+    char *str = *str_p;
+    size_t increase = 0;
+    size_t len;
+    for (len = 0; str[len]; len++) {
+        if (str[len] == '\n' && (len == 0 || str[len - 1] != '\r')) increase++;
+    }
+    if (!increase) return (int64_t)len;
+    const size_t new_len = len + increase;
+    str = realloc(str, new_len + 1);
+    if (!str) return -1;
+    *str_p = str;
+    size_t new_ind = new_len - 1;
+    str[new_len] = 0;
+    for (size_t cur_ind = len - 1;; cur_ind--) {
+        const char c = str[cur_ind];
+        str[new_ind--] = c;
+        if (c == '\n' && (cur_ind == 0 || str[cur_ind - 1] != '\r')) str[new_ind--] = '\r';
+        if (cur_ind == 0) break;
+    }
+    return (int64_t)new_len;
+}
+
+static double _now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Fill buf with len bytes of log-like text. Every line ends with CRLF if crlf is set, or with LF otherwise.
+ * If non_ascii is set, some words are replaced with multi-byte characters.
+ */
+static void _fill_text(char *buf, size_t len, int crlf, int non_ascii) {
+    static const char *const words[] = {"INFO",  "server", "accepted", "connection", "from", "10.0.0.42",
+                                        "bytes", "sent",   "2024-05-01", "ok",      "\xC3\xA9t\xC3\xA9",
+                                        "\xE6\x97\xA5\xE6\x9C\xAC", "\xF0\x9F\x98\x80"};
+    const unsigned word_cnt = non_ascii ? 13 : 10;
+    uint32_t seed = 12345;
+    size_t ind = 0;
+    unsigned line_words = 0;
+    while (ind + 8 < len) {
+        seed = seed * 1103515245U + 12345U;
+        const char *word = words[(seed >> 16) % word_cnt];
+        const size_t word_len = strlen(word);
+        if (ind + word_len + 3 >= len) break;
+        memcpy(buf + ind, word, word_len);
+        ind += word_len;
+        if (++line_words == 12) {
+            if (crlf) buf[ind++] = '\r';
+            buf[ind++] = '\n';
+            line_words = 0;
+        } else {
+            buf[ind++] = ' ';
+        }
+    }
+    while (ind < len) buf[ind++] = '.';
+    buf[len] = 0;
+}
+
+static char *_copy(const char *src, size_t len) {
+    char *dest = malloc(len + 1);
+    if (!dest) {
+        fputs("malloc failed\n", stderr);
+        exit(1);
+    }
+    memcpy(dest, src, len + 1);
+    return dest;
+}
+
+/*
+ * Check that the kernels give the same results as the legacy implementations on the sample and on corrupted copies.
+ */
+static int _verify(const char *sample, size_t len) {
+    if (utf8_validate(sample, len) != _legacy_utf8_check((const unsigned char *)sample, len)) return EXIT_FAILURE;
+    uint32_t seed = 42;
+    for (int i = 0; i < 2000; i++) {
+        seed = seed * 1103515245U + 12345U;
+        const size_t sub_len = (seed >> 8) % 300;
+        const size_t off = (seed >> 4) % (len - sub_len);
+        char *sub = _copy(sample + off, sub_len);
+        sub[sub_len] = 0;
+        if (i % 2 && sub_len) sub[(seed >> 3) % sub_len] = (char)(seed >> 24);  // corrupt a byte
+        if (utf8_validate(sub, sub_len) != _legacy_utf8_check((const unsigned char *)sub, sub_len)) {
+            free(sub);
+            return EXIT_FAILURE;
+        }
+        char *a = _copy(sub, sub_len);
+        char *b = _copy(sub, sub_len);
+        int64_t len_a = text_to_lf(a, sub_len, 0);
+        int64_t len_b = _legacy_to_lf(b);
+        int same = len_a == len_b && !memcmp(a, b, (size_t)len_a + 1);
+        free(a);
+        free(b);
+        a = _copy(sub, sub_len);
+        b = _copy(sub, sub_len);
+        len_a = text_to_crlf(&a, sub_len, 0);
+        len_b = _legacy_to_crlf(&b);
+        same = same && len_a == len_b && !memcmp(a, b, (size_t)len_a + 1);
+        free(a);
+        free(b);
+        free(sub);
+        if (!same) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void _report(const char *name, double legacy, double fused, size_t len) {
+    const double mib = (double)len / (1024.0 * 1024.0);
+    printf("%-28s legacy %8.2f ms (%7.0f MiB/s)   fused %8.2f ms (%7.0f MiB/s)   x%.1f\n", name, legacy * 1e3,
+           mib / legacy, fused * 1e3, mib / fused, legacy / fused);
+}
+
+static void _bench(const char *name, const char *sample, size_t len, int to_crlf) {
+    double legacy = 1e9;
+    double fused = 1e9;
+    for (int round = 0; round < ROUNDS; round++) {
+        char *buf = _copy(sample, len);
+        double start = _now();
+        if (_legacy_utf8_check((const unsigned char *)buf, len) != EXIT_SUCCESS) exit(1);
+        if ((to_crlf ? _legacy_to_crlf(&buf) : _legacy_to_lf(buf)) < 0) exit(1);
+        double elapsed = _now() - start;
+        if (elapsed < legacy) legacy = elapsed;
+        free(buf);
+
+        buf = _copy(sample, len);
+        start = _now();
+        if ((to_crlf ? text_to_crlf(&buf, len, 1) : text_to_lf(buf, len, 1)) < 0) exit(1);
+        elapsed = _now() - start;
+        if (elapsed < fused) fused = elapsed;
+        free(buf);
+    }
+    _report(name, legacy, fused, len);
+}
+
+int main(int argc, char **argv) {
+    size_t mib = 64;
+    if (argc > 1) mib = strtoul(argv[1], NULL, 10);
+    if (mib == 0) mib = 1;
+    const size_t len = mib * 1024 * 1024;
+    char *crlf_text = malloc(len + 1);
+    char *lf_text = malloc(len + 1);
+    char *utf8_text = malloc(len + 1);
+    if (!crlf_text || !lf_text || !utf8_text) {
+        fputs("malloc failed\n", stderr);
+        return 1;
+    }
+    _fill_text(crlf_text, len, 1, 0);
+    _fill_text(lf_text, len, 0, 0);
+    _fill_text(utf8_text, len, 1, 1);
+
+    if (_verify(crlf_text, len) || _verify(lf_text, len) || _verify(utf8_text, len)) {
+        fputs("Results differ from the legacy implementation\n", stderr);
+        return 1;
+    }
+    printf("%zu MiB, best of %d rounds, validating UTF-8 and converting EOL\n", mib, ROUNDS);
+    _bench("ASCII CRLF -> LF", crlf_text, len, 0);
+    _bench("ASCII LF -> LF (no change)", lf_text, len, 0);
+    _bench("ASCII LF -> CRLF", lf_text, len, 1);
+    _bench("UTF-8 CRLF -> LF", utf8_text, len, 0);
+    _bench("UTF-8 CRLF -> CRLF", utf8_text, len, 1);
+    free(crlf_text);
+    free(lf_text);
+    free(utf8_text);
+    return 0;
+}
@@ -282,6 +282,54 @@ update_config() {
     sleep 0.1
 }
 
+# Convert an image received as chunks to the image size followed by the image. Usage: unchunk_image <hex dump>
+# Prints nothing if the chunks are not terminated properly.
+unchunk_image() {
+    local dump="$1"
+    local image=''
+    local size
+    while [ "${#dump}" -ge 16 ]; do
+        size="$((16#${dump::16}))"
+        dump="${dump:16}"
+        if [ "$size" = '0' ] && [ -z "$dump" ]; then
+            printf '%016x%s' "$((${#image} / 2))" "$image"
+            return
+        fi
+        if [ "$size" -le 0 ] || [ "$size" -gt 65536 ] || [ "${#dump}" -lt "$((size * 2))" ]; then
+            return
+        fi
+        image="${image}${dump::$((size * 2))}"
+        dump="${dump:$((size * 2))}"
+    done
+}
+
+# Decompress a compressed stream, which is the compression code followed by the chunks, from the start of a hex dump.
+# Usage: decompress_stream <hex dump>
+# Prints the compression code, the decompressed data, and the rest of the dump after the stream, as hex on separate
+# lines. Prints nothing if the stream is not valid.
+decompress_stream() {
+    python3 -c '
+import sys, zlib
+dump = bytes.fromhex(sys.argv[1])
+num = lambda pos: int.from_bytes(dump[pos:pos + 8], "big", signed=True)
+if len(dump) < 8: sys.exit(1)
+compression, pos, data = num(0), 8, b""
+while True:
+    if pos + 8 > len(dump): sys.exit(1)
+    size = num(pos)
+    pos += 8
+    if size == 0: break
+    if size < 0 or size > 65536 or pos + size > len(dump): sys.exit(1)
+    data += dump[pos:pos + size]
+    pos += size
+if compression == 1: data = zlib.decompress(data)
+elif compression != 0: sys.exit(1)
+print(compression)
+print(data.hex())
+print(dump[pos:].hex())
+' "$1" 2>/dev/null
+}
+
 # Define constants
 
 # Proto
@@ -298,6 +346,30 @@ export METHOD_SEND_FILES=$(printf '\x04' | bin2hex)
 export METHOD_GET_IMAGE=$(printf '\x05' | bin2hex)
 export METHOD_GET_COPIED_IMAGE=$(printf '\x06' | bin2hex)
 export METHOD_GET_SCREENSHOT=$(printf '\x07' | bin2hex)
+export METHOD_GET_SCREENSHOT_DELTA=$(printf '\x08' | bin2hex)
+export METHOD_STREAM_SCREEN=$(printf '\x09' | bin2hex)
+export METHOD_GET_SCREENSHOT_REGION=$(printf '\x0a' | bin2hex)
+export METHOD_LIST_DISPLAYS=$(printf '\x0b' | bin2hex)
+export METHOD_GET_COPIED_IMAGE_NATIVE=$(printf '\x0c' | bin2hex)
+export METHOD_GET_TEXT_COMPRESSED=$(printf '\x0d' | bin2hex)
+export METHOD_GET_FILES_COMPRESSED=$(printf '\x0e' | bin2hex)
+export METHOD_GET_TEXT_IF_CHANGED=$(printf '\x0f' | bin2hex)
+export METHOD_GET_FILES_IF_CHANGED=$(printf '\x10' | bin2hex)
+export METHOD_GET_COPIED_IMAGE_IF_CHANGED=$(printf '\x11' | bin2hex)
+export METHOD_GET_SCREENSHOT_IF_CHANGED=$(printf '\x12' | bin2hex)
+export METHOD_GET_TEXT_DELTA=$(printf '\x13' | bin2hex)
+export METHOD_GET_FILES_STREAMED=$(printf '\x14' | bin2hex)
+export METHOD_SEND_FILES_MANIFEST=$(printf '\x15' | bin2hex)
+export METHOD_GET_FILES_PACKED=$(printf '\x16' | bin2hex)
+export METHOD_SEND_FILES_PACKED=$(printf '\x17' | bin2hex)
+export METHOD_GET_FILE_RESUME=$(printf '\x18' | bin2hex)
+export METHOD_SEND_FILES_RESUMABLE=$(printf '\x19' | bin2hex)
+export METHOD_GET_FILES_DELTA=$(printf '\x1a' | bin2hex)
+export METHOD_SEND_FILES_DEDUP=$(printf '\x1b' | bin2hex)
+export METHOD_GET_FILES_VERIFIED=$(printf '\x1c' | bin2hex)
+export METHOD_SEND_FILES_VERIFIED=$(printf '\x1d' | bin2hex)
+export METHOD_GET_FILES_SPARSE=$(printf '\x1e' | bin2hex)
+export METHOD_SEND_FILES_SPARSE=$(printf '\x1f' | bin2hex)
 export METHOD_INFO=$(printf '\x7d' | bin2hex)
 
 # Proto ack
@@ -310,6 +382,9 @@ export METHOD_OK=$(printf '\x01' | bin2hex)
 export METHOD_NO_DATA=$(printf '\x02' | bin2hex)
 export METHOD_UNKNOWN_METHOD=$(printf '\x03' | bin2hex)
 export METHOD_NOT_IMPLEMENTED=$(printf '\x04' | bin2hex)
+export METHOD_NOT_MODIFIED=$(printf '\x05' | bin2hex)
+export METHOD_CHANGED=$(printf '\x06' | bin2hex)
+export METHOD_CORRUPTED=$(printf '\x07' | bin2hex)
 
 export imgSample="89504e470d0a1a0a0000000d4948445200000005000000050802000000020db1b20\
 00000264944415408d755cb2112002010804070fcff973168f0681bb042b99501f5ac8bbf9ad6c\
@@ -317,7 +392,7 @@ dfc0f828c0e0522b1809c0000000049454e44ae426082"
 
 # Export variables and functions
 export DETECTED_OS
-export -f setColor showStatus client_tool copy_text get_copied_text copy_files copy_image clear_clipboard update_config
+export -f setColor showStatus client_tool copy_text get_copied_text copy_files copy_image clear_clipboard update_config unchunk_image decompress_stream
 
 exitCode=0
 passCnt=0
@@ -0,0 +1,61 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_SCREENSHOT_REGION"
+disp="$(printf '%016x' 1)"
+# x=8, y=4, width=200, height=100, max_width=50, max_height=0
+params="$(printf '%016x' 8 4 200 100 50 0)"
+
+copy_image "$imgSample"
+
+responseDump=$(echo -n "${proto}${method}${disp}${params}" | hex2bin | client_tool)
+
+protoAck="$PROTO_SUPPORTED"
+methodAck="$METHOD_OK"
+
+if [ "$DETECTED_OS" != 'Linux' ]; then
+    # screenshot region is available only on Linux
+    expected="${protoAck}${methodAck}${METHOD_NO_DATA}"
+    if [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$responseDump"
+        exit 1
+    fi
+    exit 0
+fi
+
+expected_head="${protoAck}${methodAck}${METHOD_OK}"
+if [ "${responseDump::${#expected_head}}" != "$expected_head" ]; then
+    showStatus info 'Incorrect protocol:method:display ack.'
+    echo 'Expected:' "$expected_head"
+    echo 'Received:' "${responseDump::${#expected_head}}"
+    exit 1
+fi
+responseDump="$(unchunk_image "${responseDump:${#expected_head}}")"
+
+length="$((16#${responseDump::16}))"
+responseDump="${responseDump:16}"
+if [ "$length" != "$((${#responseDump} / 2))" ]; then
+    echo "$length" does not match with "${#responseDump}"
+    showStatus info 'Invalid image length.'
+    exit 1
+fi
+
+expected_png_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+if [ "${responseDump::${#expected_png_header}}" != "$expected_png_header" ]; then
+    showStatus info 'Invalid image header.'
+    exit 1
+fi
+
+# the width and height are in the IHDR chunk following the PNG header
+width="$((16#${responseDump:32:8}))"
+height="$((16#${responseDump:40:8}))"
+if [ "$width" != '50' ] || [ "$height" != '25' ]; then
+    showStatus info 'Incorrect image dimensions.'
+    echo 'Expected: 50x25'
+    echo "Received: ${width}x${height}"
+    exit 1
+fi
@@ -0,0 +1,67 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_LIST_DISPLAYS"
+
+responseDump=$(echo -n "${proto}${method}" | hex2bin | client_tool)
+
+protoAck="$PROTO_SUPPORTED"
+methodAck="$METHOD_OK"
+
+if [ "$DETECTED_OS" != 'Linux' ]; then
+    # listing displays is available only on Linux
+    expected="${protoAck}${METHOD_NO_DATA}"
+    if [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$responseDump"
+        exit 1
+    fi
+    exit 0
+fi
+
+expected_head="${protoAck}${methodAck}"
+if [ "${responseDump::${#expected_head}}" != "$expected_head" ]; then
+    showStatus info 'Incorrect protocol:method ack.'
+    echo 'Expected:' "$expected_head"
+    echo 'Received:' "${responseDump::${#expected_head}}"
+    exit 1
+fi
+responseDump="${responseDump:${#expected_head}}"
+
+display_cnt="$((16#${responseDump::16}))"
+responseDump="${responseDump:16}"
+if [ "$display_cnt" -le 0 ]; then
+    showStatus info 'No displays listed.'
+    exit 1
+fi
+
+for _ in $(seq "$display_cnt"); do
+    name_len="$((16#${responseDump::16}))"
+    if [ "$name_len" -lt 0 ] || [ "$name_len" -gt 63 ]; then
+        showStatus info "Invalid display name length ${name_len}."
+        exit 1
+    fi
+    responseDump="${responseDump:$((16 + name_len * 2))}"
+    width="$((16#${responseDump:32:16}))"
+    height="$((16#${responseDump:48:16}))"
+    primary="$((16#${responseDump:64:16}))"
+    responseDump="${responseDump:80}"
+    if [ "$width" -le 0 ] || [ "$height" -le 0 ]; then
+        showStatus info 'Invalid display size.'
+        echo "Received: ${width}x${height}"
+        exit 1
+    fi
+    if [ "$primary" != '0' ] && [ "$primary" != '1' ]; then
+        showStatus info "Invalid primary flag ${primary}."
+        exit 1
+    fi
+done
+
+if [ -n "$responseDump" ]; then
+    showStatus info 'Unexpected data after the displays.'
+    echo "Received: ${responseDump::32} ..."
+    exit 1
+fi
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_COPIED_IMAGE_NATIVE"
+
+FORMAT_PNG=1
+FORMAT_JPEG=2
+
+# Request the copied image accepting the formats $1 and check the response header.
+# Sets format and image (the image as a size followed by the data) from the response.
+get_native_image() {
+    local formats="$(printf '%016x' "$1")"
+    local responseDump=$(echo -n "${proto}${method}${formats}" | hex2bin | client_tool)
+    local expected_head="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+    if [ "${responseDump::${#expected_head}}" != "$expected_head" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$expected_head"
+        echo 'Received:' "${responseDump::${#expected_head}}"
+        exit 1
+    fi
+    responseDump="${responseDump:${#expected_head}}"
+    format="$((16#${responseDump::16}))"
+    image="$(unchunk_image "${responseDump:16}")"
+    if [ -z "$image" ]; then
+        showStatus info 'Invalid image chunks.'
+        exit 1
+    fi
+}
+
+copy_image "$imgSample"
+
+# The copied PNG image is sent as it is
+get_native_image "$((FORMAT_PNG + FORMAT_JPEG))"
+if [ "$format" != "$FORMAT_PNG" ]; then
+    showStatus info "Incorrect image format ${format}."
+    exit 1
+fi
+expected="$(printf '%016x' "$((${#imgSample} / 2))")${imgSample}"
+if [ "$DETECTED_OS" = 'Linux' ]; then
+    if [ "$image" != "$expected" ]; then
+        showStatus info 'Incorrect image.'
+        echo 'Expected:' "${expected::40} ..."
+        echo 'Received:' "${image::40} ..."
+        exit 1
+    fi
+elif [ "${image:16:16}" != "${expected:16:16}" ]; then
+    showStatus info 'Invalid image header.'
+    exit 1
+fi
+
+# A PNG image is not sent when the client accepts only JPEG
+responseDump=$(echo -n "${proto}${method}$(printf '%016x' "$FORMAT_JPEG")" | hex2bin | client_tool)
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+if [ "$DETECTED_OS" != 'Linux' ]; then
+    # copied images are available only as PNG on other platforms
+    exit 0
+fi
+
+# A copied JPEG image is sent without converting
+jpegSample="ffd8ffe000104a46494600010100000100010000ffd9"
+hex2bin <<<"$jpegSample" | xclip -in -sel clip -t image/jpeg
+get_native_image "$((FORMAT_PNG + FORMAT_JPEG))"
+if [ "$format" != "$FORMAT_JPEG" ]; then
+    showStatus info "Incorrect image format ${format}."
+    exit 1
+fi
+expected="$(printf '%016x' "$((${#jpegSample} / 2))")${jpegSample}"
+if [ "$image" != "$expected" ]; then
+    showStatus info 'Incorrect image.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$image"
+    exit 1
+fi
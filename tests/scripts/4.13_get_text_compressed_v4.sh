@@ -0,0 +1,60 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_TEXT_COMPRESSED"
+
+COMPRESSION_NONE=0
+COMPRESSION_DEFLATE=1
+
+sample="$(for i in $(seq 200); do echo "Sample line ${i} for get_text_compressed"; done)"
+sampleDump="$(echo -n "$sample" | bin2hex | tr -d '\n')"
+copy_text "$sample"
+
+# Request the copied text accepting the compressions $1 and check the response.
+check_text() {
+    local accepted="$(printf '%016x' "$1")"
+    local expectedCompression="$2"
+    local responseDump=$(echo -n "${proto}${method}${accepted}" | hex2bin | client_tool)
+    local expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}$(printf '%016x' "${#sample}")"
+    if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$expectedHead"
+        echo 'Received:' "${responseDump::${#expectedHead}}"
+        exit 1
+    fi
+    local compression text rest
+    { read -r compression; read -r text; read -r rest; } < <(decompress_stream "${responseDump:${#expectedHead}}")
+    if [ "$compression" != "$expectedCompression" ]; then
+        showStatus info "Incorrect compression ${compression}."
+        exit 1
+    fi
+    if [ "$text" != "$sampleDump" ] || [ -n "$rest" ]; then
+        showStatus info 'Incorrect text.'
+        echo 'Expected:' "$sampleDump"
+        echo 'Received:' "$text"
+        exit 1
+    fi
+    if [ "$compression" = "$COMPRESSION_DEFLATE" ] && [ "${#responseDump}" -ge "${#sampleDump}" ]; then
+        showStatus info 'Text is not compressed.'
+        exit 1
+    fi
+}
+
+check_text "$COMPRESSION_DEFLATE" "$COMPRESSION_DEFLATE"
+
+# The text is sent without compressing if the client accepts no compression that the server supports
+check_text 0 "$COMPRESSION_NONE"
+check_text 256 "$COMPRESSION_NONE"
+
+clear_clipboard
+
+responseDump=$(echo -n "${proto}${method}$(printf '%016x' "$COMPRESSION_DEFLATE")" | hex2bin | client_tool)
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
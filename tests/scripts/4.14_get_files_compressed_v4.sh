@@ -0,0 +1,81 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILES_COMPRESSED"
+
+COMPRESSION_NONE=0
+COMPRESSION_DEFLATE=1
+
+mkdir -p original/sub original/empty && cd original
+for i in $(seq 500); do echo "line ${i} of a log file that compresses well"; done >'log file.txt'
+echo 'small' >'sub/small.txt'
+hex2bin <<<"$imgSample" >'sub/image.png'
+: >'empty.txt'
+fileCount=5
+cd ..
+
+copy_files original/*
+
+responseDump=$(echo -n "${proto}${method}$(printf '%016x' "$COMPRESSION_DEFLATE")" | hex2bin | client_tool)
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}$(printf '%016x' "$fileCount")"
+if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect response header'
+    echo 'Expected:' "$expectedHead"
+    echo 'Received:' "${responseDump::${#expectedHead}}"
+    exit 1
+fi
+
+mkdir -p copies && cd copies
+
+body="${responseDump:${#expectedHead}}"
+for _ in $(seq "$fileCount"); do
+    nameLength="$((0x${body::16}))"
+    if [ "$nameLength" -gt 1024 ]; then
+        showStatus info "File name too long. Length=${nameLength}."
+        exit 1
+    fi
+    fileName="$(echo "${body:16:$((nameLength * 2))}" | hex2bin)"
+    body="${body:$((16 + nameLength * 2))}"
+
+    fileSize="$((0x${body::16}))"
+    body="${body:16}"
+    if [ "$fileSize" = '-1' ]; then
+        mkdir -p "$fileName"
+        continue
+    fi
+    { read -r compression; read -r content; read -r body; } < <(decompress_stream "$body")
+    if [ -z "$compression" ] || [ "$((${#content} / 2))" != "$fileSize" ]; then
+        showStatus info "Invalid compressed stream for ${fileName}."
+        exit 1
+    fi
+    case "$fileName" in
+        'log file.txt') expectedCompression="$COMPRESSION_DEFLATE" ;;
+        # already compressed and empty files are not compressed
+        'sub/image.png' | 'empty.txt') expectedCompression="$COMPRESSION_NONE" ;;
+        *) expectedCompression="$compression" ;;
+    esac
+    if [ "$compression" != "$expectedCompression" ]; then
+        showStatus info "Incorrect compression ${compression} for ${fileName}."
+        exit 1
+    fi
+    if [[ $fileName == */* ]]; then
+        mkdir -p "${fileName%/*}"
+    fi
+    echo -n "$content" | hex2bin >"$fileName"
+done
+
+if [ "$body" != '' ]; then
+    showStatus info 'Incorrect response body'
+    exit 1
+fi
+
+cd ..
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
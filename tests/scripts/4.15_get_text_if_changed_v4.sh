@@ -0,0 +1,73 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_TEXT_IF_CHANGED"
+
+# Request the copied text with the known hash $1 and print the response dump.
+get_text_if_changed() {
+    echo -n "${proto}${method}$1" | hex2bin | client_tool
+}
+
+# Check the response to a request that is expected to return the text $2, and print the hash in the response.
+check_text() {
+    local responseDump="$1"
+    local sampleDump="$(echo -n "$2" | bin2hex | tr -d '\n')"
+    local expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+    local hash="${responseDump:${#expectedHead}:16}"
+    local expected="${expectedHead}${hash}$(printf '%016x' "$((${#sampleDump} / 2))")${sampleDump}"
+    if [ "${#hash}" != 16 ] || [ "$hash" = '0000000000000000' ] || [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.' >&2
+        echo 'Expected:' "$expected" >&2
+        echo 'Received:' "$responseDump" >&2
+        exit 1
+    fi
+    echo "$hash"
+}
+
+check_not_modified() {
+    local expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NOT_MODIFIED}"
+    if [ "$1" != "$expected" ]; then
+        showStatus info 'Expected not modified.'
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$1"
+        exit 1
+    fi
+}
+
+sample='Text for get_text_if_changed'
+copy_text "$sample"
+
+# A hash of 0 never matches
+hash="$(check_text "$(get_text_if_changed 0000000000000000)" "$sample")" || exit 1
+
+check_not_modified "$(get_text_if_changed "$hash")"
+
+# A different hash gets the text again with the same hash
+hash2="$(check_text "$(get_text_if_changed 0123456789abcdef)" "$sample")" || exit 1
+if [ "$hash2" != "$hash" ]; then
+    showStatus info 'Hash changed for the same text.'
+    exit 1
+fi
+
+sample='Changed text for get_text_if_changed'
+copy_text "$sample"
+
+hash2="$(check_text "$(get_text_if_changed "$hash")" "$sample")" || exit 1
+if [ "$hash2" = "$hash" ]; then
+    showStatus info 'Hash did not change for a different text.'
+    exit 1
+fi
+check_not_modified "$(get_text_if_changed "$hash2")"
+
+clear_clipboard
+
+responseDump="$(get_text_if_changed "$hash2")"
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
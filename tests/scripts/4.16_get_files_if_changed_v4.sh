@@ -0,0 +1,70 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILES_IF_CHANGED"
+
+fileName='file if changed.txt'
+nameDump="$(echo -n "$fileName" | bin2hex | tr -d '\n')"
+
+mkdir -p original
+echo 'content of the file' >"original/${fileName}"
+copy_files "original/${fileName}"
+
+# Request the copied files with the known hash $1 and print the response dump.
+get_files_if_changed() {
+    echo -n "${proto}${method}$1" | hex2bin | client_tool
+}
+
+# Check the response to a request that is expected to return the copied file, and print the hash in the response.
+check_files() {
+    local responseDump="$1"
+    local contentDump="$(cat "original/${fileName}" | bin2hex | tr -d '\n')"
+    local expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+    local hash="${responseDump:${#expectedHead}:16}"
+    local expected="${expectedHead}${hash}$(printf '%016x' 1)$(printf '%016x' "$((${#nameDump} / 2))")${nameDump}"
+    expected+="$(printf '%016x' "$((${#contentDump} / 2))")${contentDump}"
+    if [ "${#hash}" != 16 ] || [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.' >&2
+        echo 'Expected:' "$expected" >&2
+        echo 'Received:' "$responseDump" >&2
+        exit 1
+    fi
+    echo "$hash"
+}
+
+check_not_modified() {
+    local expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NOT_MODIFIED}"
+    if [ "$1" != "$expected" ]; then
+        showStatus info 'Expected not modified.'
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$1"
+        exit 1
+    fi
+}
+
+hash="$(check_files "$(get_files_if_changed 0000000000000000)")" || exit 1
+
+check_not_modified "$(get_files_if_changed "$hash")"
+
+# Modifying the copied file changes the hash
+echo 'modified content of the file' >"original/${fileName}"
+
+hash2="$(check_files "$(get_files_if_changed "$hash")")" || exit 1
+if [ "$hash2" = "$hash" ]; then
+    showStatus info 'Hash did not change for a modified file.'
+    exit 1
+fi
+check_not_modified "$(get_files_if_changed "$hash2")"
+
+clear_clipboard
+
+responseDump="$(get_files_if_changed "$hash2")"
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
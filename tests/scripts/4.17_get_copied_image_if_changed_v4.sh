@@ -0,0 +1,54 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_COPIED_IMAGE_IF_CHANGED"
+
+copy_image "$imgSample"
+
+# Request the copied image with the known hash $1 and print the response dump.
+get_image_if_changed() {
+    echo -n "${proto}${method}$1" | hex2bin | client_tool
+}
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+
+responseDump="$(get_image_if_changed 0000000000000000)"
+if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expectedHead"
+    echo 'Received:' "${responseDump::${#expectedHead}}"
+    exit 1
+fi
+hash="${responseDump:${#expectedHead}:16}"
+image="$(unchunk_image "${responseDump:$((${#expectedHead} + 16))}")"
+expected_png_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+if [ "${#hash}" != 16 ] || [ "${image:16:${#expected_png_header}}" != "$expected_png_header" ]; then
+    showStatus info 'Invalid image.'
+    exit 1
+fi
+if [ "$DETECTED_OS" = 'Linux' ] && [ "${image:16}" != "$imgSample" ]; then
+    showStatus info 'Incorrect image.'
+    exit 1
+fi
+
+responseDump="$(get_image_if_changed "$hash")"
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NOT_MODIFIED}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Expected not modified.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+clear_clipboard
+
+responseDump="$(get_image_if_changed "$hash")"
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
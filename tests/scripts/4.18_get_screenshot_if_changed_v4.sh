@@ -0,0 +1,45 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_SCREENSHOT_IF_CHANGED"
+disp="$(printf '%016x' 1)"
+
+# Request a screenshot with the known hash $1 and print the response dump.
+get_screenshot_if_changed() {
+    echo -n "${proto}${method}${disp}$1" | hex2bin | client_tool
+}
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+
+responseDump="$(get_screenshot_if_changed 0000000000000000)"
+if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expectedHead"
+    echo 'Received:' "${responseDump::${#expectedHead}}"
+    exit 1
+fi
+hash="${responseDump:${#expectedHead}:16}"
+image="$(unchunk_image "${responseDump:$((${#expectedHead} + 16))}")"
+expected_png_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+if [ "${#hash}" != 16 ] || [ "${image:16:${#expected_png_header}}" != "$expected_png_header" ]; then
+    showStatus info 'Invalid screenshot.'
+    exit 1
+fi
+
+responseDump="$(get_screenshot_if_changed "$hash")"
+notModified="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NOT_MODIFIED}"
+if [ "$DETECTED_OS" = 'Linux' ]; then
+    # the screen of the test display does not change
+    if [ "$responseDump" != "$notModified" ]; then
+        showStatus info 'Expected not modified.'
+        echo 'Expected:' "$notModified"
+        echo 'Received:' "${responseDump::20} ..."
+        exit 1
+    fi
+elif [ "$responseDump" != "$notModified" ] && [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Received:' "${responseDump::20} ..."
+    exit 1
+fi
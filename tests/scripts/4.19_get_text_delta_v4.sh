@@ -0,0 +1,113 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_TEXT_DELTA"
+
+TEXT_FULL=0
+TEXT_DELTA=1
+
+# Request the copied text as a delta against the version with the hash $1 and print the response dump.
+get_text_delta() {
+    echo -n "${proto}${method}$1" | hex2bin | client_tool
+}
+
+# Apply the delta, given as a hex dump, to the base text given as a hex dump, and print the result as hex.
+# Prints nothing if the delta is not valid or has data after its end.
+apply_delta() {
+    python3 -c '
+import sys
+base = bytes.fromhex(sys.argv[1])
+delta = bytes.fromhex(sys.argv[2])
+out = b""
+pos = 0
+while pos + 8 <= len(delta):
+    n = int.from_bytes(delta[pos:pos + 8], "big", signed=True)
+    pos += 8
+    if n == 0:
+        if pos == len(delta):
+            print(out.hex())
+        sys.exit(0)
+    if n > 0:
+        out += delta[pos:pos + n]
+        pos += n
+    else:
+        offset = int.from_bytes(delta[pos:pos + 8], "big", signed=True)
+        pos += 8
+        if offset < 0 or offset - n > len(base):
+            sys.exit(0)
+        out += base[offset:offset - n]
+' "$1" "$2"
+}
+
+# Check the response to a request for the text given as a hex dump in $2, sent in the way $3, and print the hash.
+check_text() {
+    local responseDump="$1"
+    local textDump="$2"
+    local expectedKind="$(printf '%016x' "$3")"
+    local expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+    local hash="${responseDump:${#expectedHead}:16}"
+    local length="${responseDump:$((${#expectedHead} + 16)):16}"
+    local kind="${responseDump:$((${#expectedHead} + 32)):16}"
+    local body="${responseDump:$((${#expectedHead} + 48))}"
+    if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ] || [ "${#hash}" != 16 ] ||
+        [ "$length" != "$(printf '%016x' "$((${#textDump} / 2))")" ] || [ "$kind" != "$expectedKind" ]; then
+        showStatus info 'Incorrect server response.' >&2
+        echo 'Expected:' "${expectedHead}<hash>$(printf '%016x' "$((${#textDump} / 2))")${expectedKind}" >&2
+        echo 'Received:' "${responseDump::$((${#expectedHead} + 48))}" >&2
+        exit 1
+    fi
+    if [ "$3" = "$TEXT_DELTA" ]; then
+        if [ "${#body}" -ge "${#textDump}" ]; then
+            showStatus info 'Delta is not smaller than the text.' >&2
+            exit 1
+        fi
+        body="$(apply_delta "$baseDump" "$body")"
+    fi
+    if [ "$body" != "$textDump" ]; then
+        showStatus info 'Incorrect text.' >&2
+        exit 1
+    fi
+    echo "$hash"
+}
+
+sample="$(for i in $(seq 300); do echo "Log line ${i} for get_text_delta"; done)"
+baseDump="$(echo -n "$sample" | bin2hex | tr -d '\n')"
+copy_text "$sample"
+
+# Without a previous version, the full text is sent
+hash="$(check_text "$(get_text_delta 0000000000000000)" "$baseDump" "$TEXT_FULL")" || exit 1
+
+sample="$(for i in $(seq 20 320); do echo "Log line ${i} for get_text_delta"; done)"
+sampleDump="$(echo -n "$sample" | bin2hex | tr -d '\n')"
+copy_text "$sample"
+
+hash2="$(check_text "$(get_text_delta "$hash")" "$sampleDump" "$TEXT_DELTA")" || exit 1
+if [ "$hash2" = "$hash" ]; then
+    showStatus info 'Hash did not change for a different text.'
+    exit 1
+fi
+
+# An unknown previous version gets the full text
+check_text "$(get_text_delta 0123456789abcdef)" "$sampleDump" "$TEXT_FULL" >/dev/null || exit 1
+
+responseDump="$(get_text_delta "$hash2")"
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NOT_MODIFIED}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Expected not modified.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+clear_clipboard
+
+responseDump="$(get_text_delta "$hash2")"
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
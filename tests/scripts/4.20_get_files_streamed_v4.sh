@@ -0,0 +1,96 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILES_STREAMED"
+
+files=(
+    'file 1.txt'
+    'empty/'
+    'sub/file 2.txt'
+    'sub 1/empty dir/'
+    'sub 1/subsub/file 3.txt'
+)
+
+mkdir -p original && cd original
+for f in "${files[@]}"; do
+    if [[ $f == */* ]]; then
+        mkdir -p "${f%/*}"
+    fi
+    if [[ $f != */ ]]; then
+        echo "$f"$'\n''abc' >"$f"
+    fi
+done
+# enough files to fill the queue between the enumeration and the transfer
+mkdir -p many
+for i in $(seq 300); do echo "$i" >"many/file_${i}.txt"; done
+cd ..
+
+copy_files original/*
+
+responseDump=$(echo -n "${proto}${method}" | hex2bin | client_tool)
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}"
+if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect response header'
+    echo 'Expected:' "$expectedHead"
+    echo 'Received:' "${responseDump::${#expectedHead}}"
+    exit 1
+fi
+
+mkdir -p copies && cd copies
+
+body="${responseDump:${#expectedHead}}"
+while true; do
+    nameLength="$((0x${body::16}))"
+    body="${body:16}"
+    # a file name length of 0 marks the end of the files
+    [ "$nameLength" = 0 ] && break
+    if [ "$nameLength" -gt 1024 ] || [ -z "$body" ]; then
+        showStatus info "Invalid file name length ${nameLength}."
+        exit 1
+    fi
+    fileName="$(echo "${body::$((nameLength * 2))}" | hex2bin)"
+    body="${body:$((nameLength * 2))}"
+
+    fileSize="$((0x${body::16}))"
+    body="${body:16}"
+    if [ "$fileSize" = '-1' ]; then
+        mkdir -p "$fileName"
+        continue
+    fi
+    if [ "$fileSize" -gt 1048576 ]; then
+        showStatus info "File is too large. size=${fileSize}."
+        exit 1
+    fi
+    if [[ $fileName == */* ]]; then
+        mkdir -p "${fileName%/*}"
+    fi
+    echo "${body::$((fileSize * 2))}" | hex2bin >"$fileName"
+    body="${body:$((fileSize * 2))}"
+done
+
+if [ "$body" != '' ]; then
+    showStatus info 'Incorrect response body'
+    exit 1
+fi
+
+cd ..
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
+
+clear_clipboard
+
+responseDump=$(echo -n "${proto}${method}" | hex2bin | client_tool)
+expected="${PROTO_SUPPORTED}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
@@ -0,0 +1,84 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_SEND_FILES_MANIFEST"
+
+files=(
+    'file 1.txt'
+    'empty/'
+    'sub/file 2.txt'
+    'sub 1/empty 1/'
+    'sub 1/subsub/file 3.txt'
+    'sub 1/subsub/file_4.txt'
+)
+
+mkdir -p original && cd original
+
+for f in "${files[@]}"; do
+    if [[ $f == */* ]]; then
+        mkdir -p "${f%/*}"
+    fi
+    if [[ $f != */ ]]; then
+        echo "$f"$'\n''abc' >"$f"
+    fi
+done
+
+# the manifest has the names and sizes of all the files, and the contents of the files follow it
+manifest=''
+contents=''
+for fname in "${files[@]}"; do
+    printf -v _ '%s%n' "$fname" utf8nameLen
+    nameLength="$(printf '%016x' $utf8nameLen)"
+    if [ -d "$fname" ]; then
+        fileSize=-1
+    else
+        fileSize="$(stat -c '%s' "$fname")"
+        contents+=$(cat "$fname" | bin2hex | tr -d '\n')
+    fi
+    manifest+="${nameLength}$(echo -n "$fname" | bin2hex)$(printf '%016x' "$fileSize")"
+done
+
+cd ..
+mkdir -p copies
+update_config working_dir copies
+
+fileCount=$(printf '%016x' "${#files[@]}")
+
+responseDump=$(echo -n "${proto}${method}${fileCount}${manifest}${contents}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
+
+rm -rf copies/*
+
+# the manifest is rejected before any file is created if a file is too large
+update_config max_file_size 20
+
+responseDump=$(echo -n "${proto}${method}${fileCount}${manifest}${contents}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response for a rejected manifest.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+findOutput=$(find copies -mindepth 1 2>&1)
+if [ ! -z "$findOutput" ]; then
+    showStatus info 'Files are created for a rejected manifest.'
+    exit 1
+fi
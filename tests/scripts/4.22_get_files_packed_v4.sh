@@ -0,0 +1,93 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILES_PACKED"
+
+files=(
+    'file 1.txt'
+    'empty/'
+    'sub/file 2.txt'
+    'sub 1/empty 1/'
+    'sub 1/subsub/file 3.txt'
+)
+
+mkdir -p original && cd original
+for f in "${files[@]}"; do
+    if [[ $f == */* ]]; then
+        mkdir -p "${f%/*}"
+    fi
+    if [[ $f != */ ]]; then
+        echo "$f"$'\n''abc' >"$f"
+    fi
+done
+mkdir -p many
+for i in $(seq 200); do echo "small file ${i}" >"many/file_${i}.txt"; done
+# larger files are sent in frames of their own
+head -c 300000 /dev/urandom >'large.bin'
+cd ..
+
+copy_files original/*
+
+responseDump=$(echo -n "${proto}${method}" | hex2bin | client_tool)
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}"
+if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect response header'
+    echo 'Expected:' "$expectedHead"
+    echo 'Received:' "${responseDump::${#expectedHead}}"
+    exit 1
+fi
+
+mkdir -p copies && cd copies
+
+body="${responseDump:${#expectedHead}}"
+while true; do
+    fileCount="$((0x${body::16}))"
+    body="${body:16}"
+    # a frame of 0 files marks the end of the files
+    [ "$fileCount" = 0 ] && break
+    if [ "$fileCount" -lt 0 ] || [ -z "$body" ]; then
+        showStatus info "Invalid file count ${fileCount}."
+        exit 1
+    fi
+    tableLength="$((0x${body::16}))"
+    table="${body:16:$((tableLength * 2))}"
+    body="${body:$((16 + tableLength * 2))}"
+
+    # the contents of the files follow the table in the same order
+    for _ in $(seq "$fileCount"); do
+        nameLength="$((0x${table::16}))"
+        fileName="$(echo "${table:16:$((nameLength * 2))}" | hex2bin)"
+        table="${table:$((16 + nameLength * 2))}"
+        fileSize="$((0x${table::16}))"
+        table="${table:16}"
+        if [ "$fileSize" = '-1' ]; then
+            mkdir -p "$fileName"
+            continue
+        fi
+        if [[ $fileName == */* ]]; then
+            mkdir -p "${fileName%/*}"
+        fi
+        echo "${body::$((fileSize * 2))}" | hex2bin >"$fileName"
+        body="${body:$((fileSize * 2))}"
+    done
+    if [ "$table" != '' ]; then
+        showStatus info 'Incorrect frame table'
+        exit 1
+    fi
+done
+
+if [ "$body" != '' ]; then
+    showStatus info 'Incorrect response body'
+    exit 1
+fi
+
+cd ..
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
@@ -0,0 +1,66 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_SEND_FILES_PACKED"
+
+files=(
+    'file 1.txt'
+    'empty/'
+    'sub/file 2.txt'
+    'sub/file 3.txt'
+    'sub 1/empty 1/'
+    'sub 1/subsub/file 4.txt'
+)
+
+mkdir -p original && cd original
+
+for f in "${files[@]}"; do
+    if [[ $f == */* ]]; then
+        mkdir -p "${f%/*}"
+    fi
+    if [[ $f != */ ]]; then
+        echo "$f"$'\n''abc' >"$f"
+    fi
+done
+
+# Print a frame of the files given as arguments, with the table of names and sizes followed by the contents.
+pack_frame() {
+    local table=''
+    local contents=''
+    for fname in "$@"; do
+        printf -v _ '%s%n' "$fname" utf8nameLen
+        if [ -d "$fname" ]; then
+            fileSize=-1
+        else
+            fileSize="$(stat -c '%s' "$fname")"
+            contents+=$(cat "$fname" | bin2hex | tr -d '\n')
+        fi
+        table+="$(printf '%016x' "$utf8nameLen")$(echo -n "$fname" | bin2hex)$(printf '%016x' "$fileSize")"
+    done
+    echo -n "$(printf '%016x' "$#")$(printf '%016x' "$((${#table} / 2))")${table}${contents}"
+}
+
+# files are split into two frames, and a frame of 0 files ends the files
+frames="$(pack_frame "${files[@]::3}")$(pack_frame "${files[@]:3}")$(printf '%016x' 0)"
+
+cd ..
+mkdir -p copies
+update_config working_dir copies
+
+responseDump=$(echo -n "${proto}${method}${frames}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILE_RESUME"
+
+fileName='resumed file.txt'
+nameDump="$(echo -n "$fileName" | bin2hex | tr -d '\n')"
+
+mkdir -p original
+echo 'content of the file to resume' >"original/${fileName}"
+copy_files "original/${fileName}"
+
+fileSize="$(stat -c '%s' "original/${fileName}")"
+# XXH64 hashes, with the seed 0, of no bytes, of the first 8 bytes, and of the whole file
+emptyHash='ef46db3751d8e999'
+prefixHash='bac5cd73bc4c21a7'
+fullHash='5da5fb4f49b410f8'
+
+# Request the file named $1 with the size $2, from the offset $3 with the hash $4, and print the response dump.
+get_file_resume() {
+    local nameLength="$(printf '%016x' "$((${#1} / 2))")"
+    echo -n "${proto}${method}${nameLength}$1$(printf '%016x' "$2")$(printf '%016x' "$3")$4" | hex2bin | client_tool
+}
+
+check_response() {
+    local expected="${PROTO_SUPPORTED}${METHOD_OK}$2"
+    if [ "$1" != "$expected" ]; then
+        showStatus info "$3"
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$1"
+        exit 1
+    fi
+}
+
+contentDump="$(cat "original/${fileName}" | bin2hex | tr -d '\n')"
+check_response "$(get_file_resume "$nameDump" "$fileSize" 0 "$emptyHash")" "${METHOD_OK}${contentDump}" \
+    'Incorrect response from offset 0.'
+
+# the client has the first 8 bytes, "content ", and gets the rest of the file
+restDump="$(tail -c +9 "original/${fileName}" | bin2hex | tr -d '\n')"
+check_response "$(get_file_resume "$nameDump" "$fileSize" 8 "$prefixHash")" "${METHOD_OK}${restDump}" \
+    'Incorrect response from offset 8.'
+
+# the client has the whole file, and gets no more data
+check_response "$(get_file_resume "$nameDump" "$fileSize" "$fileSize" "$fullHash")" "$METHOD_OK" \
+    'Incorrect response from the end of the file.'
+
+check_response "$(get_file_resume "$nameDump" "$((fileSize + 1))" 0 "$emptyHash")" "$METHOD_CHANGED" \
+    'Incorrect response for a different file size.'
+
+check_response "$(get_file_resume "$nameDump" "$fileSize" 5 "$emptyHash")" "$METHOD_CHANGED" \
+    'Incorrect response for a different hash.'
+
+otherName="$(echo -n 'other file.txt' | bin2hex | tr -d '\n')"
+check_response "$(get_file_resume "$otherName" "$fileSize" 0 "$emptyHash")" "$METHOD_NO_DATA" \
+    'Incorrect response for a file that is not copied.'
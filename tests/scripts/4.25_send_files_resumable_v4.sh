@@ -0,0 +1,84 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_SEND_FILES_RESUMABLE"
+
+files=(
+    'file 1.txt'
+    'empty/'
+    'sub/file 2.txt'
+    'sub 1/subsub/file 3.txt'
+)
+
+mkdir -p original && cd original
+
+for f in "${files[@]}"; do
+    if [[ $f == */* ]]; then
+        mkdir -p "${f%/*}"
+    fi
+    if [[ $f != */ ]]; then
+        echo "$f"$'\n''abc' >"$f"
+    fi
+done
+
+manifest=''
+contents=()
+for fname in "${files[@]}"; do
+    printf -v _ '%s%n' "$fname" utf8nameLen
+    nameLength="$(printf '%016x' $utf8nameLen)"
+    if [ -d "$fname" ]; then
+        fileSize=-1
+        contents+=('')
+    else
+        fileSize="$(stat -c '%s' "$fname")"
+        contents+=("$(cat "$fname" | bin2hex | tr -d '\n')")
+    fi
+    manifest+="${nameLength}$(echo -n "$fname" | bin2hex)$(printf '%016x' "$fileSize")"
+done
+
+cd ..
+mkdir -p copies
+update_config working_dir copies
+
+uploadId='0123456789abcdef'
+header="${uploadId}$(printf '%016x' "${#files[@]}")${manifest}"
+
+# the transfer is interrupted in the middle of the last file
+lastFile="${contents[3]}"
+body="${contents[0]}${contents[2]}${lastFile::8}"
+responseDump=$(echo -n "${proto}${method}${header}${body}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}0000000000000000ffffffffffffffff00000000000000000000000000000000"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+# the server has all the files except the last one, which is sent again
+fileSizes=''
+for i in 0 1 2; do
+    if [ -z "${contents[$i]}" ]; then
+        fileSizes+='ffffffffffffffff'
+    else
+        fileSizes+="$(printf '%016x' "$((${#contents[$i]} / 2))")"
+    fi
+done
+responseDump=$(echo -n "${proto}${method}${header}${lastFile}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}${fileSizes}0000000000000000"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response for the resumed transfer.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
@@ -0,0 +1,108 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILES_DELTA"
+
+fileName='delta file.txt'
+nameDump="$(echo -n "$fileName" | bin2hex | tr -d '\n')"
+nameLength="$(printf '%016x' "$((${#nameDump} / 2))")"
+
+mkdir -p original
+echo 'content of the file sent as a delta' >"original/${fileName}"
+copy_files "original/${fileName}"
+
+contentDump="$(cat "original/${fileName}" | bin2hex | tr -d '\n')"
+contentLength="$(printf '%016x' "$((${#contentDump} / 2))")"
+
+# Apply the delta, given as a hex dump, to the base file given as a hex dump, and print the result as hex.
+# Prints nothing if the delta is not valid or has data after its end.
+apply_delta() {
+    python3 -c '
+import sys
+base = bytes.fromhex(sys.argv[1])
+delta = bytes.fromhex(sys.argv[2])
+out = b""
+pos = 0
+while pos + 8 <= len(delta):
+    n = int.from_bytes(delta[pos:pos + 8], "big", signed=True)
+    pos += 8
+    if n == 0:
+        if pos == len(delta):
+            print(out.hex())
+        sys.exit(0)
+    if n > 0:
+        out += delta[pos:pos + n]
+        pos += n
+    else:
+        offset = int.from_bytes(delta[pos:pos + 8], "big", signed=True)
+        pos += 8
+        if offset < 0 or offset - n > len(base):
+            sys.exit(0)
+        out += base[offset:offset - n]
+' "$1" "$2"
+}
+
+check_response() {
+    local expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}$(printf '%016x' 1)${nameLength}${nameDump}$2"
+    if [ "$1" != "$expected" ]; then
+        showStatus info "$3"
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$1"
+        exit 1
+    fi
+}
+
+# without the checksums of a file, the file is sent as it is
+responseDump=$(echo -n "${proto}${method}$(printf '%016x' 0)" | hex2bin | client_tool)
+check_response "$responseDump" "${contentLength}${contentDump}" 'Incorrect response without checksums.'
+
+# a file with no matching blocks is sent as a single insert, followed by 0 to mark the end of the delta
+signature="${nameLength}${nameDump}$(printf '%016x' 512)$(printf '%016x' 0)"
+responseDump=$(echo -n "${proto}${method}$(printf '%016x' 1)${signature}" | hex2bin | client_tool)
+check_response "$responseDump" "${contentLength}${contentLength}${contentDump}$(printf '%016x' 0)" \
+    'Incorrect response with checksums.'
+
+# the client has a file of two blocks, one of zeros and one of the letter a, which the copied file has between literal
+# bytes. Both blocks are sent as a single copy from the offset 0, between the inserts of the literal bytes
+fileName='blocks.bin'
+nameDump="$(echo -n "$fileName" | bin2hex | tr -d '\n')"
+nameLength="$(printf '%016x' "$((${#nameDump} / 2))")"
+
+letters="$(printf 'a%.0s' $(seq 512))"
+{
+    echo 'head'
+    head -c 512 /dev/zero
+    echo -n "$letters"
+    echo 'tail'
+} >"original/${fileName}"
+copy_files "original/${fileName}"
+
+baseDump="$({
+    head -c 512 /dev/zero
+    echo -n "$letters"
+} | bin2hex | tr -d '\n')"
+contentDump="$(cat "original/${fileName}" | bin2hex | tr -d '\n')"
+contentLength="$(printf '%016x' "$((${#contentDump} / 2))")"
+
+# the weak checksum and the XXH64 hash, with the seed 0, of each block
+zerosBlock="$(printf '%016x' 0)8bbf7f68e8c3b87c"
+lettersBlock='000000006100c2007c6428d1b821e1c7'
+signature="${nameLength}${nameDump}$(printf '%016x' 512)$(printf '%016x' 2)${zerosBlock}${lettersBlock}"
+responseDump=$(echo -n "${proto}${method}$(printf '%016x' 1)${signature}" | hex2bin | client_tool)
+
+headDump="$(echo 'head' | bin2hex | tr -d '\n')"
+tailDump="$(echo 'tail' | bin2hex | tr -d '\n')"
+delta="$(printf '%016x' 5)${headDump}$(printf '%016x' -1024)$(printf '%016x' 0)$(printf '%016x' 5)${tailDump}"
+delta+="$(printf '%016x' 0)"
+check_response "$responseDump" "${contentLength}${delta}" 'Incorrect response with matching blocks.'
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}$(printf '%016x' 1)${nameLength}${nameDump}${contentLength}"
+mkdir -p copies
+apply_delta "$baseDump" "${responseDump:${#expectedHead}}" | hex2bin >"copies/${fileName}"
+diffOutput=$(diff -q "original/${fileName}" "copies/${fileName}" 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Incorrect file from the delta.'
+    exit 1
+fi
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_SEND_FILES_DEDUP"
+
+# XXH64 hash of 1 MiB of zeros, with the seed 0
+zerosHash='87d2a1b6e1163ef1'
+
+mkdir -p original
+head -c 1048576 /dev/zero >original/zeros.bin
+content="$(cat original/zeros.bin | bin2hex | tr -d '\n')"
+
+mkdir -p copies
+update_config working_dir copies
+update_config dedup_store_size 16M
+
+header="$(printf '%016x' 1)$(printf '%016x' 9)$(echo -n 'zeros.bin' | bin2hex)$(printf '%016x' 1048576)${zerosHash}"
+
+# the file is received on the plain socket and added to the store
+responseDump=$(echo -n "${proto}${method}${header}${content}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}0000000000000000"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response on the plain socket.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+sleep 0.1
+
+mv copies/zeros.bin copies/first.bin
+
+# the TLS socket uses the same store, so the file is not sent again
+responseDump=$(echo -n "${proto}${method}${header}" | hex2bin | client_tool -s)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}0000000000100000"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response on the TLS socket.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+sleep 0.1
+
+if [ "$(ls -A copies/.clipshare-store | wc -l)" != '1' ]; then
+    showStatus info 'The store does not have exactly one file.'
+    exit 1
+fi
+
+# the file taken from the store must not share its data with the file received first
+printf 'x' | dd of=copies/first.bin conv=notrunc 2>/dev/null
+if ! cmp -s original/zeros.bin copies/zeros.bin; then
+    showStatus info 'File taken from the store changed with the file received first.'
+    exit 1
+fi
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_SEND_FILES_DEDUP"
+
+# XXH64 hash of 1 MiB of zeros, with the seed 0
+zerosHash='87d2a1b6e1163ef1'
+
+mkdir -p original/sub
+head -c 1048576 /dev/zero >original/zeros.bin
+echo 'abc' >'original/sub/file 1.txt'
+
+cd original
+manifest=''
+contents=()
+for fname in 'zeros.bin' 'sub/file 1.txt'; do
+    printf -v _ '%s%n' "$fname" utf8nameLen
+    nameLength="$(printf '%016x' $utf8nameLen)"
+    fileSize="$(stat -c '%s' "$fname")"
+    contents+=("$(cat "$fname" | bin2hex | tr -d '\n')")
+    hash='0000000000000000'
+    if [ "$fname" = 'zeros.bin' ]; then
+        hash="$zerosHash"
+    fi
+    manifest+="${nameLength}$(echo -n "$fname" | bin2hex)$(printf '%016x' "$fileSize")${hash}"
+done
+cd ..
+
+mkdir -p copies
+update_config working_dir copies
+update_config dedup_store_size 16M
+
+header="$(printf '%016x' 2)${manifest}"
+
+# the server does not have any of the files yet
+responseDump=$(echo -n "${proto}${method}${header}${contents[0]}${contents[1]}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}00000000000000000000000000000000"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+sleep 0.1
+
+diffOutput=$(diff -rq -x .clipshare-store original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
+
+# the large file is taken from the store, and only the small file is sent again
+rm -rf copies/zeros.bin copies/sub
+responseDump=$(echo -n "${proto}${method}${header}${contents[1]}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}00000000001000000000000000000000"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response for the files in the store.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+diffOutput=$(diff -rq -x .clipshare-store original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files taken from the store do not match.'
+    exit 1
+fi
@@ -0,0 +1,67 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILES_VERIFIED"
+
+# XXH64 hashes, with the seed 0, of the contents of the files
+declare -A hashes=(
+    ['zeros.bin']='87d2a1b6e1163ef1'
+    ['empty.txt']='ef46db3751d8e999'
+)
+
+mkdir -p original/empty && cd original
+head -c 1048576 /dev/zero >'zeros.bin'
+touch 'empty.txt'
+cd ..
+
+copy_files original/*
+
+responseDump=$(echo -n "${proto}${method}" | hex2bin | client_tool)
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}$(printf '%016x' 3)"
+if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect response header'
+    echo 'Expected:' "$expectedHead"
+    echo 'Received:' "${responseDump::${#expectedHead}}"
+    exit 1
+fi
+
+mkdir -p copies && cd copies
+
+body="${responseDump:${#expectedHead}}"
+for _ in $(seq 3); do
+    nameLength="$((0x${body::16}))"
+    fileName="$(echo "${body:16:$((nameLength * 2))}" | hex2bin)"
+    body="${body:$((16 + nameLength * 2))}"
+    fileSize="$((0x${body::16}))"
+    if [ "$fileSize" = '-1' ]; then
+        mkdir -p "$fileName"
+        body="${body:16}"
+        continue
+    fi
+    echo "${body:16:$((fileSize * 2))}" | hex2bin >"$fileName"
+    body="${body:$((16 + fileSize * 2))}"
+    # the contents of each regular file are followed by their hash
+    if [ "${body::16}" != "${hashes[$fileName]}" ]; then
+        showStatus info "Incorrect hash for ${fileName}."
+        echo 'Expected:' "${hashes[$fileName]}"
+        echo 'Received:' "${body::16}"
+        exit 1
+    fi
+    body="${body:16}"
+done
+
+if [ "$body" != '' ]; then
+    showStatus info 'Incorrect response body'
+    exit 1
+fi
+
+cd ..
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
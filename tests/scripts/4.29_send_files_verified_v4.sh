@@ -0,0 +1,62 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_SEND_FILES_VERIFIED"
+
+files=(
+    'zeros.bin'
+    'empty/'
+    'sub/corrupted.txt'
+    'sub/empty.txt'
+)
+
+# XXH64 hashes, with the seed 0, of the contents of the files. The hash of corrupted.txt does not match it
+declare -A hashes=(
+    ['zeros.bin']='87d2a1b6e1163ef1'
+    ['sub/corrupted.txt']='0123456789abcdef'
+    ['sub/empty.txt']='ef46db3751d8e999'
+)
+
+mkdir -p original/empty original/sub && cd original
+head -c 1048576 /dev/zero >'zeros.bin'
+echo 'abc' >'sub/corrupted.txt'
+touch 'sub/empty.txt'
+
+chunks=''
+for fname in "${files[@]}"; do
+    printf -v _ '%s%n' "$fname" utf8nameLen
+    nameLength="$(printf '%016x' $utf8nameLen)"
+    if [ -d "$fname" ]; then
+        chunks+="${nameLength}$(echo -n "$fname" | bin2hex)ffffffffffffffff"
+        continue
+    fi
+    fileSize="$(stat -c '%s' "$fname")"
+    content=$(cat "$fname" | bin2hex | tr -d '\n')
+    chunks+="${nameLength}$(echo -n "$fname" | bin2hex)$(printf '%016x' "$fileSize")${content}${hashes[$fname]}"
+done
+
+cd ..
+mkdir -p copies
+update_config working_dir copies
+
+fileCount=$(printf '%016x' "${#files[@]}")
+responseDump=$(echo -n "${proto}${method}${fileCount}${chunks}" | hex2bin | client_tool)
+
+# the index of the corrupted file follows the number of corrupted files
+expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_CORRUPTED}$(printf '%016x%016x' 1 2)"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+# the corrupted file is removed
+rm original/sub/corrupted.txt
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
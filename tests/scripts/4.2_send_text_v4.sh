@@ -0,0 +1,5 @@
+#!/bin/bash
+
+proto="$PROTO_V4"
+
+. scripts/common/x.2_send_text.sh
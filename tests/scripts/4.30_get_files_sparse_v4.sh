@@ -0,0 +1,74 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_FILES_SPARSE"
+
+mkdir -p original/empty && cd original
+# a file of only a hole, on file systems that support sparse files
+dd if=/dev/null of='sparse.bin' bs=1 seek=1048576 2>/dev/null
+echo 'abc' >'text.txt'
+cd ..
+
+copy_files original/*
+
+responseDump=$(echo -n "${proto}${method}" | hex2bin | client_tool)
+
+expectedHead="${PROTO_SUPPORTED}${METHOD_OK}$(printf '%016x' 3)"
+if [ "${responseDump::${#expectedHead}}" != "$expectedHead" ]; then
+    showStatus info 'Incorrect response header'
+    echo 'Expected:' "$expectedHead"
+    echo 'Received:' "${responseDump::${#expectedHead}}"
+    exit 1
+fi
+
+mkdir -p copies && cd copies
+
+body="${responseDump:${#expectedHead}}"
+for _ in $(seq 3); do
+    nameLength="$((0x${body::16}))"
+    fileName="$(echo "${body:16:$((nameLength * 2))}" | hex2bin)"
+    body="${body:$((16 + nameLength * 2))}"
+    fileSize="$((0x${body::16}))"
+    body="${body:16}"
+    if [ "$fileSize" = '-1' ]; then
+        mkdir -p "$fileName"
+        continue
+    fi
+    touch "$fileName"
+    # the contents are extents of data, with a positive length, and holes, with a negative length
+    remaining="$fileSize"
+    while [ "$remaining" -gt 0 ]; do
+        extentLength="$((0x${body::16}))"
+        body="${body:16}"
+        if [ "$extentLength" -gt 0 ]; then
+            echo "${body::$((extentLength * 2))}" | hex2bin >>"$fileName"
+            body="${body:$((extentLength * 2))}"
+            remaining="$((remaining - extentLength))"
+        elif [ "$extentLength" -lt 0 ]; then
+            head -c "$((-extentLength))" /dev/zero >>"$fileName"
+            remaining="$((remaining + extentLength))"
+        else
+            showStatus info "Empty extent in ${fileName}."
+            exit 1
+        fi
+    done
+    if [ "$remaining" != '0' ]; then
+        showStatus info "Extents of ${fileName} exceed its size."
+        exit 1
+    fi
+done
+
+if [ "$body" != '' ]; then
+    showStatus info 'Incorrect response body'
+    exit 1
+fi
+
+cd ..
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
@@ -0,0 +1,52 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_SEND_FILES_SPARSE"
+
+mkdir -p original/empty original/sub && cd original
+# a hole followed by data
+dd if=/dev/null of='sparse.bin' bs=1 seek=1048576 2>/dev/null
+echo -n 'abc' >>'sparse.bin'
+# data followed by a hole, which extends the file
+echo -n 'abc' >'sub/tail.bin'
+dd if=/dev/null of='sub/tail.bin' bs=1 seek=1048579 2>/dev/null
+touch 'sub/empty.txt'
+cd ..
+
+hole="$(printf '%016x' -1048576)"
+data="$(printf '%016x' 3)$(echo -n 'abc' | bin2hex)"
+
+chunk() {
+    local fname="$1"
+    local size="$2"
+    local extents="$3"
+    printf -v _ '%s%n' "$fname" utf8nameLen
+    echo -n "$(printf '%016x' $utf8nameLen)$(echo -n "$fname" | bin2hex)${size}${extents}"
+}
+
+chunks="$(chunk 'sparse.bin' "$(printf '%016x' 1048579)" "${hole}${data}")"
+chunks+="$(chunk 'empty/' 'ffffffffffffffff' '')"
+chunks+="$(chunk 'sub/tail.bin' "$(printf '%016x' 1048579)" "${data}${hole}")"
+chunks+="$(chunk 'sub/empty.txt' "$(printf '%016x' 0)" '')"
+
+mkdir -p copies
+update_config working_dir copies
+
+fileCount=$(printf '%016x' 4)
+responseDump=$(echo -n "${proto}${method}${fileCount}${chunks}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_OK}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+diffOutput=$(diff -rq original copies 2>&1 || echo failed)
+if [ ! -z "$diffOutput" ]; then
+    showStatus info 'Files do not match.'
+    exit 1
+fi
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+proto="$PROTO_V4"
+chunked=1
+
+. scripts/common/x.5.1_get_image.sh
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+proto="$PROTO_V4"
+chunked=1
+
+. scripts/common/x.5.2_get_screenshot.sh
@@ -0,0 +1,7 @@
+#!/bin/bash
+
+proto="$PROTO_V4"
+chunked=1
+method="$METHOD_GET_COPIED_IMAGE"
+
+. scripts/common/get_image.sh
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_GET_SCREENSHOT_DELTA"
+disp="$(printf '%016x' 1)"
+
+copy_image "$imgSample"
+
+if [ "$DETECTED_OS" != 'Linux' ]; then
+    # screenshot delta is available only on Linux
+    responseDump=$(echo -n "${proto}${method}${disp}$(printf '%016x' 0)" | hex2bin | client_tool)
+    expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+    if [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$responseDump"
+        exit 1
+    fi
+    exit 0
+fi
+
+expected_head="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}"
+expected_png_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+
+# Request the screenshot delta against the base frame $1 and check the response header.
+# Sets frame_id, base_id, tile_cnt and tiles_dump from the response.
+get_delta() {
+    local base="$(printf '%016x' "$1")"
+    local responseDump=$(echo -n "${proto}${method}${disp}${base}" | hex2bin | client_tool)
+    if [ "${responseDump::${#expected_head}}" != "$expected_head" ]; then
+        showStatus info 'Incorrect protocol:method:display ack.'
+        echo 'Expected:' "$expected_head"
+        echo 'Received:' "${responseDump::${#expected_head}}"
+        exit 1
+    fi
+    responseDump="${responseDump:${#expected_head}}"
+    frame_id="$((16#${responseDump::16}))"
+    base_id="$((16#${responseDump:16:16}))"
+    local width="$((16#${responseDump:32:16}))"
+    local height="$((16#${responseDump:48:16}))"
+    local tile_size="$((16#${responseDump:64:16}))"
+    tile_cnt="$((16#${responseDump:80:16}))"
+    tiles_dump="${responseDump:96}"
+    if [ "$frame_id" -le 0 ] || [ "$width" -le 0 ] || [ "$height" -le 0 ] || [ "$tile_size" -le 0 ]; then
+        showStatus info 'Invalid frame header.'
+        echo "frame=${frame_id} width=${width} height=${height} tile_size=${tile_size}"
+        exit 1
+    fi
+    max_tiles="$((((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size)))"
+    if [ "$tile_cnt" -gt "$max_tiles" ]; then
+        showStatus info 'Too many tiles.'
+        exit 1
+    fi
+}
+
+get_delta 0
+if [ "$base_id" != '0' ] || [ "$tile_cnt" != "$max_tiles" ]; then
+    showStatus info 'Full frame expected without a base frame.'
+    echo "base=${base_id} tiles=${tile_cnt} expected=${max_tiles}"
+    exit 1
+fi
+first_len="$((16#${tiles_dump:32:16}))"
+if [ "${tiles_dump:0:32}" != "$(printf '%032x' 0)" ] || [ "$first_len" -le 8 ] ||
+    [ "${tiles_dump:48:${#expected_png_header}}" != "$expected_png_header" ]; then
+    showStatus info 'Invalid first tile.'
+    exit 1
+fi
+
+full_frame="$frame_id"
+get_delta "$full_frame"
+if [ "$base_id" != "$full_frame" ] || [ "$frame_id" -le "$full_frame" ]; then
+    showStatus info 'Delta frame does not refer to the base frame.'
+    echo "base=${base_id} expected=${full_frame} frame=${frame_id}"
+    exit 1
+fi
@@ -0,0 +1,64 @@
+#!/bin/bash
+
+. init.sh
+
+proto="$PROTO_V4"
+method="$METHOD_STREAM_SCREEN"
+disp="$(printf '%016x' 1)"
+fps="$(printf '%016x' 10)"
+
+copy_image "$imgSample"
+
+# keep the connection open for a while and then send a byte to stop the stream
+responseDump=$( (
+    echo -n "${proto}${method}${disp}${fps}" | hex2bin
+    sleep 1
+    printf '\x00'
+) | client_tool)
+
+protoAck="$PROTO_SUPPORTED"
+methodAck="$METHOD_OK"
+
+if [ "$DETECTED_OS" != 'Linux' ]; then
+    # screen streaming is available only on Linux
+    expected="${protoAck}${methodAck}${METHOD_NO_DATA}"
+    if [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$responseDump"
+        exit 1
+    fi
+    exit 0
+fi
+
+expected_head="${protoAck}${methodAck}${METHOD_OK}"
+if [ "${responseDump::${#expected_head}}" != "$expected_head" ]; then
+    showStatus info 'Incorrect protocol:method:display ack.'
+    echo 'Expected:' "$expected_head"
+    echo 'Received:' "${responseDump::${#expected_head}}"
+    exit 1
+fi
+responseDump="${responseDump:${#expected_head}}"
+
+expected_png_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+frame_cnt=0
+while [ -n "$responseDump" ]; do
+    length="$((16#${responseDump::16}))"
+    responseDump="${responseDump:16}"
+    if [ "$length" -le '512' ] || [ "$((length * 2))" -gt "${#responseDump}" ]; then
+        showStatus info 'Invalid frame length.'
+        exit 1
+    fi
+    if [ "${responseDump::${#expected_png_header}}" != "$expected_png_header" ]; then
+        showStatus info 'Invalid frame header.'
+        exit 1
+    fi
+    responseDump="${responseDump:$((length * 2))}"
+    frame_cnt="$((frame_cnt + 1))"
+done
+
+if [ "$frame_cnt" -lt 2 ]; then
+    showStatus info 'Too few frames received.'
+    echo "Received ${frame_cnt} frames"
+    exit 1
+fi
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+proto="$PROTO_V4"
+method="$(printf '\x7f' | bin2hex)"
+
+. scripts/common/x.x_invalid_method.sh
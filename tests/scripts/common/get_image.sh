@@ -5,6 +5,9 @@
 copy_image "$imgSample"
 
 responseDump=$(echo -n "${proto}${method}" | hex2bin | client_tool)
+if [ -n "$chunked" ]; then
+    responseDump="${responseDump::4}$(unchunk_image "${responseDump:4}")"
+fi
 
 protoAck="$PROTO_SUPPORTED"
 methodAck="$METHOD_OK"
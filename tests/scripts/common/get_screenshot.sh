@@ -32,6 +32,10 @@ if [ ! -z "$disp" ]; then
     responseDump="${responseDump:2}"
 fi
 
+if [ -n "$chunked" ]; then
+    responseDump="$(unchunk_image "$responseDump")"
+fi
+
 length="$((16#${responseDump::16}))"
 responseDump="${responseDump:16}"
 
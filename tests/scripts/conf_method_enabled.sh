@@ -17,11 +17,40 @@ check_method() {
 
 GET_TEXT_STATUS="$METHOD_NO_DATA"
 GET_FILES_STATUS="$METHOD_NO_DATA"
+GET_TEXT_COMPRESSED_STATUS="$METHOD_OK"
+GET_FILES_COMPRESSED_STATUS="$METHOD_OK"
+GET_TEXT_IF_CHANGED_STATUS="$METHOD_OK"
+GET_FILES_IF_CHANGED_STATUS="$METHOD_OK"
+GET_FILES_STREAMED_STATUS="$METHOD_NO_DATA"
+GET_FILES_PACKED_STATUS="$METHOD_NO_DATA"
+GET_FILE_RESUME_STATUS="$METHOD_OK"
+GET_FILES_DELTA_STATUS="$METHOD_OK"
+GET_FILES_VERIFIED_STATUS="$METHOD_NO_DATA"
+GET_FILES_SPARSE_STATUS="$METHOD_NO_DATA"
+GET_TEXT_DELTA_STATUS="$METHOD_OK"
 GET_IMAGE_STATUS="$METHOD_OK"
 GET_COPIED_IMAGE_STATUS="$METHOD_NO_DATA"
+GET_COPIED_IMAGE_NATIVE_STATUS="$METHOD_OK"
+GET_COPIED_IMAGE_IF_CHANGED_STATUS="$METHOD_OK"
 GET_SCREENSHOT_STATUS="$METHOD_OK"
+GET_SCREENSHOT_DELTA_STATUS="$METHOD_OK"
+STREAM_SCREEN_STATUS="$METHOD_OK"
+GET_SCREENSHOT_REGION_STATUS="$METHOD_OK"
+GET_SCREENSHOT_IF_CHANGED_STATUS="$METHOD_OK"
+if [ "$DETECTED_OS" = 'Linux' ]; then
+    LIST_DISPLAYS_STATUS="$METHOD_OK"
+else
+    # listing displays is available only on Linux
+    LIST_DISPLAYS_STATUS="$METHOD_NO_DATA"
+fi
 SEND_TEXT_STATUS="$METHOD_OK"
 SEND_FILES_STATUS="$METHOD_OK"
+SEND_FILES_MANIFEST_STATUS="$METHOD_OK"
+SEND_FILES_PACKED_STATUS="$METHOD_OK"
+SEND_FILES_RESUMABLE_STATUS="$METHOD_OK"
+SEND_FILES_DEDUP_STATUS="$METHOD_OK"
+SEND_FILES_VERIFIED_STATUS="$METHOD_OK"
+SEND_FILES_SPARSE_STATUS="$METHOD_OK"
 INFO_STATUS="$METHOD_OK"
 
 TEXT="0000000000000000"
@@ -32,9 +61,33 @@ check_all_methods() {
     check_method "$METHOD_GET_FILES" "$GET_FILES_STATUS"
     check_method "$METHOD_GET_IMAGE" "$GET_IMAGE_STATUS"
     check_method "$METHOD_GET_COPIED_IMAGE" "$GET_COPIED_IMAGE_STATUS"
+    check_method "$METHOD_GET_COPIED_IMAGE_NATIVE" "$GET_COPIED_IMAGE_NATIVE_STATUS"
     check_method "$METHOD_GET_SCREENSHOT" "$GET_SCREENSHOT_STATUS"
+    check_method "$METHOD_GET_SCREENSHOT_DELTA" "$GET_SCREENSHOT_DELTA_STATUS"
+    check_method "$METHOD_STREAM_SCREEN" "$STREAM_SCREEN_STATUS"
+    check_method "$METHOD_GET_SCREENSHOT_REGION" "$GET_SCREENSHOT_REGION_STATUS"
+    check_method "$METHOD_LIST_DISPLAYS" "$LIST_DISPLAYS_STATUS"
+    check_method "$METHOD_GET_TEXT_COMPRESSED" "$GET_TEXT_COMPRESSED_STATUS"
+    check_method "$METHOD_GET_FILES_COMPRESSED" "$GET_FILES_COMPRESSED_STATUS"
+    check_method "$METHOD_GET_TEXT_IF_CHANGED" "$GET_TEXT_IF_CHANGED_STATUS"
+    check_method "$METHOD_GET_FILES_IF_CHANGED" "$GET_FILES_IF_CHANGED_STATUS"
+    check_method "$METHOD_GET_COPIED_IMAGE_IF_CHANGED" "$GET_COPIED_IMAGE_IF_CHANGED_STATUS"
+    check_method "$METHOD_GET_SCREENSHOT_IF_CHANGED" "$GET_SCREENSHOT_IF_CHANGED_STATUS"
+    check_method "$METHOD_GET_TEXT_DELTA" "$GET_TEXT_DELTA_STATUS"
+    check_method "$METHOD_GET_FILES_STREAMED" "$GET_FILES_STREAMED_STATUS"
+    check_method "$METHOD_GET_FILES_PACKED" "$GET_FILES_PACKED_STATUS"
+    check_method "$METHOD_GET_FILE_RESUME" "$GET_FILE_RESUME_STATUS"
+    check_method "$METHOD_GET_FILES_DELTA" "$GET_FILES_DELTA_STATUS"
+    check_method "$METHOD_GET_FILES_VERIFIED" "$GET_FILES_VERIFIED_STATUS"
+    check_method "$METHOD_GET_FILES_SPARSE" "$GET_FILES_SPARSE_STATUS"
     check_method "${METHOD_SEND_TEXT}${TEXT}" "$SEND_TEXT_STATUS"
     check_method "${METHOD_SEND_FILES}${FILE_CNT}" "$SEND_FILES_STATUS"
+    check_method "${METHOD_SEND_FILES_MANIFEST}${FILE_CNT}" "$SEND_FILES_MANIFEST_STATUS"
+    check_method "${METHOD_SEND_FILES_PACKED}${FILE_CNT}" "$SEND_FILES_PACKED_STATUS"
+    check_method "${METHOD_SEND_FILES_RESUMABLE}${FILE_CNT}" "$SEND_FILES_RESUMABLE_STATUS"
+    check_method "${METHOD_SEND_FILES_DEDUP}${FILE_CNT}" "$SEND_FILES_DEDUP_STATUS"
+    check_method "${METHOD_SEND_FILES_VERIFIED}${FILE_CNT}" "$SEND_FILES_VERIFIED_STATUS"
+    check_method "${METHOD_SEND_FILES_SPARSE}${FILE_CNT}" "$SEND_FILES_SPARSE_STATUS"
     check_method "$METHOD_INFO" "$INFO_STATUS"
 }
 
@@ -50,6 +103,11 @@ check_all_methods
 update_config method_get_screenshot_enabled false
 
 GET_SCREENSHOT_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_SCREENSHOT_DELTA_STATUS="$METHOD_NOT_IMPLEMENTED"
+STREAM_SCREEN_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_SCREENSHOT_REGION_STATUS="$METHOD_NOT_IMPLEMENTED"
+LIST_DISPLAYS_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_SCREENSHOT_IF_CHANGED_STATUS="$METHOD_NOT_IMPLEMENTED"
 check_all_methods
 
 update_config method_info_enabled false
@@ -61,17 +119,30 @@ update_config method_get_text_enabled false
 clear_clipboard
 
 GET_TEXT_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_TEXT_COMPRESSED_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_TEXT_IF_CHANGED_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_TEXT_DELTA_STATUS="$METHOD_NOT_IMPLEMENTED"
 check_all_methods
 
 update_config method_get_files_enabled false
 clear_clipboard
 
 GET_FILES_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILES_COMPRESSED_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILES_IF_CHANGED_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILES_STREAMED_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILES_PACKED_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILE_RESUME_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILES_DELTA_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILES_VERIFIED_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_FILES_SPARSE_STATUS="$METHOD_NOT_IMPLEMENTED"
 check_all_methods
 
 update_config method_get_copied_image_enabled false
 
 GET_COPIED_IMAGE_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_COPIED_IMAGE_NATIVE_STATUS="$METHOD_NOT_IMPLEMENTED"
+GET_COPIED_IMAGE_IF_CHANGED_STATUS="$METHOD_NOT_IMPLEMENTED"
 check_all_methods
 
 update_config method_send_text_enabled false
@@ -84,4 +155,10 @@ update_config method_send_files_enabled false
 
 FILE_CNT=''
 SEND_FILES_STATUS="$METHOD_NOT_IMPLEMENTED"
+SEND_FILES_MANIFEST_STATUS="$METHOD_NOT_IMPLEMENTED"
+SEND_FILES_PACKED_STATUS="$METHOD_NOT_IMPLEMENTED"
+SEND_FILES_RESUMABLE_STATUS="$METHOD_NOT_IMPLEMENTED"
+SEND_FILES_DEDUP_STATUS="$METHOD_NOT_IMPLEMENTED"
+SEND_FILES_VERIFIED_STATUS="$METHOD_NOT_IMPLEMENTED"
+SEND_FILES_SPARSE_STATUS="$METHOD_NOT_IMPLEMENTED"
 check_all_methods
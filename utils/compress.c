@@ -0,0 +1,223 @@
+/*
+ * utils/compress.c - platform independent compression of data streams
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/compress.h>
+
+#define ZLIB_CONST
+#include <zlib.h>
+
+// compression levels used for data that compresses well, and for data that compresses only a little
+#define LEVEL_HIGH 6
+#define LEVEL_LOW 1
+// number of input bytes after which the compression level is adjusted
+#define ADAPT_WINDOW 262144U
+// number of bytes at the start of a window compressed as a sample to check if storing data should stop
+#define PROBE_SIZE 4096
+
+struct _compressor {
+    int compression;
+    chunk_writer writer;
+    void *arg;
+    z_stream strm;
+    int level;
+    uLong window_in;  // total_in at the start of the current window
+    uLong window_out;
+    unsigned char out[COMPRESS_CHUNK_SIZE];
+};
+
+typedef struct _signature {
+    size_t offset;
+    size_t len;
+    const char *bytes;
+} signature;
+
+// signatures of formats that are already compressed
+static const signature compressed_formats[] = {
+    {0, 8, "\x89PNG\r\n\x1a\n"},   // PNG
+    {0, 3, "\xff\xd8\xff"},         // JPEG
+    {0, 4, "GIF8"},                 // GIF
+    {8, 4, "WEBP"},                 // WebP
+    {0, 4, "PK\x03\x04"},           // zip, jar, docx, odt, apk, ...
+    {0, 2, "\x1f\x8b"},             // gzip
+    {0, 3, "BZh"},                  // bzip2
+    {0, 6, "\xfd" "7zXZ\x00"},      // xz
+    {0, 4, "\x28\xb5\x2f\xfd"},     // zstd
+    {0, 4, "\x04\x22\x4d\x18"},     // lz4
+    {0, 6, "7z\xbc\xaf\x27\x1c"},   // 7z
+    {0, 6, "Rar!\x1a\x07"},         // rar
+    {4, 4, "ftyp"},                 // mp4, mov, m4a, heic, avif
+    {0, 4, "\x1a\x45\xdf\xa3"},     // mkv, webm
+    {0, 4, "OggS"},                 // ogg, opus
+    {0, 3, "ID3"},                  // mp3
+    {0, 4, "fLaC"},                 // flac
+};
+
+int choose_compression(int64_t accepted) {
+    if (accepted > 0 && (accepted & COMPRESSION_DEFLATE)) return COMPRESSION_DEFLATE;
+    return COMPRESSION_NONE;
+}
+
+int is_compressible(const char *data, size_t len) {
+    for (size_t i = 0; i < sizeof(compressed_formats) / sizeof(compressed_formats[0]); i++) {
+        const signature *sig = &(compressed_formats[i]);
+        if (len >= sig->offset + sig->len && !memcmp(data + sig->offset, sig->bytes, sig->len)) return 0;
+    }
+    // MPEG audio frame sync, including mp3 without ID3 tags and AAC
+    if (len >= 2 && (unsigned char)data[0] == 0xFF && ((unsigned char)data[1] & 0xF0) == 0xF0) return 0;
+    return 1;
+}
+
+compressor *compressor_new(int compression, chunk_writer writer, void *arg) {
+    if (compression != COMPRESSION_NONE && compression != COMPRESSION_DEFLATE) return NULL;
+    compressor *comp = malloc(sizeof(compressor));
+    if (!comp) return NULL;
+    comp->compression = compression;
+    comp->writer = writer;
+    comp->arg = arg;
+    comp->level = LEVEL_HIGH;
+    comp->window_in = 0;
+    comp->window_out = 0;
+    if (compression == COMPRESSION_NONE) return comp;
+
+    memset(&(comp->strm), 0, sizeof(comp->strm));
+    if (deflateInit(&(comp->strm), comp->level) != Z_OK) {
+        free(comp);
+        return NULL;
+    }
+    comp->strm.next_out = comp->out;
+    comp->strm.avail_out = COMPRESS_CHUNK_SIZE;
+    return comp;
+}
+
+/*
+ * Pass the compressed data in the output buffer to the writer, and empty the buffer.
+ */
+static int _emit(compressor *comp) {
+    const size_t len = COMPRESS_CHUNK_SIZE - comp->strm.avail_out;
+    comp->strm.next_out = comp->out;
+    comp->strm.avail_out = COMPRESS_CHUNK_SIZE;
+    if (len == 0) return EXIT_SUCCESS;
+    return comp->writer(comp->arg, (const char *)comp->out, len);
+}
+
+/*
+ * Compress all the input, emitting the output buffer whenever it is full.
+ */
+static int _deflate(compressor *comp, int flush) {
+    while (1) {
+        const int ret = deflate(&(comp->strm), flush);
+        if (ret == Z_STREAM_ERROR) return EXIT_FAILURE;
+        // deflate stops with space left in the output buffer only after consuming all the input
+        if (comp->strm.avail_out > 0) return EXIT_SUCCESS;
+        if (_emit(comp) != EXIT_SUCCESS) return EXIT_FAILURE;
+    }
+}
+
+static int _set_level(compressor *comp, int level) {
+    if (level == comp->level) return EXIT_SUCCESS;
+    int ret;
+    // changing the level may flush the data compressed so far, which needs space in the output buffer
+    while ((ret = deflateParams(&(comp->strm), level, Z_DEFAULT_STRATEGY)) == Z_BUF_ERROR) {
+        if (comp->strm.avail_out == COMPRESS_CHUNK_SIZE) return EXIT_FAILURE;
+        if (_emit(comp) != EXIT_SUCCESS) return EXIT_FAILURE;
+    }
+    if (ret != Z_OK) return EXIT_FAILURE;
+    comp->level = level;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Adjust the compression level based on how well the data compressed in the last window.
+ */
+static int _adapt(compressor *comp) {
+    const uLong in = comp->strm.total_in - comp->window_in;
+    const uLong out = comp->strm.total_out - comp->window_out;
+    comp->window_in = comp->strm.total_in;
+    comp->window_out = comp->strm.total_out;
+    // the ratio is not known while storing. _probe decides when to compress again
+    if (comp->level == Z_NO_COMPRESSION) return EXIT_SUCCESS;
+    int level;
+    if (out * 20 > in * 19) {
+        level = Z_NO_COMPRESSION;  // saves less than 5%
+    } else if (out * 5 > in * 3) {
+        level = LEVEL_LOW;  // saves less than 40%
+    } else {
+        level = LEVEL_HIGH;
+    }
+    return _set_level(comp, level);
+}
+
+/*
+ * While storing without compression, compress a sample of the data at the start of a window to check if the data
+ * compresses well again.
+ */
+static int _probe(compressor *comp, const char *data, size_t len) {
+    unsigned char sample[PROBE_SIZE + 64];  // larger than compressBound(PROBE_SIZE)
+    uLongf out_len = sizeof(sample);
+    const uLong in_len = len < PROBE_SIZE ? (uLong)len : PROBE_SIZE;
+    if (in_len < PROBE_SIZE / 4) return EXIT_SUCCESS;  // too small to decide
+    if (compress2(sample, &out_len, (const Bytef *)data, in_len, LEVEL_LOW) != Z_OK) return EXIT_SUCCESS;
+    if (out_len * 5 > in_len * 4) return EXIT_SUCCESS;  // saves less than 20%
+    return _set_level(comp, LEVEL_LOW);
+}
+
+int compressor_write(compressor *comp, const char *data, size_t len) {
+    if (comp->compression == COMPRESSION_NONE) {
+        while (len > 0) {
+            const size_t cnt = len < COMPRESS_CHUNK_SIZE ? len : COMPRESS_CHUNK_SIZE;
+            if (comp->writer(comp->arg, data, cnt) != EXIT_SUCCESS) return EXIT_FAILURE;
+            data += cnt;
+            len -= cnt;
+        }
+        return EXIT_SUCCESS;
+    }
+    while (len > 0) {
+        if (comp->level == Z_NO_COMPRESSION && comp->strm.total_in == comp->window_in &&
+            _probe(comp, data, len) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        // feed at most the rest of the current window, so that the level is adjusted at window boundaries
+        const uLong window_left = ADAPT_WINDOW - (comp->strm.total_in - comp->window_in);
+        const uInt cnt = (uInt)(len < window_left ? len : window_left);
+        comp->strm.next_in = (const Bytef *)data;
+        comp->strm.avail_in = cnt;
+        if (_deflate(comp, Z_NO_FLUSH) != EXIT_SUCCESS) return EXIT_FAILURE;
+        data += cnt;
+        len -= cnt;
+        if (comp->strm.total_in - comp->window_in >= ADAPT_WINDOW && _adapt(comp) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int compressor_finish(compressor *comp) {
+    if (comp->compression == COMPRESSION_NONE) return EXIT_SUCCESS;
+    comp->strm.next_in = NULL;
+    comp->strm.avail_in = 0;
+    if (_deflate(comp, Z_FINISH) != EXIT_SUCCESS) return EXIT_FAILURE;
+    return _emit(comp);
+}
+
+void compressor_free(compressor *comp) {
+    if (!comp) return;
+    if (comp->compression != COMPRESSION_NONE) deflateEnd(&(comp->strm));
+    free(comp);
+}
@@ -0,0 +1,72 @@
+/*
+ * utils/compress.h - header for compressing data streams
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_COMPRESS_H_
+#define UTILS_COMPRESS_H_
+
+#include <stddef.h>
+#include <utils/utils.h>
+
+// compression codes. A set of codes is the sum of the codes in it
+#define COMPRESSION_NONE 0
+#define COMPRESSION_DEFLATE 1
+
+// maximum size of a part of the compressed stream passed to the chunk_writer
+#define COMPRESS_CHUNK_SIZE 65536
+
+typedef struct _compressor compressor;
+
+/*
+ * Choose the compression to use from the set of compressions the client accepts.
+ * returns the compression code, or COMPRESSION_NONE if none of the accepted compressions is supported.
+ */
+extern int choose_compression(int64_t accepted);
+
+/*
+ * Check if the data, which is the beginning of a file or stream, is worth compressing. Data that starts with the
+ * signature of an already compressed format, such as PNG, JPEG, zip, or common audio and video containers, is not.
+ * returns 1 if the data is worth compressing, or 0 otherwise.
+ */
+extern int is_compressible(const char *data, size_t len);
+
+/*
+ * Start a stream compressed with the given compression code. The compressed stream is passed to the writer in parts
+ * of at most COMPRESS_CHUNK_SIZE bytes. With COMPRESSION_NONE, the data is passed to the writer as it is.
+ * The compression level is lowered while the data does not compress well, and raised again when it does.
+ * returns the compressor, or NULL on failure.
+ */
+extern compressor *compressor_new(int compression, chunk_writer writer, void *arg);
+
+/*
+ * Compress len bytes of data, passing the compressed parts that are ready to the writer.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if compressing failed or the writer failed.
+ */
+extern int compressor_write(compressor *comp, const char *data, size_t len);
+
+/*
+ * End the compressed stream, passing the rest of it to the writer.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if compressing failed or the writer failed.
+ */
+extern int compressor_finish(compressor *comp);
+
+/*
+ * Free the compressor. The stream does not need to be finished.
+ */
+extern void compressor_free(compressor *comp);
+
+#endif  // UTILS_COMPRESS_H_
@@ -292,6 +292,10 @@ static void parse_line(char *line, config *cfg) {
         set_int64(value, &(cfg->max_file_size));
     } else if (!strcmp("cut_sent_files", key)) {
         set_is_true(value, &(cfg->cut_sent_files));
+    } else if (!strcmp("resume_grace_period", key)) {
+        set_int64(value, &(cfg->resume_grace_period));
+    } else if (!strcmp("dedup_store_size", key)) {
+        set_int64(value, &(cfg->dedup_store_size));
     } else if (!strcmp("client_selects_display", key)) {
         set_is_true(value, &(cfg->client_selects_display));
     } else if (!strcmp("display", key)) {
@@ -352,6 +356,8 @@ void parse_conf(config *cfg, const char *file_name) {
     cfg->max_text_length = 0;
     cfg->max_file_size = 0;
     cfg->cut_sent_files = -1;
+    cfg->resume_grace_period = -1;
+    cfg->dedup_store_size = -1;
     cfg->client_selects_display = -1;
     cfg->display = 0;
 
@@ -51,6 +51,8 @@ typedef struct _config {
     int64_t max_file_size;
 
     int8_t cut_sent_files;
+    int64_t resume_grace_period;
+    int64_t dedup_store_size;
     int8_t client_selects_display;
     uint16_t display;
 
@@ -0,0 +1,347 @@
+/*
+ * utils/delta.c - platform independent computation of binary deltas
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/delta.h>
+#include <utils/hash.h>
+
+// multiplier of the polynomial rolling hash of a block
+#define ROLL_MULT 0x100000001B3ULL
+// multiplier to spread the rolling hash over the bits used as the index of the block table
+#define INDEX_MULT 0x9E3779B97F4A7C15ULL
+// multiplier to spread the weak checksum of a file block over the bits used as the index of the block table
+#define WEAK_INDEX_MULT 0x9E3779B1U
+
+static inline uint64_t _block_hash(const unsigned char *block) {
+    uint64_t h = 0;
+    for (unsigned i = 0; i < DELTA_BLOCK_SIZE; i++) h = h * ROLL_MULT + block[i];
+    return h;
+}
+
+static inline size_t _table_index(uint64_t h, unsigned bits) { return (size_t)((h * INDEX_MULT) >> (64 - bits)); }
+
+/*
+ * Append an operation to the delta, merging it with the last operation if that continues to the same place.
+ */
+static int _append_op(data_delta *dlt, int copy, uint64_t offset, uint64_t len) {
+    if (len == 0) return EXIT_SUCCESS;
+    if (dlt->count > 0) {
+        delta_op *last = &(dlt->ops[dlt->count - 1]);
+        if (last->copy == copy && last->offset + last->len == offset) {
+            last->len += len;
+            return EXIT_SUCCESS;
+        }
+    }
+    if (dlt->count == dlt->capacity) {
+        const size_t new_cap = dlt->capacity ? dlt->capacity * 2 : 16;
+        delta_op *new_ops = realloc(dlt->ops, new_cap * sizeof(delta_op));
+        if (!new_ops) return EXIT_FAILURE;
+        dlt->ops = new_ops;
+        dlt->capacity = new_cap;
+    }
+    dlt->ops[dlt->count++] = (delta_op){.offset = offset, .len = len, .copy = copy};
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Index the blocks of the base at multiples of DELTA_BLOCK_SIZE. Each entry is the offset of a block plus 1, or 0 if
+ * the entry is empty. When blocks collide, the first one is kept.
+ */
+static size_t *_index_base(const unsigned char *base, size_t base_len, unsigned *bits_p) {
+    const size_t blocks = base_len / DELTA_BLOCK_SIZE;
+    unsigned bits = 4;
+    while (bits < 40 && ((size_t)1 << bits) < blocks * 2) bits++;
+    size_t *table = calloc((size_t)1 << bits, sizeof(size_t));
+    if (!table) return NULL;
+    for (size_t off = 0; off + DELTA_BLOCK_SIZE <= base_len; off += DELTA_BLOCK_SIZE) {
+        size_t *entry = &(table[_table_index(_block_hash(base + off), bits)]);
+        if (!*entry) *entry = off + 1;
+    }
+    *bits_p = bits;
+    return table;
+}
+
+int delta_compute(const char *base_p, size_t base_len, const char *data_p, size_t len, data_delta *dlt) {
+    const unsigned char *base = (const unsigned char *)base_p;
+    const unsigned char *data = (const unsigned char *)data_p;
+    dlt->ops = NULL;
+    dlt->count = 0;
+    dlt->capacity = 0;
+    size_t lit_start = 0;  // start of the data not covered by the operations yet
+    if (base_len >= DELTA_BLOCK_SIZE && len >= DELTA_BLOCK_SIZE) {
+        unsigned bits;
+        size_t *table = _index_base(base, base_len, &bits);
+        if (!table) return EXIT_FAILURE;
+        uint64_t out_mult = 1;  // multiplier of the byte leaving the rolling window
+        for (unsigned i = 1; i < DELTA_BLOCK_SIZE; i++) out_mult *= ROLL_MULT;
+
+        size_t pos = 0;
+        uint64_t h = _block_hash(data);
+        while (1) {
+            const size_t entry = table[_table_index(h, bits)];
+            if (entry && !memcmp(base + entry - 1, data + pos, DELTA_BLOCK_SIZE)) {
+                size_t match = entry - 1;
+                // extend the match backwards into the data not covered yet, and then forwards
+                while (pos > lit_start && match > 0 && data[pos - 1] == base[match - 1]) {
+                    pos--;
+                    match--;
+                }
+                size_t match_len = DELTA_BLOCK_SIZE + (entry - 1 - match);
+                while (match + match_len < base_len && pos + match_len < len &&
+                       data[pos + match_len] == base[match + match_len]) {
+                    match_len++;
+                }
+                if (_append_op(dlt, 0, lit_start, pos - lit_start) != EXIT_SUCCESS ||
+                    _append_op(dlt, 1, match, match_len) != EXIT_SUCCESS) {
+                    free(table);
+                    delta_free(dlt);
+                    return EXIT_FAILURE;
+                }
+                pos += match_len;
+                lit_start = pos;
+                if (pos + DELTA_BLOCK_SIZE > len) break;
+                h = _block_hash(data + pos);
+                continue;
+            }
+            if (pos + DELTA_BLOCK_SIZE >= len) break;
+            h = (h - data[pos] * out_mult) * ROLL_MULT + data[pos + DELTA_BLOCK_SIZE];
+            pos++;
+        }
+        free(table);
+    }
+    if (_append_op(dlt, 0, lit_start, len - lit_start) != EXIT_SUCCESS) {
+        delta_free(dlt);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void delta_free(data_delta *dlt) {
+    if (dlt->ops) free(dlt->ops);
+    dlt->ops = NULL;
+    dlt->count = 0;
+    dlt->capacity = 0;
+}
+
+/*
+ * Compute the two sums of the weak checksum of the block. No iteration of the loop depends on the previous one, so that
+ * compilers can vectorize it.
+ */
+static inline void _weak_sums(const unsigned char *block, size_t len, uint32_t *a_p, uint32_t *b_p) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a += block[i];
+        b += (uint32_t)(len - i) * block[i];
+    }
+    *a_p = a;
+    *b_p = b;
+}
+
+static inline uint32_t _weak_checksum(uint32_t a, uint32_t b) { return (a & 0xFFFFU) | (b << 16); }
+
+uint32_t delta_weak_sum(const char *block, size_t len) {
+    uint32_t a;
+    uint32_t b;
+    _weak_sums((const unsigned char *)block, len, &a, &b);
+    return _weak_checksum(a, b);
+}
+
+static inline size_t _weak_index(uint32_t weak, unsigned bits) {
+    return (size_t)((uint32_t)(weak * WEAK_INDEX_MULT) >> (32 - bits));
+}
+
+int block_index_init(block_index *index, const block_sig *sigs, size_t cnt, size_t block_size) {
+    unsigned bits = 4;
+    while (bits < 31 && ((size_t)1 << bits) < cnt * 2) bits++;
+    if (((size_t)1 << bits) <= cnt) return EXIT_FAILURE;
+    index->table = calloc((size_t)1 << bits, sizeof(size_t));
+    if (!index->table) return EXIT_FAILURE;
+    const size_t mask = ((size_t)1 << bits) - 1;
+    for (size_t i = 0; i < cnt; i++) {
+        size_t slot = _weak_index(sigs[i].weak, bits);
+        while (index->table[slot]) slot = (slot + 1) & mask;
+        index->table[slot] = i + 1;
+    }
+    index->sigs = sigs;
+    index->cnt = cnt;
+    index->block_size = block_size;
+    index->bits = bits;
+    return EXIT_SUCCESS;
+}
+
+void block_index_free(block_index *index) {
+    if (index->table) free(index->table);
+    index->table = NULL;
+}
+
+/*
+ * Find a block with the weak checksum and the same contents as the data of block_size bytes. The block at hint, which
+ * follows the last block found, is checked first.
+ * returns the index of the block, or -1 if there is no such block.
+ */
+static int64_t _find_block(const block_index *index, uint32_t weak, const unsigned char *data, int64_t hint) {
+    const block_sig *sigs = index->sigs;
+    // the strong hash is computed only if a weak checksum matches
+    uint64_t strong = 0;
+    int have_strong = 0;
+    if (hint >= 0 && (size_t)hint < index->cnt && sigs[hint].weak == weak) {
+        strong = hash64(data, index->block_size, 0);
+        have_strong = 1;
+        if (sigs[hint].strong == strong) return hint;
+    }
+    const size_t mask = ((size_t)1 << index->bits) - 1;
+    for (size_t slot = _weak_index(weak, index->bits); index->table[slot]; slot = (slot + 1) & mask) {
+        const size_t ind = index->table[slot] - 1;
+        if (sigs[ind].weak != weak) continue;
+        if (!have_strong) {
+            strong = hash64(data, index->block_size, 0);
+            have_strong = 1;
+        }
+        if (sigs[ind].strong == strong) return (int64_t)ind;
+    }
+    return -1;
+}
+
+/*
+ * State of a file being streamed as a delta. The buffer has the data not passed to the writer yet, from lit_start, and
+ * the window of the rolling checksum, at pos.
+ */
+typedef struct _delta_stream {
+    FILE *fp;
+    int64_t remaining;  // bytes of the file not read yet
+    unsigned char *buf;
+    size_t capacity;
+    uint64_t buf_offset;  // offset in the file of the start of the buffer
+    size_t lit_start;
+    size_t pos;
+    size_t end;
+    delta_op copy;  // copy not passed to the writer yet, which is extended while the next blocks follow it
+    delta_op_writer writer;
+    void *arg;
+} delta_stream;
+
+/*
+ * Move the data from lit_start to the start of the buffer, and read the file into the rest of the buffer.
+ */
+static int _fill_stream(delta_stream *st) {
+    const size_t keep = st->end - st->lit_start;
+    memmove(st->buf, st->buf + st->lit_start, keep);
+    st->buf_offset += st->lit_start;
+    st->pos -= st->lit_start;
+    st->end = keep;
+    st->lit_start = 0;
+    while (st->end < st->capacity && st->remaining > 0) {
+        size_t want = st->capacity - st->end;
+        if ((int64_t)want > st->remaining) want = (size_t)st->remaining;
+        const size_t read = fread(st->buf + st->end, 1, want, st->fp);
+        // the file is shorter than its size
+        if (read == 0) return EXIT_FAILURE;
+        st->end += read;
+        st->remaining -= (int64_t)read;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int _write_copy(delta_stream *st) {
+    if (st->copy.len == 0) return EXIT_SUCCESS;
+    const int status = st->writer(st->arg, &(st->copy), NULL);
+    st->copy.len = 0;
+    return status;
+}
+
+/*
+ * Pass the data from lit_start to end as an insert, after the copy before it.
+ */
+static int _write_insert(delta_stream *st, size_t end) {
+    if (end == st->lit_start) return EXIT_SUCCESS;
+    if (_write_copy(st) != EXIT_SUCCESS) return EXIT_FAILURE;
+    const delta_op op = {.offset = st->buf_offset + st->lit_start, .len = end - st->lit_start, .copy = 0};
+    const int status = st->writer(st->arg, &op, (const char *)st->buf + st->lit_start);
+    st->lit_start = end;
+    return status;
+}
+
+static int _add_copy(delta_stream *st, uint64_t offset, uint64_t len) {
+    if (st->copy.len > 0 && st->copy.offset + st->copy.len == offset) {
+        st->copy.len += len;
+        return EXIT_SUCCESS;
+    }
+    if (_write_copy(st) != EXIT_SUCCESS) return EXIT_FAILURE;
+    st->copy.offset = offset;
+    st->copy.len = len;
+    return EXIT_SUCCESS;
+}
+
+int delta_stream_file(FILE *fp, int64_t size, const block_index *index, delta_op_writer writer, void *arg) {
+    const size_t block_size = index->block_size;
+    // inserts are passed before they grow beyond DELTA_FILE_INSERT_SIZE, leaving space for a window and more
+    delta_stream st = {.fp = fp,
+                       .remaining = size,
+                       .capacity = DELTA_FILE_INSERT_SIZE + 2 * block_size,
+                       .buf_offset = 0,
+                       .lit_start = 0,
+                       .pos = 0,
+                       .end = 0,
+                       .copy = {.offset = 0, .len = 0, .copy = 1},
+                       .writer = writer,
+                       .arg = arg};
+    st.buf = malloc(st.capacity);
+    if (!st.buf) return EXIT_FAILURE;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    int have_sums = 0;
+    int64_t next_block = -1;
+    int status = EXIT_SUCCESS;
+    while (status == EXIT_SUCCESS) {
+        // the window and the byte after it are needed to roll the checksum
+        if (st.end - st.pos <= block_size && st.remaining > 0 && _fill_stream(&st) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (st.end - st.pos < block_size) break;
+        if (!have_sums) {
+            _weak_sums(st.buf + st.pos, block_size, &a, &b);
+            have_sums = 1;
+        }
+        const int64_t block = _find_block(index, _weak_checksum(a, b), st.buf + st.pos, next_block);
+        if (block >= 0) {
+            if (_write_insert(&st, st.pos) != EXIT_SUCCESS ||
+                _add_copy(&st, (uint64_t)block * block_size, block_size) != EXIT_SUCCESS) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            st.pos += block_size;
+            st.lit_start = st.pos;
+            have_sums = 0;
+            next_block = block + 1;
+            continue;
+        }
+        if (st.pos + block_size == st.end) break;
+        const uint32_t out = st.buf[st.pos];
+        a = a - out + st.buf[st.pos + block_size];
+        b = b - (uint32_t)block_size * out + a;
+        st.pos++;
+        if (st.pos - st.lit_start >= DELTA_FILE_INSERT_SIZE) status = _write_insert(&st, st.pos);
+    }
+    if (status == EXIT_SUCCESS) status = _write_insert(&st, st.end);
+    if (status == EXIT_SUCCESS) status = _write_copy(&st);
+    free(st.buf);
+    return status;
+}
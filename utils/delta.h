@@ -0,0 +1,120 @@
+/*
+ * utils/delta.h - header for computing binary deltas
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_DELTA_H_
+#define UTILS_DELTA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// length of the blocks of the base that are looked up in the data. Matches shorter than this are not found
+#define DELTA_BLOCK_SIZE 32
+
+// limits of the size of the blocks of a file that the client has, which are looked up in the file being sent
+#define DELTA_FILE_MIN_BLOCK 512
+#define DELTA_FILE_MAX_BLOCK 1048576  // 1 MiB
+// data of a file not found in the blocks is passed to the writer in parts of at most this size
+#define DELTA_FILE_INSERT_SIZE 1048576L  // 1 MiB
+
+/*
+ * An operation that appends len bytes to the output. A copy operation appends the bytes at offset in the base, and an
+ * insert operation appends the bytes at offset in the data.
+ */
+typedef struct _delta_op {
+    uint64_t offset;
+    uint64_t len;
+    int copy;
+} delta_op;
+
+/*
+ * A sequence of operations that produces the data from the base when applied in order.
+ */
+typedef struct _data_delta {
+    delta_op *ops;
+    size_t count;
+    size_t capacity;
+} data_delta;
+
+/*
+ * Compute a delta that produces len bytes of data from base_len bytes of base. Copies are found by looking up the
+ * blocks of the base at each position of the data, and are extended as far as the base and the data match.
+ * Caller should free the delta with delta_free after using. On failure, dlt->ops is set to NULL.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int delta_compute(const char *base, size_t base_len, const char *data, size_t len, data_delta *dlt);
+
+/*
+ * Free the operations of the delta.
+ */
+extern void delta_free(data_delta *dlt);
+
+/*
+ * The checksums of a block of a file. weak is the rolling checksum given by delta_weak_sum, and strong is the hash64 of
+ * the block with the seed 0.
+ */
+typedef struct _block_sig {
+    uint64_t strong;
+    uint32_t weak;
+} block_sig;
+
+/*
+ * A hash table of the blocks of a file, looked up by their weak checksums.
+ */
+typedef struct _block_index {
+    const block_sig *sigs;
+    size_t cnt;
+    size_t block_size;
+    size_t *table;  // index of a block plus 1, or 0 if the entry is empty
+    unsigned bits;
+} block_index;
+
+/*
+ * Writer of an operation of a delta. The data of an insert operation is passed with it, and is NULL for a copy.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+typedef int (*delta_op_writer)(void *arg, const delta_op *op, const char *data);
+
+/*
+ * Get the rolling checksum of the block of len bytes. The low 16 bits are the sum of the bytes, and the high 16 bits
+ * are the sum of each byte multiplied by its distance from the end of the block, as in rsync.
+ */
+extern uint32_t delta_weak_sum(const char *block, size_t len);
+
+/*
+ * Index the cnt blocks of block_size bytes given by sigs, which must outlive the index.
+ * Caller should free the index with block_index_free after using.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int block_index_init(block_index *index, const block_sig *sigs, size_t cnt, size_t block_size);
+
+/*
+ * Free the table of the index.
+ */
+extern void block_index_free(block_index *index);
+
+/*
+ * Read size bytes of the file from its current position, and pass the operations that produce them from the blocks of
+ * the index to the writer in order. The offset of a copy is in the file of the blocks, and the offset of an insert is
+ * in the data read. Blocks are looked up at every position of the file by rolling the weak checksum, so that a block
+ * is found even if the data before it has changed in length.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int delta_stream_file(FILE *fp, int64_t size, const block_index *index, delta_op_writer writer, void *arg);
+
+#endif  // UTILS_DELTA_H_
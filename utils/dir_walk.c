@@ -0,0 +1,394 @@
+/*
+ * utils/dir_walk.c - parallel walking of directory trees on Linux and macOS
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <utils/dir_walk.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/utils.h>
+
+#define MAX_WALK_THREADS 8
+// maximum number of directories waiting in the queues while holding an open file descriptor. Other directories are
+// opened by their path when they are taken from a queue
+#define MAX_QUEUED_DIR_FDS 64
+// number of paths a worker collects before passing them to the callback
+#define OUT_BATCH_SIZE 64
+#define MAX_PATH_LEN 2048
+
+/*
+ * A directory to be read. The path ends with a path separator.
+ */
+typedef struct _walk_task {
+    char *path;
+    size_t path_len;
+    int fd;  // -1 if the directory is not opened yet
+    int depth;
+} walk_task;
+
+/*
+ * The queue of a worker. The owner takes tasks from the back, so that it walks depth-first, and other workers steal
+ * from the front.
+ */
+typedef struct _task_deque {
+    pthread_mutex_t lock;
+    walk_task *tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} task_deque;
+
+typedef struct _walker walker;
+
+typedef struct _walk_worker {
+    walker *w;
+    unsigned id;
+    pthread_t thread;
+    char *out[OUT_BATCH_SIZE];
+    unsigned out_cnt;
+} walk_worker;
+
+struct _walker {
+    task_deque *deques;
+    walk_worker *workers;
+    unsigned worker_cnt;
+    int max_depth;
+    int include_leaf_dirs;
+    // the fields below are protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t queued;  // tasks in the queues
+    size_t active;  // tasks being processed
+    unsigned idle;  // workers waiting on cond
+    unsigned queued_fds;
+    int stop;
+    // the callback is called with out_lock held
+    pthread_mutex_t out_lock;
+    path_callback callback;
+    void *arg;
+    int callback_stopped;  // protected by out_lock
+};
+
+static void _push_task(walker *w, unsigned id, walk_task *task) {
+    pthread_mutex_lock(&(w->lock));
+    if (task->fd >= 0) {
+        if (w->queued_fds < MAX_QUEUED_DIR_FDS) {
+            w->queued_fds++;
+        } else {
+            close(task->fd);
+            task->fd = -1;
+        }
+    }
+    pthread_mutex_unlock(&(w->lock));
+
+    task_deque *dq = &(w->deques[id]);
+    pthread_mutex_lock(&(dq->lock));
+    if (dq->head > 0 && dq->head == dq->tail) {
+        dq->head = 0;
+        dq->tail = 0;
+    }
+    if (dq->tail == dq->capacity) {
+        const size_t new_cap = dq->capacity ? dq->capacity * 2 : 64;
+        walk_task *new_tasks = realloc(dq->tasks, new_cap * sizeof(walk_task));
+        if (!new_tasks) {
+            pthread_mutex_unlock(&(dq->lock));
+            pthread_mutex_lock(&(w->lock));
+            if (task->fd >= 0) w->queued_fds--;
+            pthread_mutex_unlock(&(w->lock));
+            if (task->fd >= 0) close(task->fd);
+            free(task->path);
+            return;
+        }
+        dq->tasks = new_tasks;
+        dq->capacity = new_cap;
+    }
+    dq->tasks[dq->tail++] = *task;
+    pthread_mutex_unlock(&(dq->lock));
+
+    pthread_mutex_lock(&(w->lock));
+    w->queued++;
+    if (w->idle) pthread_cond_signal(&(w->cond));
+    pthread_mutex_unlock(&(w->lock));
+}
+
+/*
+ * Take a task from the own queue of the worker, or steal one from another worker.
+ * returns 1 if a task was taken, or 0 if all the queues are empty.
+ */
+static int _take_task(walker *w, unsigned id, walk_task *task) {
+    int found = 0;
+    for (unsigned i = 0; i < w->worker_cnt && !found; i++) {
+        task_deque *dq = &(w->deques[(id + i) % w->worker_cnt]);
+        pthread_mutex_lock(&(dq->lock));
+        if (dq->head < dq->tail) {
+            *task = (i == 0) ? dq->tasks[--(dq->tail)] : dq->tasks[(dq->head)++];
+            found = 1;
+        }
+        pthread_mutex_unlock(&(dq->lock));
+    }
+    if (!found) return 0;
+    pthread_mutex_lock(&(w->lock));
+    w->queued--;
+    w->active++;
+    if (task->fd >= 0) w->queued_fds--;
+    pthread_mutex_unlock(&(w->lock));
+    return 1;
+}
+
+/*
+ * Pass the collected paths to the callback.
+ */
+static void _flush_out(walk_worker *worker) {
+    if (worker->out_cnt == 0) return;
+    walker *w = worker->w;
+    pthread_mutex_lock(&(w->out_lock));
+    for (unsigned i = 0; i < worker->out_cnt; i++) {
+        // once the callback stops the walk, it is not called again
+        if (w->callback_stopped) {
+            free(worker->out[i]);
+        } else if (w->callback(w->arg, worker->out[i]) != EXIT_SUCCESS) {
+            w->callback_stopped = 1;
+        }
+    }
+    const int stop = w->callback_stopped;
+    pthread_mutex_unlock(&(w->out_lock));
+    worker->out_cnt = 0;
+    if (stop) {
+        pthread_mutex_lock(&(w->lock));
+        w->stop = 1;
+        pthread_mutex_unlock(&(w->lock));
+    }
+}
+
+static void _emit(walk_worker *worker, char *path) {
+    if (!path) return;
+    worker->out[worker->out_cnt++] = path;
+    if (worker->out_cnt == OUT_BATCH_SIZE) _flush_out(worker);
+}
+
+/*
+ * Join the directory path, which ends with a path separator, and the name. Appends a path separator if is_dir is set.
+ */
+static char *_join_path(const walk_task *task, const char *name, size_t name_len, int is_dir) {
+    char *path = malloc(task->path_len + name_len + 2);
+    if (!path) return NULL;
+    memcpy(path, task->path, task->path_len);
+    memcpy(path + task->path_len, name, name_len);
+    size_t len = task->path_len + name_len;
+    if (is_dir) path[len++] = PATH_SEP;
+    path[len] = '\0';
+    return path;
+}
+
+/*
+ * Read the directory of the task, emitting its files and queueing its subdirectories.
+ */
+static void _walk_dir(walk_worker *worker, walk_task *task) {
+    walker *w = worker->w;
+    int fd = task->fd;
+    if (fd < 0) fd = open(task->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d) {
+#ifdef DEBUG_MODE
+        printf("Error opening directory %s\n", task->path);
+#endif
+        if (fd >= 0) close(fd);
+        free(task->path);
+        return;
+    }
+    const struct dirent *dir;
+    int is_empty = 1;
+    while ((dir = readdir(d)) != NULL) {
+        const char *filename = dir->d_name;
+        if (!(strcmp(filename, ".") && strcmp(filename, ".."))) continue;
+        is_empty = 0;
+        const size_t fname_len = strnlen(filename, sizeof(dir->d_name));
+        if (fname_len + task->path_len > MAX_PATH_LEN) {
+            error("Too long file name.");
+            break;
+        }
+        // the type in the directory entry saves a stat call for each file, on file systems that provide it
+        unsigned char type = dir->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat sb;
+            if (fstatat(dirfd(d), filename, &sb, AT_SYMLINK_NOFOLLOW)) continue;
+            if (S_ISDIR(sb.st_mode)) {
+                type = DT_DIR;
+            } else if (S_ISREG(sb.st_mode)) {
+                type = DT_REG;
+            }
+        }
+        if (type == DT_REG) {
+            _emit(worker, _join_path(task, filename, fname_len, 0));
+        } else if (type == DT_DIR && task->depth < w->max_depth) {
+            walk_task sub = {.path = _join_path(task, filename, fname_len, 1),
+                             .path_len = task->path_len + fname_len + 1,
+                             .fd = -1,
+                             .depth = task->depth + 1};
+            if (!sub.path) continue;
+            sub.fd = openat(dirfd(d), filename, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            _push_task(w, worker->id, &sub);
+        }
+    }
+    if (w->include_leaf_dirs && is_empty) {
+        _emit(worker, task->path);
+    } else {
+        free(task->path);
+    }
+    (void)closedir(d);
+}
+
+static void _discard_task(walk_task *task) {
+    if (task->fd >= 0) close(task->fd);
+    free(task->path);
+}
+
+static void *_worker_run(void *arg) {
+    walk_worker *worker = (walk_worker *)arg;
+    walker *w = worker->w;
+    while (1) {
+        walk_task task;
+        if (_take_task(w, worker->id, &task)) {
+            pthread_mutex_lock(&(w->lock));
+            const int stop = w->stop;
+            pthread_mutex_unlock(&(w->lock));
+            if (stop) {
+                _discard_task(&task);
+            } else {
+                _walk_dir(worker, &task);
+                // pass the files of each directory on without waiting for a full batch
+                _flush_out(worker);
+            }
+            pthread_mutex_lock(&(w->lock));
+            w->active--;
+            if (w->active == 0 && w->queued == 0) pthread_cond_broadcast(&(w->cond));
+            pthread_mutex_unlock(&(w->lock));
+            continue;
+        }
+        pthread_mutex_lock(&(w->lock));
+        if (w->queued == 0 && w->active == 0) {
+            pthread_mutex_unlock(&(w->lock));
+            break;
+        }
+        if (w->queued == 0) {
+            w->idle++;
+            pthread_cond_wait(&(w->cond), &(w->lock));
+            w->idle--;
+        }
+        pthread_mutex_unlock(&(w->lock));
+    }
+    return NULL;
+}
+
+/*
+ * Get the number of workers to use, which is the number of online processors, up to MAX_WALK_THREADS.
+ */
+static unsigned _worker_count(void) {
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 1) return 1;
+    return cpus < MAX_WALK_THREADS ? (unsigned)cpus : MAX_WALK_THREADS;
+}
+
+/*
+ * Queue the given directory as a task of depth 1. The directory is followed if it is a symbolic link.
+ */
+static void _push_root(walker *w, const char *dir) {
+    const size_t len = strnlen(dir, MAX_PATH_LEN + 1);
+    if (len == 0) return;
+    if (len > MAX_PATH_LEN) {
+        error("Too long file name.");
+        return;
+    }
+    walk_task task = {.path = malloc(len + 2), .path_len = len, .fd = -1, .depth = 1};
+    if (!task.path) return;
+    memcpy(task.path, dir, len);
+    if (task.path[len - 1] != PATH_SEP) task.path[(task.path_len)++] = PATH_SEP;
+    task.path[task.path_len] = '\0';
+    task.fd = open(task.path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (task.fd < 0) {
+#ifdef DEBUG_MODE
+        printf("Error opening directory %s\n", task.path);
+#endif
+        free(task.path);
+        return;
+    }
+    _push_task(w, 0, &task);
+}
+
+int walk_dirs(const char *const *dirs, size_t cnt, int max_depth, int include_leaf_dirs, path_callback callback,
+              void *arg) {
+    if (cnt == 0 || max_depth < 1) return EXIT_SUCCESS;
+    walker w = {.worker_cnt = _worker_count(),
+                .max_depth = max_depth,
+                .include_leaf_dirs = include_leaf_dirs,
+                .queued = 0,
+                .active = 0,
+                .idle = 0,
+                .queued_fds = 0,
+                .stop = 0,
+                .callback = callback,
+                .arg = arg,
+                .callback_stopped = 0};
+    w.deques = calloc(w.worker_cnt, sizeof(task_deque));
+    w.workers = calloc(w.worker_cnt, sizeof(walk_worker));
+    if (!w.deques || !w.workers || pthread_mutex_init(&(w.lock), NULL)) {
+        if (w.deques) free(w.deques);
+        if (w.workers) free(w.workers);
+        return EXIT_FAILURE;
+    }
+    pthread_cond_init(&(w.cond), NULL);
+    pthread_mutex_init(&(w.out_lock), NULL);
+    for (unsigned i = 0; i < w.worker_cnt; i++) {
+        pthread_mutex_init(&(w.deques[i].lock), NULL);
+        w.workers[i].w = &w;
+        w.workers[i].id = i;
+        w.workers[i].out_cnt = 0;
+    }
+
+    for (size_t i = 0; i < cnt; i++) _push_root(&w, dirs[i]);
+
+    // the calling thread is the first worker. Workers that could not be started leave their share to the others
+    unsigned started = 1;
+    for (unsigned i = 1; i < w.worker_cnt; i++) {
+        if (pthread_create(&(w.workers[i].thread), NULL, &_worker_run, &(w.workers[i]))) break;
+        started++;
+    }
+    _worker_run(&(w.workers[0]));
+    for (unsigned i = 1; i < started; i++) pthread_join(w.workers[i].thread, NULL);
+
+    // the workers return only after all the queues are empty
+    for (unsigned i = 0; i < w.worker_cnt; i++) {
+        free(w.deques[i].tasks);
+        pthread_mutex_destroy(&(w.deques[i].lock));
+    }
+    free(w.deques);
+    free(w.workers);
+    pthread_mutex_destroy(&(w.out_lock));
+    pthread_cond_destroy(&(w.cond));
+    pthread_mutex_destroy(&(w.lock));
+    return w.stop ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * utils/dir_walk.h - header for walking directory trees
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_DIR_WALK_H_
+#define UTILS_DIR_WALK_H_
+
+#include <stddef.h>
+#include <utils/utils.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+
+/*
+ * Walk the directories given by the cnt paths in dirs, and their subdirectories up to a depth of max_depth, where the
+ * given directories are at depth 1. Calls the callback with the path of each regular file found, and also with the
+ * path of each empty directory, ending with a path separator, if include_leaf_dirs is set. Symbolic links inside the
+ * directories are not followed. The directories are read in parallel by a pool of threads, so the paths are not in
+ * any particular order. Calls to the callback are never made concurrently, but may be made from different threads.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if the callback stopped the walk.
+ */
+extern int walk_dirs(const char *const *dirs, size_t cnt, int max_depth, int include_leaf_dirs, path_callback callback,
+                     void *arg);
+
+#endif
+
+#endif  // UTILS_DIR_WALK_H_
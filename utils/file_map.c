@@ -0,0 +1,105 @@
+/*
+ * utils/file_map.c - passing files to writers directly from memory mappings on Linux and macOS
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <utils/file_map.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the window being passed to the writer by this thread, where a SIGBUS means that the file was truncated
+static _Thread_local char *volatile window_start = NULL;
+static _Thread_local volatile size_t window_len = 0;
+static _Thread_local volatile sig_atomic_t window_truncated = 0;
+
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+static int handler_installed = 0;
+static struct sigaction prev_action;
+static uintptr_t page_size;
+
+static void _handle_sigbus(int sig, siginfo_t *info, void *context) {
+    (void)sig;
+    (void)context;
+    char *addr = (char *)info->si_addr;
+    char *start = window_start;
+    if (start && addr >= start && addr < start + window_len) {
+        // map zeros over the rest of the window, so that the access that faulted can continue
+        char *page = (char *)((uintptr_t)addr & ~(page_size - 1));
+        const size_t len = (size_t)(start + window_len - page);
+        if (mmap(page, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+            window_truncated = 1;
+            return;
+        }
+    }
+    // not caused by a truncated window. The access faults again with the previous handler
+    sigaction(SIGBUS, &prev_action, NULL);
+}
+
+static void _install_handler(void) {
+    const long size = sysconf(_SC_PAGESIZE);
+    if (size <= 0) return;
+    page_size = (uintptr_t)size;
+    struct sigaction action;
+    action.sa_sigaction = &_handle_sigbus;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    if (sigaction(SIGBUS, &action, &prev_action)) return;
+    handler_installed = 1;
+}
+
+int map_file_chunked(FILE *fp, int64_t size, chunk_writer writer, void *arg) {
+    pthread_once(&handler_once, &_install_handler);
+    if (!handler_installed) return FILE_MAP_UNAVAILABLE;
+    const off_t start = ftello(fp);
+    if (start < 0) return FILE_MAP_UNAVAILABLE;
+    const int fd = fileno(fp);
+    int64_t done = 0;
+    while (done < size) {
+        const off_t offset = start + (off_t)done;
+        // mappings start at a page boundary
+        const size_t skip = (size_t)((uintptr_t)offset & (page_size - 1));
+        const size_t len = size - done < FILE_MAP_WINDOW ? (size_t)(size - done) : FILE_MAP_WINDOW;
+        // a file already truncated is found without passing zeros
+        struct stat statbuf;
+        if (fstat(fd, &statbuf) || statbuf.st_size < offset + (off_t)len) return EXIT_FAILURE;
+        char *map = mmap(NULL, skip + len, PROT_READ, MAP_SHARED, fd, offset - (off_t)skip);
+        if (map == MAP_FAILED) return done == 0 ? FILE_MAP_UNAVAILABLE : EXIT_FAILURE;
+        // the window is read ahead in the background while its first pages are being passed
+        madvise(map, skip + len, MADV_SEQUENTIAL);
+        madvise(map, skip + len, MADV_WILLNEED);
+        window_truncated = 0;
+        window_len = skip + len;
+        window_start = map;
+        const int status = writer(arg, map + skip, len);
+        window_start = NULL;
+        munmap(map, skip + len);
+        if (status != EXIT_SUCCESS || window_truncated) return EXIT_FAILURE;
+        done += (int64_t)len;
+    }
+    if (fseeko(fp, start + (off_t)size, SEEK_SET)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * utils/file_map.h - header for passing files to writers directly from memory mappings
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_FILE_MAP_H_
+#define UTILS_FILE_MAP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <utils/utils.h>
+
+// returned when the file cannot be mapped, in which case the writer is not called
+#define FILE_MAP_UNAVAILABLE -1
+// files smaller than this are read faster than they are mapped
+#define FILE_MAP_MIN_SIZE 1048576
+// maximum size of a window of the file mapped at a time, which is also the maximum part passed to the writer
+#define FILE_MAP_WINDOW 8388608
+
+#if defined(__linux__) || defined(__APPLE__)
+
+/*
+ * Pass size bytes of the file opened as fp, from its current position, to the writer directly from windows of the file
+ * mapped into memory, without copying them. Each window is unmapped after the writer returns.
+ * If the file is truncated while a window is being passed, the pages past the new end read as zeros instead of raising
+ * SIGBUS, and the function fails after the writer returns. The caller should then close the connection.
+ * returns EXIT_SUCCESS on success, EXIT_FAILURE on failure, or FILE_MAP_UNAVAILABLE if the file cannot be mapped.
+ */
+extern int map_file_chunked(FILE *fp, int64_t size, chunk_writer writer, void *arg);
+
+#endif
+
+#endif  // UTILS_FILE_MAP_H_
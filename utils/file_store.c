@@ -0,0 +1,343 @@
+/*
+ * utils/file_store.c - platform independent store of received files, addressed by their contents
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <globals.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/file_store.h>
+#include <utils/hash.h>
+#include <utils/list_utils.h>
+#include <utils/utils.h>
+
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+// a stored file is named after its hash and its size, as 16 hex digits each separated by a '-'
+#define STORE_NAME_LEN 34
+#define STORE_PATH_LEN (sizeof(FILE_STORE_DIR) + STORE_NAME_LEN)
+
+#define CHECK_BUF_SZ 65536L  // 64 KiB
+
+typedef struct _store_entry {
+    uint64_t hash;
+    int64_t size;  // 0 if the slot is empty
+    uint64_t last_use;
+} store_entry;
+
+typedef struct _file_store {
+    pthread_mutex_t lock;
+    uint64_t clock;
+    int64_t total_size;
+    store_entry entries[FILE_STORE_LEN];
+} file_store;
+
+// connection handlers are forked processes on Linux and macOS, which share this memory, and threads on Windows
+static file_store *store = NULL;
+
+static int _store_path(char *path, uint64_t hash, int64_t size) {
+    return snprintf_check(path, STORE_PATH_LEN, "%s%c%016llx-%016llx", FILE_STORE_DIR, PATH_SEP,
+                          (unsigned long long)hash, (unsigned long long)size);
+}
+
+/*
+ * Check that the file at path has the given size and hash.
+ * returns EXIT_SUCCESS if it has and EXIT_FAILURE otherwise.
+ */
+static int _check_file(const char *path, uint64_t hash, int64_t size) {
+    FILE *fp = open_file(path, "rb");
+    if (!fp) return EXIT_FAILURE;
+    hash64_state state;
+    hash64_init(&state, 0);
+    char buf[CHECK_BUF_SZ];
+    int64_t total = 0;
+    size_t len;
+    while ((len = fread(buf, 1, CHECK_BUF_SZ, fp)) > 0 && total + (int64_t)len <= size) {
+        hash64_update(&state, buf, len);
+        total += (int64_t)len;
+    }
+    const int failed = ferror(fp) || len > 0;
+    fclose(fp);
+    if (failed || total != size || hash64_digest(&state) != hash) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+static void _remove_entry(store_entry *entry) {
+    char path[STORE_PATH_LEN];
+    if (_store_path(path, entry->hash, entry->size) == EXIT_SUCCESS) remove_file(path);
+    store->total_size -= entry->size;
+    entry->size = 0;
+}
+
+static store_entry *_find_entry(uint64_t hash, int64_t size) {
+    for (unsigned i = 0; i < FILE_STORE_LEN; i++) {
+        store_entry *entry = &(store->entries[i]);
+        if (entry->size == size && entry->hash == hash) return entry;
+    }
+    return NULL;
+}
+
+/*
+ * Remove the least recently used files until a file of the given size fits in the store.
+ * returns an empty slot for the file, or NULL if it does not fit.
+ */
+static store_entry *_make_room(int64_t size) {
+    if (size > configuration.dedup_store_size) return NULL;
+    while (1) {
+        store_entry *empty = NULL;
+        store_entry *lru = NULL;
+        for (unsigned i = 0; i < FILE_STORE_LEN; i++) {
+            store_entry *entry = &(store->entries[i]);
+            if (entry->size == 0) {
+                if (!empty) empty = entry;
+            } else if (!lru || entry->last_use < lru->last_use) {
+                lru = entry;
+            }
+        }
+        if (empty && store->total_size <= configuration.dedup_store_size - size) return empty;
+        if (!lru) return NULL;
+        _remove_entry(lru);
+    }
+}
+
+static void _insert_entry(store_entry *entry, uint64_t hash, int64_t size) {
+    entry->hash = hash;
+    entry->size = size;
+    entry->last_use = ++(store->clock);
+    store->total_size += size;
+}
+
+/*
+ * Lock the store. If a process died while holding the lock, the total size is recounted.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _lock_store(void) {
+    int status = pthread_mutex_lock(&(store->lock));
+#ifdef __linux__
+    if (status == EOWNERDEAD) {
+        store->total_size = 0;
+        for (unsigned i = 0; i < FILE_STORE_LEN; i++) store->total_size += store->entries[i].size;
+        pthread_mutex_consistent(&(store->lock));
+        return EXIT_SUCCESS;
+    }
+#endif
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int _parse_hex(const char *str, uint64_t *value_p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 16; i++) {
+        const char c = str[i];
+        if ('0' <= c && c <= '9') {
+            value = (value << 4) | (uint64_t)(c - '0');
+        } else if ('a' <= c && c <= 'f') {
+            value = (value << 4) | (uint64_t)(c - 'a' + 10);
+        } else {
+            return EXIT_FAILURE;
+        }
+    }
+    *value_p = value;
+    return EXIT_SUCCESS;
+}
+
+typedef struct _stored_file {
+    uint64_t hash;
+    int64_t size;
+    int64_t mtime;
+} stored_file;
+
+static int _compare_mtime(const void *a, const void *b) {
+    const int64_t mtime_a = ((const stored_file *)a)->mtime;
+    const int64_t mtime_b = ((const stored_file *)b)->mtime;
+    return (mtime_a > mtime_b) - (mtime_a < mtime_b);
+}
+
+/*
+ * Add the files in the store directory to the table, from the least recently modified, so that the most recently
+ * modified ones are kept if they do not all fit.
+ */
+static void _load_store(void) {
+    list2 *files = list_dir(FILE_STORE_DIR);
+    if (!files) return;
+    stored_file *stored = malloc((files->len ? files->len : 1) * sizeof(stored_file));
+    if (!stored) {
+        free_list(files);
+        return;
+    }
+    size_t cnt = 0;
+    for (uint32_t i = 0; i < files->len; i++) {
+        const char *filename = files->array[i];
+        uint64_t hash;
+        uint64_t size;
+        if (strlen(filename) != STORE_NAME_LEN - 1 || filename[16] != '-' || _parse_hex(filename, &hash) ||
+            _parse_hex(filename + 17, &size) || size > INT64_MAX) {
+            continue;
+        }
+        char path[STORE_PATH_LEN];
+        int64_t file_size;
+        int64_t mtime;
+        if (_store_path(path, hash, (int64_t)size) || is_directory(path, 0) ||
+            get_file_stat(path, &file_size, &mtime) != EXIT_SUCCESS) {
+            continue;
+        }
+        if (file_size != (int64_t)size || file_size < FILE_STORE_MIN_SIZE) {
+            remove_file(path);
+            continue;
+        }
+        stored[cnt].hash = hash;
+        stored[cnt].size = file_size;
+        stored[cnt].mtime = mtime;
+        cnt++;
+    }
+    free_list(files);
+    qsort(stored, cnt, sizeof(stored_file), &_compare_mtime);
+    for (size_t i = 0; i < cnt; i++) {
+        store_entry *entry = _make_room(stored[i].size);
+        if (entry) {
+            _insert_entry(entry, stored[i].hash, stored[i].size);
+        } else {
+            char path[STORE_PATH_LEN];
+            if (_store_path(path, stored[i].hash, stored[i].size) == EXIT_SUCCESS) remove_file(path);
+        }
+    }
+    free(stored);
+}
+
+void file_store_init(void) {
+    if (store || configuration.dedup_store_size <= 0) return;
+    const size_t size = sizeof(file_store);
+#if defined(__linux__) || defined(__APPLE__)
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        error("Failed allocating shared memory for file store");
+        return;
+    }
+#elif defined(_WIN32)
+    void *mem = malloc(size);
+    if (!mem) return;
+#endif
+    file_store *st = (file_store *)mem;
+    pthread_mutexattr_t attr;
+    int status = pthread_mutexattr_init(&attr);
+#if defined(__linux__) || defined(__APPLE__)
+    if (!status) status = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#endif
+#ifdef __linux__
+    if (!status) status = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+    if (!status) status = pthread_mutex_init(&(st->lock), &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (status || mkdirs(FILE_STORE_DIR) != EXIT_SUCCESS) {
+        if (!status) pthread_mutex_destroy(&(st->lock));
+#if defined(__linux__) || defined(__APPLE__)
+        munmap(mem, size);
+#elif defined(_WIN32)
+        free(mem);
+#endif
+        return;
+    }
+    st->clock = 0;
+    st->total_size = 0;
+    for (unsigned i = 0; i < FILE_STORE_LEN; i++) st->entries[i].size = 0;
+    store = st;
+    _load_store();
+}
+
+/*
+ * Copy the stored file opened as src_fp to dest_path, checking that it has the given size and hash on the way.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _copy_checked(FILE *src_fp, const char *dest_path, uint64_t hash, int64_t size) {
+    FILE *dest_fp = open_file(dest_path, "wb");
+    if (!dest_fp) return EXIT_FAILURE;
+    hash64_state state;
+    hash64_init(&state, 0);
+    char buf[CHECK_BUF_SZ];
+    int64_t total = 0;
+    size_t len;
+    int failed = 0;
+    while ((len = fread(buf, 1, CHECK_BUF_SZ, src_fp)) > 0 && total + (int64_t)len <= size) {
+        hash64_update(&state, buf, len);
+        total += (int64_t)len;
+        if (fwrite(buf, 1, len, dest_fp) != len) {
+            failed = 1;
+            break;
+        }
+    }
+    failed = failed || ferror(src_fp) || len > 0 || total != size || hash64_digest(&state) != hash;
+    if (fclose(dest_fp)) failed = 1;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int file_store_take(uint64_t hash, int64_t size, const char *dest_path) {
+    if (!store || size < FILE_STORE_MIN_SIZE) return EXIT_FAILURE;
+    char path[STORE_PATH_LEN];
+    if (_store_path(path, hash, size) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (_lock_store() != EXIT_SUCCESS) return EXIT_FAILURE;
+    store_entry *entry = _find_entry(hash, size);
+    if (!entry) {
+        pthread_mutex_unlock(&(store->lock));
+        return EXIT_FAILURE;
+    }
+    entry->last_use = ++(store->clock);
+    // cloned or opened while holding the lock, so that the file is not removed from the store meanwhile. A hard link to
+    // the stored file is never created here, since writing to it would change the file another client received
+    const int cloned = (clone_file(path, dest_path) == EXIT_SUCCESS);
+    FILE *src_fp = cloned ? NULL : open_file(path, "rb");
+    pthread_mutex_unlock(&(store->lock));
+    if (!cloned && !src_fp) return EXIT_FAILURE;
+
+    int status;
+    if (cloned) {
+        // the stored file is a hard link to a received file, which may have been modified after it was added
+        status = _check_file(dest_path, hash, size);
+    } else {
+        status = _copy_checked(src_fp, dest_path, hash, size);
+        fclose(src_fp);
+    }
+    if (status == EXIT_SUCCESS) return EXIT_SUCCESS;
+    remove_file(dest_path);
+    if (_lock_store() != EXIT_SUCCESS) return EXIT_FAILURE;
+    entry = _find_entry(hash, size);
+    if (entry) _remove_entry(entry);
+    pthread_mutex_unlock(&(store->lock));
+    return EXIT_FAILURE;
+}
+
+void file_store_add(const char *path, uint64_t hash, int64_t size) {
+    if (!store || size < FILE_STORE_MIN_SIZE || size > configuration.dedup_store_size) return;
+    // the hash is claimed by the client. Keeping a file with other contents would give them to the next client
+    if (_check_file(path, hash, size) != EXIT_SUCCESS) return;
+    char store_path[STORE_PATH_LEN];
+    if (_store_path(store_path, hash, size) != EXIT_SUCCESS) return;
+    if (_lock_store() != EXIT_SUCCESS) return;
+    if (!_find_entry(hash, size)) {
+        store_entry *entry = _make_room(size);
+        // a file left in the store directory without an entry is replaced
+        if (entry) remove_file(store_path);
+        if (entry && link_file(path, store_path) == EXIT_SUCCESS) _insert_entry(entry, hash, size);
+    }
+    pthread_mutex_unlock(&(store->lock));
+}
+
+#endif
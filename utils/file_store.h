@@ -0,0 +1,56 @@
+/*
+ * utils/file_store.h - platform independent store of received files, addressed by their contents
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_FILE_STORE_H_
+#define UTILS_FILE_STORE_H_
+
+#include <stdint.h>
+
+// directory of the store, in the working directory
+#define FILE_STORE_DIR ".clipshare-store"
+
+// smaller files are not kept in the store, as receiving them again costs little
+#define FILE_STORE_MIN_SIZE 1048576L  // 1 MiB
+
+// maximum number of files kept in the store
+#define FILE_STORE_LEN 4096
+
+/*
+ * Allocate the table of the store in memory shared with the connection handlers, and load the files already in the
+ * store directory, removing the least recently modified ones that exceed configuration.dedup_store_size.
+ * Must be called in the working directory once, before starting the servers, so that the servers of plain and TLS
+ * sockets and their connection handlers share the same table. If this fails, or the size of the store is 0, no files
+ * are kept.
+ */
+extern void file_store_init(void);
+
+/*
+ * Create a file at dest_path with the contents of the stored file of the given size, which has the given XXH64 hash,
+ * and mark it as the most recently used. The file is a clone of the stored file where the file system supports it, and
+ * a copy otherwise, so that it never shares its data with the file of another client.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if the file is not in the store.
+ */
+extern int file_store_take(uint64_t hash, int64_t size, const char *dest_path);
+
+/*
+ * Add the file at path, which is claimed to have the given size and XXH64 hash, to the store if its contents have that
+ * hash. The least recently used files are removed to keep the store within its size.
+ */
+extern void file_store_add(const char *path, uint64_t hash, int64_t size);
+
+#endif  // UTILS_FILE_STORE_H_
@@ -0,0 +1,153 @@
+/*
+ * utils/file_stream.c - platform independent enumeration of copied files in a separate thread
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <utils/file_stream.h>
+#include <utils/utils.h>
+
+// the stream is used only by the methods of version 4
+#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+
+/*
+ * A bounded queue of paths filled by the enumeration thread. The enumeration waits while the queue is full, so that
+ * the paths found ahead of the transfer do not take more memory than the queue.
+ */
+struct _file_stream {
+    pthread_t thread;
+    int include_leaf_dirs;
+    size_t path_len;  // set by the enumeration thread before the first path is queued
+    // the fields below are protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t filled;  // signalled when a path is queued or the enumeration ends
+    pthread_cond_t taken;   // signalled when a path is taken or the stream is stopped
+    char *paths[FILE_STREAM_QUEUE_LEN];
+    unsigned head;
+    unsigned count;
+    int done;
+    int stopped;
+};
+
+static int _queue_path(void *arg, char *path) {
+    file_stream *stream = (file_stream *)arg;
+    pthread_mutex_lock(&(stream->lock));
+    while (stream->count == FILE_STREAM_QUEUE_LEN && !stream->stopped) {
+        pthread_cond_wait(&(stream->taken), &(stream->lock));
+    }
+    if (stream->stopped) {
+        pthread_mutex_unlock(&(stream->lock));
+        free(path);
+        return EXIT_FAILURE;
+    }
+    stream->paths[(stream->head + stream->count) % FILE_STREAM_QUEUE_LEN] = path;
+    stream->count++;
+    pthread_cond_signal(&(stream->filled));
+    pthread_mutex_unlock(&(stream->lock));
+    return EXIT_SUCCESS;
+}
+
+static void *_enumerate(void *arg) {
+    file_stream *stream = (file_stream *)arg;
+    walk_copied_dirs_files(stream->include_leaf_dirs, &(stream->path_len), &_queue_path, stream);
+    pthread_mutex_lock(&(stream->lock));
+    stream->done = 1;
+    pthread_cond_signal(&(stream->filled));
+    pthread_mutex_unlock(&(stream->lock));
+    return NULL;
+}
+
+file_stream *file_stream_start(int include_leaf_dirs, size_t *path_len_p) {
+    file_stream *stream = malloc(sizeof(file_stream));
+    if (!stream) return NULL;
+    stream->include_leaf_dirs = include_leaf_dirs;
+    stream->path_len = 0;
+    stream->head = 0;
+    stream->count = 0;
+    stream->done = 0;
+    stream->stopped = 0;
+    if (pthread_mutex_init(&(stream->lock), NULL)) {
+        free(stream);
+        return NULL;
+    }
+    if (pthread_cond_init(&(stream->filled), NULL)) {
+        pthread_mutex_destroy(&(stream->lock));
+        free(stream);
+        return NULL;
+    }
+    if (pthread_cond_init(&(stream->taken), NULL)) {
+        pthread_cond_destroy(&(stream->filled));
+        pthread_mutex_destroy(&(stream->lock));
+        free(stream);
+        return NULL;
+    }
+    if (pthread_create(&(stream->thread), NULL, &_enumerate, stream)) {
+        pthread_cond_destroy(&(stream->taken));
+        pthread_cond_destroy(&(stream->filled));
+        pthread_mutex_destroy(&(stream->lock));
+        free(stream);
+        return NULL;
+    }
+    pthread_mutex_lock(&(stream->lock));
+    while (stream->count == 0 && !stream->done) {
+        pthread_cond_wait(&(stream->filled), &(stream->lock));
+    }
+    *path_len_p = stream->path_len;
+    pthread_mutex_unlock(&(stream->lock));
+    return stream;
+}
+
+char *file_stream_next(file_stream *stream) {
+    pthread_mutex_lock(&(stream->lock));
+    while (stream->count == 0 && !stream->done) {
+        pthread_cond_wait(&(stream->filled), &(stream->lock));
+    }
+    char *path = NULL;
+    if (stream->count > 0) {
+        path = stream->paths[stream->head];
+        stream->head = (stream->head + 1) % FILE_STREAM_QUEUE_LEN;
+        stream->count--;
+        pthread_cond_signal(&(stream->taken));
+    }
+    pthread_mutex_unlock(&(stream->lock));
+    return path;
+}
+
+const char *file_stream_peek(file_stream *stream, unsigned ahead) {
+    pthread_mutex_lock(&(stream->lock));
+    // the enumeration only adds paths after the ones queued, so this path is not moved until it is taken
+    const char *path = ahead < stream->count ? stream->paths[(stream->head + ahead) % FILE_STREAM_QUEUE_LEN] : NULL;
+    pthread_mutex_unlock(&(stream->lock));
+    return path;
+}
+
+void file_stream_stop(file_stream *stream) {
+    pthread_mutex_lock(&(stream->lock));
+    stream->stopped = 1;
+    pthread_cond_signal(&(stream->taken));
+    pthread_mutex_unlock(&(stream->lock));
+    pthread_join(stream->thread, NULL);
+    for (unsigned i = 0; i < stream->count; i++) {
+        free(stream->paths[(stream->head + i) % FILE_STREAM_QUEUE_LEN]);
+    }
+    pthread_cond_destroy(&(stream->taken));
+    pthread_cond_destroy(&(stream->filled));
+    pthread_mutex_destroy(&(stream->lock));
+    free(stream);
+}
+
+#endif  // (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
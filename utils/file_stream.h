@@ -0,0 +1,57 @@
+/*
+ * utils/file_stream.h - header for enumerating copied files in a separate thread
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_FILE_STREAM_H_
+#define UTILS_FILE_STREAM_H_
+
+#include <stddef.h>
+
+// maximum number of paths found by the enumeration that are waiting to be taken
+#define FILE_STREAM_QUEUE_LEN 256
+
+/*
+ * A session that enumerates the copied files in a separate thread
+ */
+typedef struct _file_stream file_stream;
+
+/*
+ * Start enumerating the copied files and directories, as in walk_copied_dirs_files, in a separate thread. Waits until
+ * the first path is found or the enumeration ends, and sets the length of the path name of the directory which the
+ * files are copied at path_len_p.
+ * returns the stream on success, or NULL on failure.
+ */
+extern file_stream *file_stream_start(int include_leaf_dirs, size_t *path_len_p);
+
+/*
+ * Take the next path found by the enumeration. Waits until a path is found if none is waiting.
+ * returns the path, which should be freed by the caller, or NULL if the enumeration has ended.
+ */
+extern char *file_stream_next(file_stream *stream);
+
+/*
+ * Get the path that would be taken after ahead more calls to file_stream_next, without taking it or waiting for it.
+ * returns the path, which is owned by the stream and stays valid until it is taken, or NULL if it is not found yet.
+ */
+extern const char *file_stream_peek(file_stream *stream, unsigned ahead);
+
+/*
+ * Stop the enumeration if it is still running and free the stream with the paths not taken.
+ */
+extern void file_stream_stop(file_stream *stream);
+
+#endif  // UTILS_FILE_STREAM_H_
@@ -0,0 +1,161 @@
+/*
+ * utils/file_writer.c - platform independent writing of received files in a separate thread
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <utils/file_writer.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// alignment of the buffers, which is the page size on most systems
+#define BUF_ALIGN 4096
+
+/*
+ * A ring of buffers. The caller fills the buffer at tail while the thread writes the buffer at head. Buffers are
+ * allocated when they are first used, so that small files do not take memory for all of them.
+ */
+struct _file_writer {
+    FILE *file;
+    pthread_t thread;
+    char *bufs[FILE_WRITER_BUF_CNT];
+    size_t lens[FILE_WRITER_BUF_CNT];
+    // the fields below are protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t queued;   // signalled when a buffer is queued or the writer is finishing
+    pthread_cond_t written;  // signalled when a buffer is written
+    unsigned head;
+    unsigned count;  // number of buffers queued, including the one being written
+    int finishing;
+    int failed;
+};
+
+static inline char *_alloc_buf(void) {
+#ifdef _WIN32
+    return _aligned_malloc(FILE_WRITER_BUF_SIZE, BUF_ALIGN);
+#else
+    void *buf;
+    if (posix_memalign(&buf, BUF_ALIGN, FILE_WRITER_BUF_SIZE)) return NULL;
+    return buf;
+#endif
+}
+
+static inline void _free_buf(char *buf) {
+#ifdef _WIN32
+    _aligned_free(buf);
+#else
+    free(buf);
+#endif
+}
+
+static void *_write_bufs(void *arg) {
+    file_writer *writer = (file_writer *)arg;
+    pthread_mutex_lock(&(writer->lock));
+    while (1) {
+        while (writer->count == 0 && !writer->finishing) {
+            pthread_cond_wait(&(writer->queued), &(writer->lock));
+        }
+        if (writer->count == 0) break;
+        const unsigned ind = writer->head;
+        const int failed = writer->failed;
+        pthread_mutex_unlock(&(writer->lock));
+        // after a failure, the buffers are dropped without writing so that the caller does not wait on them
+        int status = failed || fwrite(writer->bufs[ind], 1, writer->lens[ind], writer->file) < writer->lens[ind];
+        pthread_mutex_lock(&(writer->lock));
+        if (status) writer->failed = 1;
+        writer->head = (ind + 1) % FILE_WRITER_BUF_CNT;
+        writer->count--;
+        pthread_cond_signal(&(writer->written));
+    }
+    pthread_mutex_unlock(&(writer->lock));
+    return NULL;
+}
+
+file_writer *file_writer_start(FILE *file) {
+    file_writer *writer = malloc(sizeof(file_writer));
+    if (!writer) return NULL;
+    writer->file = file;
+    for (unsigned i = 0; i < FILE_WRITER_BUF_CNT; i++) writer->bufs[i] = NULL;
+    writer->head = 0;
+    writer->count = 0;
+    writer->finishing = 0;
+    writer->failed = 0;
+    if (pthread_mutex_init(&(writer->lock), NULL)) {
+        free(writer);
+        return NULL;
+    }
+    if (pthread_cond_init(&(writer->queued), NULL)) {
+        pthread_mutex_destroy(&(writer->lock));
+        free(writer);
+        return NULL;
+    }
+    if (pthread_cond_init(&(writer->written), NULL)) {
+        pthread_cond_destroy(&(writer->queued));
+        pthread_mutex_destroy(&(writer->lock));
+        free(writer);
+        return NULL;
+    }
+    if (pthread_create(&(writer->thread), NULL, &_write_bufs, writer)) {
+        pthread_cond_destroy(&(writer->written));
+        pthread_cond_destroy(&(writer->queued));
+        pthread_mutex_destroy(&(writer->lock));
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+char *file_writer_buffer(file_writer *writer) {
+    pthread_mutex_lock(&(writer->lock));
+    while (writer->count == FILE_WRITER_BUF_CNT && !writer->failed) {
+        pthread_cond_wait(&(writer->written), &(writer->lock));
+    }
+    const int failed = writer->failed;
+    const unsigned tail = (writer->head + writer->count) % FILE_WRITER_BUF_CNT;
+    pthread_mutex_unlock(&(writer->lock));
+    if (failed) return NULL;
+    // the buffer at tail is not accessed by the thread until it is submitted
+    if (!writer->bufs[tail]) writer->bufs[tail] = _alloc_buf();
+    return writer->bufs[tail];
+}
+
+void file_writer_submit(file_writer *writer, size_t len) {
+    pthread_mutex_lock(&(writer->lock));
+    writer->lens[(writer->head + writer->count) % FILE_WRITER_BUF_CNT] = len;
+    writer->count++;
+    pthread_cond_signal(&(writer->queued));
+    pthread_mutex_unlock(&(writer->lock));
+}
+
+int file_writer_finish(file_writer *writer) {
+    pthread_mutex_lock(&(writer->lock));
+    writer->finishing = 1;
+    pthread_cond_signal(&(writer->queued));
+    pthread_mutex_unlock(&(writer->lock));
+    pthread_join(writer->thread, NULL);
+    const int failed = writer->failed;
+    for (unsigned i = 0; i < FILE_WRITER_BUF_CNT; i++) {
+        if (writer->bufs[i]) _free_buf(writer->bufs[i]);
+    }
+    pthread_cond_destroy(&(writer->written));
+    pthread_cond_destroy(&(writer->queued));
+    pthread_mutex_destroy(&(writer->lock));
+    free(writer);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/*
+ * utils/file_writer.h - header for writing received files in a separate thread
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_FILE_WRITER_H_
+#define UTILS_FILE_WRITER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+// size of each buffer of the writer
+#define FILE_WRITER_BUF_SIZE 1048576
+// number of buffers of the writer, which bounds the data received ahead of the disk
+#define FILE_WRITER_BUF_CNT 8
+
+/*
+ * A session that writes buffers filled by the caller to a file in a separate thread
+ */
+typedef struct _file_writer file_writer;
+
+/*
+ * Start a thread that writes the buffers submitted to the writer to the file.
+ * returns the writer on success, or NULL on failure.
+ */
+extern file_writer *file_writer_start(FILE *file);
+
+/*
+ * Get the next buffer of FILE_WRITER_BUF_SIZE bytes to be filled. Waits until a buffer is written if all buffers are
+ * waiting to be written.
+ * returns the buffer on success, or NULL if writing to the file has failed or the buffer could not be allocated.
+ */
+extern char *file_writer_buffer(file_writer *writer);
+
+/*
+ * Queue the first len bytes of the buffer last returned by file_writer_buffer to be written to the file.
+ */
+extern void file_writer_submit(file_writer *writer, size_t len);
+
+/*
+ * Wait until the queued buffers are written, stop the thread, and free the writer. The file is not closed.
+ * returns EXIT_SUCCESS if all submitted buffers were written, or EXIT_FAILURE otherwise.
+ */
+extern int file_writer_finish(file_writer *writer);
+
+#endif  // UTILS_FILE_WRITER_H_
@@ -0,0 +1,166 @@
+/*
+ * utils/hash.c - platform independent implementation of XXH64 hash
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <utils/hash.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t _read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t _read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t _round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t _merge_round(uint64_t acc, uint64_t val) {
+    acc ^= _round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/*
+ * Process the remaining bytes (less than 32) and mix the final hash value.
+ */
+static inline uint64_t _finalize(uint64_t h, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        h ^= _round(0, _read64(p));
+        h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)_read32(p) * PRIME64_1;
+        h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h ^= (*p) * PRIME64_5;
+        h = ROTL64(h, 11) * PRIME64_1;
+        p++;
+        len--;
+    }
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+void hash64_init(hash64_state *state, uint64_t seed) {
+    state->total_len = 0;
+    state->mem_size = 0;
+    state->seed = seed;
+    state->v[0] = seed + PRIME64_1 + PRIME64_2;
+    state->v[1] = seed + PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - PRIME64_1;
+}
+
+void hash64_update(hash64_state *state, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *const end = p + len;
+    state->total_len += len;
+
+    if (state->mem_size + len < 32) {  // not enough for a full stripe. buffer it
+        memcpy(state->mem + state->mem_size, p, len);
+        state->mem_size += (uint32_t)len;
+        return;
+    }
+    if (state->mem_size) {  // complete the buffered stripe first
+        const size_t fill = 32 - state->mem_size;
+        memcpy(state->mem + state->mem_size, p, fill);
+        p += fill;
+        for (unsigned i = 0; i < 4; i++) {
+            state->v[i] = _round(state->v[i], _read64(state->mem + i * 8));
+        }
+        state->mem_size = 0;
+    }
+    if (p + 32 <= end) {
+        uint64_t v1 = state->v[0];
+        uint64_t v2 = state->v[1];
+        uint64_t v3 = state->v[2];
+        uint64_t v4 = state->v[3];
+        const unsigned char *const limit = end - 32;
+        do {
+            v1 = _round(v1, _read64(p));
+            v2 = _round(v2, _read64(p + 8));
+            v3 = _round(v3, _read64(p + 16));
+            v4 = _round(v4, _read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        state->v[0] = v1;
+        state->v[1] = v2;
+        state->v[2] = v3;
+        state->v[3] = v4;
+    }
+    if (p < end) {
+        state->mem_size = (uint32_t)(end - p);
+        memcpy(state->mem, p, state->mem_size);
+    }
+}
+
+uint64_t hash64_digest(const hash64_state *state) {
+    uint64_t h;
+    if (state->total_len >= 32) {
+        const uint64_t v1 = state->v[0];
+        const uint64_t v2 = state->v[1];
+        const uint64_t v3 = state->v[2];
+        const uint64_t v4 = state->v[3];
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = _merge_round(h, v1);
+        h = _merge_round(h, v2);
+        h = _merge_round(h, v3);
+        h = _merge_round(h, v4);
+    } else {
+        h = state->seed + PRIME64_5;
+    }
+    h += state->total_len;
+    return _finalize(h, state->mem, state->mem_size);
+}
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed) {
+    hash64_state state;
+    hash64_init(&state, seed);
+    hash64_update(&state, data, len);
+    return hash64_digest(&state);
+}
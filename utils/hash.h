@@ -0,0 +1,57 @@
+/*
+ * utils/hash.h - header for fast non-cryptographic hashing
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_HASH_H_
+#define UTILS_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * State of an incremental XXH64 hash computation.
+ * Initialize with hash64_init(), feed data with hash64_update(), and get the result with hash64_digest().
+ */
+typedef struct _hash64_state {
+    uint64_t total_len;
+    uint64_t v[4];
+    unsigned char mem[32];
+    uint32_t mem_size;
+    uint64_t seed;
+} hash64_state;
+
+/*
+ * Initialize the hash state with the given seed.
+ */
+extern void hash64_init(hash64_state *state, uint64_t seed);
+
+/*
+ * Feed len bytes from data into the hash state.
+ */
+extern void hash64_update(hash64_state *state, const void *data, size_t len);
+
+/*
+ * Get the hash value of all the data fed into the state so far. This does not modify the state.
+ */
+extern uint64_t hash64_digest(const hash64_state *state);
+
+/*
+ * Compute the XXH64 hash of len bytes from data with the given seed.
+ */
+extern uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+#endif  // UTILS_HASH_H_
@@ -25,6 +25,7 @@
 #import <stddef.h>
 #import <stdint.h>
 #import <string.h>
+#import <utils/text_history.h>
 #import <utils/utils.h>
 
 #if !__has_feature(objc_arc)
@@ -174,4 +175,38 @@ int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
     return EXIT_SUCCESS;
 }
 
+int get_screenshot_delta(uint16_t disp, uint64_t base_frame, screenshot_delta *delta) {
+    (void)disp;
+    (void)base_frame;
+    delta->tiles = NULL;
+    return EXIT_FAILURE;
+}
+
+int get_screenshot_region(uint16_t disp, const capture_region *region, char **buf_ptr, uint32_t *len_ptr) {
+    (void)disp;
+    (void)region;
+    *buf_ptr = NULL;
+    *len_ptr = 0;
+    return EXIT_FAILURE;
+}
+
+screen_stream *start_screen_stream(uint16_t disp, uint32_t max_fps) {
+    (void)disp;
+    (void)max_fps;
+    return NULL;
+}
+
+int get_stream_frame(screen_stream *stream, char **buf_ptr, uint32_t *len_ptr) {
+    (void)stream;
+    *buf_ptr = NULL;
+    *len_ptr = 0;
+    return EXIT_FAILURE;
+}
+
+void stop_screen_stream(screen_stream *stream) { (void)stream; }
+
+list2 *get_displays(void) { return NULL; }
+
+void init_server_state(void) { text_history_init(); }
+
 #endif
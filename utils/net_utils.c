@@ -28,12 +28,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <utils/file_map.h>
 #include <utils/list_utils.h>
 #include <utils/net_utils.h>
+#include <utils/uring_io.h>
 #include <utils/utils.h>
 
 #if defined(__linux__) || defined(__APPLE__)
 #include <arpa/inet.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #elif defined(_WIN32)
@@ -591,6 +594,47 @@ int write_sock(socket_t *socket, const char *buf, uint64_t size) {
     return EXIT_SUCCESS;
 }
 
+#if defined(__linux__) || defined(__APPLE__)
+static int _write_sock_chunk(void *arg, const char *data, size_t len) {
+    return write_sock((socket_t *)arg, data, (uint64_t)len);
+}
+#endif
+
+int write_sock_from_file(socket_t *socket, FILE *fp, int64_t num) {
+    int status = DIRECT_IO_UNAVAILABLE;
+#ifdef __linux__
+    if (socket->type == PLAIN_SOCK && num >= URING_MIN_FILE_SIZE) {
+        status = uring_send_file(socket->socket.plain, fp, num);
+        if (status == URING_UNAVAILABLE) status = DIRECT_IO_UNAVAILABLE;
+    }
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+    if (socket->type == SSL_SOCK && num >= FILE_MAP_MIN_SIZE) {
+        // OpenSSL encrypts the mapped pages into its records without the copy into a read buffer
+        status = map_file_chunked(fp, num, &_write_sock_chunk, socket);
+        if (status == FILE_MAP_UNAVAILABLE) status = DIRECT_IO_UNAVAILABLE;
+    }
+#else
+    (void)socket;
+    (void)fp;
+    (void)num;
+#endif
+    return status;
+}
+
+int read_sock_to_file(socket_t *socket, FILE *fp, int64_t num) {
+#ifdef __linux__
+    if (socket->type != PLAIN_SOCK || num < URING_MIN_FILE_SIZE) return DIRECT_IO_UNAVAILABLE;
+    const int status = uring_receive_file(socket->socket.plain, fp, num);
+    return status == URING_UNAVAILABLE ? DIRECT_IO_UNAVAILABLE : status;
+#else
+    (void)socket;
+    (void)fp;
+    (void)num;
+    return DIRECT_IO_UNAVAILABLE;
+#endif
+}
+
 int send_size(socket_t *socket, int64_t size) {
     char sz_buf[8];
     int64_t sz = size;
@@ -616,3 +660,35 @@ int read_size(socket_t *socket, int64_t *size_ptr) {
     *size_ptr = size;
     return EXIT_SUCCESS;
 }
+
+int poll_sock(socket_t *socket, int timeout_ms) {
+    sock_t sock;
+    switch (socket->type) {
+        case PLAIN_SOCK: {
+            sock = socket->socket.plain;
+            break;
+        }
+#ifndef NO_SSL
+        case SSL_SOCK: {
+            if (SSL_pending(socket->socket.ssl) > 0) return SOCK_READABLE;
+            sock = (sock_t)SSL_get_fd(socket->socket.ssl);
+            break;
+        }
+#endif
+        default:
+            return -1;
+    }
+#if defined(__linux__) || defined(__APPLE__)
+    struct pollfd pfd = {.fd = sock, .events = POLLIN | POLLOUT, .revents = 0};
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0 && errno == EINTR) return 0;
+#elif defined(_WIN32)
+    WSAPOLLFD pfd = {.fd = sock, .events = POLLIN | POLLOUT, .revents = 0};
+    int ret = WSAPoll(&pfd, 1, timeout_ms);
+#endif
+    if (ret < 0 || (pfd.revents & (POLLERR | POLLNVAL))) return -1;
+    int status = 0;
+    if (pfd.revents & (POLLIN | POLLHUP)) status |= SOCK_READABLE;
+    if (pfd.revents & POLLOUT) status |= SOCK_WRITABLE;
+    return status;
+}
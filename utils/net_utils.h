@@ -24,6 +24,7 @@
 #endif
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <utils/list_utils.h>
 
@@ -46,6 +47,13 @@ typedef SOCKET sock_t;
 #define SSL_SOCK 2
 #define UDP_SOCK 127
 
+// status flags returned by poll_sock
+#define SOCK_READABLE 1
+#define SOCK_WRITABLE 2
+
+// returned by write_sock_from_file and read_sock_to_file when the file cannot be transferred directly
+#define DIRECT_IO_UNAVAILABLE -1
+
 typedef struct _socket_t {
     union {
         sock_t plain;
@@ -135,6 +143,23 @@ extern int read_sock_no_wait(socket_t *socket, char *buf, size_t num);
  */
 extern int write_sock(socket_t *socket, const char *buf, uint64_t num);
 
+/*
+ * Writes num bytes of the file opened as fp, from its current position, to the socket without copying the file through
+ * a buffer. Plain sockets on Linux use io_uring, and TLS sockets on Linux and macOS encrypt directly from the file
+ * mapped into memory.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure. returns DIRECT_IO_UNAVAILABLE if neither can be used,
+ * in which case nothing is written and the caller should fall back to write_sock.
+ */
+extern int write_sock_from_file(socket_t *socket, FILE *fp, int64_t num);
+
+/*
+ * Reads num bytes from the socket and writes them to the file opened as fp, from its current position, using io_uring
+ * for plain sockets on Linux.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure. returns DIRECT_IO_UNAVAILABLE if io_uring cannot be
+ * used, in which case nothing is read and the caller should fall back to read_sock.
+ */
+extern int read_sock_to_file(socket_t *socket, FILE *fp, int64_t num);
+
 /*
  * Sends a 64-bit signed integer num to socket as big-endian encoded 8 bytes.
  * returns EXIT_SUCCESS on success. Otherwise, returns EXIT_FAILURE on error.
@@ -148,4 +173,11 @@ extern int send_size(socket_t *socket, int64_t num);
  */
 extern int read_size(socket_t *socket, int64_t *size_ptr);
 
+/*
+ * Waits up to timeout_ms milliseconds until the socket is readable or writable.
+ * A socket closed by the peer is reported as readable.
+ * returns a combination of SOCK_READABLE and SOCK_WRITABLE flags, which is 0 on timeout. returns -1 on error.
+ */
+extern int poll_sock(socket_t *socket, int timeout_ms);
+
 #endif  // UTILS_NET_UTILS_H_
@@ -0,0 +1,241 @@
+/*
+ * utils/read_ahead.c - platform independent reading of files ahead of sending them in separate threads
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/read_ahead.h>
+#include <utils/utils.h>
+
+/*
+ * A bounded queue of paths to be prefetched. Paths added while the queue is full are dropped, so that adding never
+ * waits on the disk.
+ */
+struct _file_prefetch {
+    pthread_t thread;
+    // the fields below are protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t added;  // signalled when a path is added or the prefetch is stopped
+    char *paths[FILE_PREFETCH_AHEAD];
+    unsigned head;
+    unsigned count;
+    int stopped;
+};
+
+/*
+ * A ring of buffers. The thread fills the buffer after the ones read while the caller sends the buffer at head.
+ */
+struct _file_reader {
+    FILE *file;
+    int64_t remaining;  // used only by the thread
+    pthread_t thread;
+    char *bufs[FILE_READER_BUF_CNT];
+    size_t lens[FILE_READER_BUF_CNT];
+    // the fields below are protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t filled;  // signalled when a buffer is read, or reading ends or fails
+    pthread_cond_t taken;   // signalled when a buffer is given back or the reader is stopped
+    unsigned head;
+    unsigned count;  // number of buffers read, including the one held by the caller
+    int holding;     // whether the caller holds the buffer at head
+    int done;
+    int failed;
+    int stopped;
+};
+
+static void *_prefetch_files(void *arg) {
+    file_prefetch *prefetch = (file_prefetch *)arg;
+    pthread_mutex_lock(&(prefetch->lock));
+    while (1) {
+        while (prefetch->count == 0 && !prefetch->stopped) {
+            pthread_cond_wait(&(prefetch->added), &(prefetch->lock));
+        }
+        if (prefetch->stopped) break;
+        char *path = prefetch->paths[prefetch->head];
+        prefetch->head = (prefetch->head + 1) % FILE_PREFETCH_AHEAD;
+        prefetch->count--;
+        pthread_mutex_unlock(&(prefetch->lock));
+        // the read ahead continues in the operating system after the file is closed
+        FILE *fp = open_file(path, "rb");
+        if (fp) {
+            advise_read_ahead(fp, FILE_PREFETCH_SIZE);
+            fclose(fp);
+        }
+        free(path);
+        pthread_mutex_lock(&(prefetch->lock));
+    }
+    pthread_mutex_unlock(&(prefetch->lock));
+    return NULL;
+}
+
+file_prefetch *file_prefetch_start(void) {
+    file_prefetch *prefetch = malloc(sizeof(file_prefetch));
+    if (!prefetch) return NULL;
+    prefetch->head = 0;
+    prefetch->count = 0;
+    prefetch->stopped = 0;
+    if (pthread_mutex_init(&(prefetch->lock), NULL)) {
+        free(prefetch);
+        return NULL;
+    }
+    if (pthread_cond_init(&(prefetch->added), NULL)) {
+        pthread_mutex_destroy(&(prefetch->lock));
+        free(prefetch);
+        return NULL;
+    }
+    if (pthread_create(&(prefetch->thread), NULL, &_prefetch_files, prefetch)) {
+        pthread_cond_destroy(&(prefetch->added));
+        pthread_mutex_destroy(&(prefetch->lock));
+        free(prefetch);
+        return NULL;
+    }
+    return prefetch;
+}
+
+void file_prefetch_add(file_prefetch *prefetch, const char *path) {
+    if (!prefetch || !path) return;
+    pthread_mutex_lock(&(prefetch->lock));
+    if (prefetch->count < FILE_PREFETCH_AHEAD) {
+        char *copy = strdup(path);
+        if (copy) {
+            prefetch->paths[(prefetch->head + prefetch->count) % FILE_PREFETCH_AHEAD] = copy;
+            prefetch->count++;
+            pthread_cond_signal(&(prefetch->added));
+        }
+    }
+    pthread_mutex_unlock(&(prefetch->lock));
+}
+
+void file_prefetch_stop(file_prefetch *prefetch) {
+    pthread_mutex_lock(&(prefetch->lock));
+    prefetch->stopped = 1;
+    pthread_cond_signal(&(prefetch->added));
+    pthread_mutex_unlock(&(prefetch->lock));
+    pthread_join(prefetch->thread, NULL);
+    for (unsigned i = 0; i < prefetch->count; i++) {
+        free(prefetch->paths[(prefetch->head + i) % FILE_PREFETCH_AHEAD]);
+    }
+    pthread_cond_destroy(&(prefetch->added));
+    pthread_mutex_destroy(&(prefetch->lock));
+    free(prefetch);
+}
+
+static void *_read_bufs(void *arg) {
+    file_reader *reader = (file_reader *)arg;
+    pthread_mutex_lock(&(reader->lock));
+    while (reader->remaining > 0) {
+        while (reader->count == FILE_READER_BUF_CNT && !reader->stopped) {
+            pthread_cond_wait(&(reader->taken), &(reader->lock));
+        }
+        if (reader->stopped) break;
+        const unsigned tail = (reader->head + reader->count) % FILE_READER_BUF_CNT;
+        pthread_mutex_unlock(&(reader->lock));
+        // the buffer at tail is not accessed by the caller until it is counted
+        if (!reader->bufs[tail]) reader->bufs[tail] = malloc(FILE_READER_BUF_SIZE);
+        const size_t len =
+            reader->remaining < FILE_READER_BUF_SIZE ? (size_t)reader->remaining : FILE_READER_BUF_SIZE;
+        const int status = reader->bufs[tail] && fread(reader->bufs[tail], 1, len, reader->file) == len;
+        pthread_mutex_lock(&(reader->lock));
+        if (!status) {
+            reader->failed = 1;
+            break;
+        }
+        reader->lens[tail] = len;
+        reader->count++;
+        reader->remaining -= (int64_t)len;
+        pthread_cond_signal(&(reader->filled));
+    }
+    reader->done = 1;
+    pthread_cond_signal(&(reader->filled));
+    pthread_mutex_unlock(&(reader->lock));
+    return NULL;
+}
+
+file_reader *file_reader_start(FILE *file, int64_t size) {
+    file_reader *reader = malloc(sizeof(file_reader));
+    if (!reader) return NULL;
+    reader->file = file;
+    reader->remaining = size;
+    for (unsigned i = 0; i < FILE_READER_BUF_CNT; i++) reader->bufs[i] = NULL;
+    reader->head = 0;
+    reader->count = 0;
+    reader->holding = 0;
+    reader->done = 0;
+    reader->failed = 0;
+    reader->stopped = 0;
+    if (pthread_mutex_init(&(reader->lock), NULL)) {
+        free(reader);
+        return NULL;
+    }
+    if (pthread_cond_init(&(reader->filled), NULL)) {
+        pthread_mutex_destroy(&(reader->lock));
+        free(reader);
+        return NULL;
+    }
+    if (pthread_cond_init(&(reader->taken), NULL)) {
+        pthread_cond_destroy(&(reader->filled));
+        pthread_mutex_destroy(&(reader->lock));
+        free(reader);
+        return NULL;
+    }
+    if (pthread_create(&(reader->thread), NULL, &_read_bufs, reader)) {
+        pthread_cond_destroy(&(reader->taken));
+        pthread_cond_destroy(&(reader->filled));
+        pthread_mutex_destroy(&(reader->lock));
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+const char *file_reader_next(file_reader *reader, size_t *len_p) {
+    pthread_mutex_lock(&(reader->lock));
+    if (reader->holding) {
+        reader->head = (reader->head + 1) % FILE_READER_BUF_CNT;
+        reader->count--;
+        reader->holding = 0;
+        pthread_cond_signal(&(reader->taken));
+    }
+    while (reader->count == 0 && !reader->done) {
+        pthread_cond_wait(&(reader->filled), &(reader->lock));
+    }
+    const char *buf = NULL;
+    // buffers read before a failure are not taken, since the file cannot be sent completely
+    if (reader->count > 0 && !reader->failed) {
+        buf = reader->bufs[reader->head];
+        *len_p = reader->lens[reader->head];
+        reader->holding = 1;
+    }
+    pthread_mutex_unlock(&(reader->lock));
+    return buf;
+}
+
+void file_reader_stop(file_reader *reader) {
+    pthread_mutex_lock(&(reader->lock));
+    reader->stopped = 1;
+    pthread_cond_signal(&(reader->taken));
+    pthread_mutex_unlock(&(reader->lock));
+    pthread_join(reader->thread, NULL);
+    for (unsigned i = 0; i < FILE_READER_BUF_CNT; i++) {
+        if (reader->bufs[i]) free(reader->bufs[i]);
+    }
+    pthread_cond_destroy(&(reader->taken));
+    pthread_cond_destroy(&(reader->filled));
+    pthread_mutex_destroy(&(reader->lock));
+    free(reader);
+}
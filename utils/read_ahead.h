@@ -0,0 +1,80 @@
+/*
+ * utils/read_ahead.h - header for reading files ahead of sending them in separate threads
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_READ_AHEAD_H_
+#define UTILS_READ_AHEAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// number of files after the one being sent that are prefetched
+#define FILE_PREFETCH_AHEAD 8
+// number of bytes at the start of each file that are prefetched
+#define FILE_PREFETCH_SIZE 2097152
+// size of each buffer of the reader
+#define FILE_READER_BUF_SIZE 1048576
+// number of buffers of the reader, which bounds the data read ahead of the socket
+#define FILE_READER_BUF_CNT 4
+
+/*
+ * A session that opens files in a separate thread and asks the operating system to read them ahead
+ */
+typedef struct _file_prefetch file_prefetch;
+
+/*
+ * A session that reads a file into buffers in a separate thread, while the caller sends the buffers already read
+ */
+typedef struct _file_reader file_reader;
+
+/*
+ * Start a thread that prefetches the files added to the prefetch.
+ * returns the prefetch on success, or NULL on failure.
+ */
+extern file_prefetch *file_prefetch_start(void);
+
+/*
+ * Queue the file to be prefetched. Does nothing if prefetch or path is NULL, or if FILE_PREFETCH_AHEAD files are
+ * already waiting. The path is copied, and is not used after returning.
+ */
+extern void file_prefetch_add(file_prefetch *prefetch, const char *path);
+
+/*
+ * Stop the thread and free the prefetch with the files not prefetched yet.
+ */
+extern void file_prefetch_stop(file_prefetch *prefetch);
+
+/*
+ * Start a thread that reads the next size bytes of the file into the buffers of the reader.
+ * returns the reader on success, or NULL on failure.
+ */
+extern file_reader *file_reader_start(FILE *file, int64_t size);
+
+/*
+ * Take the next buffer read from the file, and set its length at len_p. Waits until the buffer is read if it is not
+ * read yet. The buffer returned by the previous call is given back to the reader.
+ * returns the buffer, or NULL if all size bytes are taken or reading the file has failed.
+ */
+extern const char *file_reader_next(file_reader *reader, size_t *len_p);
+
+/*
+ * Stop the thread and free the reader. The file is not closed.
+ */
+extern void file_reader_stop(file_reader *reader);
+
+#endif  // UTILS_READ_AHEAD_H_
@@ -0,0 +1,142 @@
+/*
+ * utils/text_history.c - platform independent history of sent text
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <globals.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/text_history.h>
+#include <utils/utils.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+typedef struct _text_version {
+    uint64_t hash;
+    uint32_t len;  // 0 if the slot is empty
+} text_version;
+
+/*
+ * The history is followed by TEXT_HISTORY_LEN slots of capacity bytes each, holding the texts.
+ */
+typedef struct _text_history {
+    pthread_mutex_t lock;
+    uint32_t capacity;
+    uint32_t next_slot;
+    text_version versions[TEXT_HISTORY_LEN];
+} text_history;
+
+// connection handlers are forked processes on Linux and macOS, which share this memory, and threads on Windows
+static text_history *history = NULL;
+
+static inline char *_slot_data(uint32_t slot) {
+    return (char *)history + sizeof(text_history) + (size_t)slot * history->capacity;
+}
+
+void text_history_init(void) {
+    if (history) return;
+    const uint32_t capacity = configuration.max_text_length;
+    const size_t size = sizeof(text_history) + (size_t)capacity * TEXT_HISTORY_LEN;
+#if defined(__linux__) || defined(__APPLE__)
+    // pages of the slots are not allocated until texts are written to them
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        error("Failed allocating shared memory for text history");
+        return;
+    }
+#elif defined(_WIN32)
+    void *mem = malloc(size);
+    if (!mem) return;
+#endif
+    text_history *hist = (text_history *)mem;
+    pthread_mutexattr_t attr;
+    int status = pthread_mutexattr_init(&attr);
+#if defined(__linux__) || defined(__APPLE__)
+    if (!status) status = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#endif
+#ifdef __linux__
+    if (!status) status = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+    if (!status) status = pthread_mutex_init(&(hist->lock), &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (status) {
+#if defined(__linux__) || defined(__APPLE__)
+        munmap(mem, size);
+#elif defined(_WIN32)
+        free(mem);
+#endif
+        return;
+    }
+    hist->capacity = capacity;
+    hist->next_slot = 0;
+    for (unsigned i = 0; i < TEXT_HISTORY_LEN; i++) hist->versions[i].len = 0;
+    history = hist;
+}
+
+/*
+ * Lock the history. If a process died while holding the lock, the history is cleared.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _lock_history(void) {
+    int status = pthread_mutex_lock(&(history->lock));
+#ifdef __linux__
+    if (status == EOWNERDEAD) {
+        for (unsigned i = 0; i < TEXT_HISTORY_LEN; i++) history->versions[i].len = 0;
+        pthread_mutex_consistent(&(history->lock));
+        return EXIT_SUCCESS;
+    }
+#endif
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void text_history_add(const char *text, uint32_t len, uint64_t hash) {
+    if (!history || len == 0 || len > history->capacity) return;
+    if (_lock_history() != EXIT_SUCCESS) return;
+    for (uint32_t i = 0; i < TEXT_HISTORY_LEN; i++) {
+        const text_version *version = &(history->versions[i]);
+        if (version->len == len && version->hash == hash) {
+            pthread_mutex_unlock(&(history->lock));
+            return;
+        }
+    }
+    const uint32_t slot = history->next_slot;
+    memcpy(_slot_data(slot), text, len);
+    history->versions[slot].hash = hash;
+    history->versions[slot].len = len;
+    history->next_slot = (slot + 1) % TEXT_HISTORY_LEN;
+    pthread_mutex_unlock(&(history->lock));
+}
+
+char *text_history_get(uint64_t hash, uint32_t *len_p) {
+    if (!history || _lock_history() != EXIT_SUCCESS) return NULL;
+    char *text = NULL;
+    for (uint32_t i = 0; i < TEXT_HISTORY_LEN; i++) {
+        const text_version *version = &(history->versions[i]);
+        if (version->len == 0 || version->hash != hash) continue;
+        text = malloc(version->len);
+        if (text) {
+            memcpy(text, _slot_data(i), version->len);
+            *len_p = version->len;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&(history->lock));
+    return text;
+}
@@ -0,0 +1,47 @@
+/*
+ * utils/text_history.h - header for the history of sent text
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_TEXT_HISTORY_H_
+#define UTILS_TEXT_HISTORY_H_
+
+#include <stdint.h>
+
+// number of recent text versions kept in the history
+#define TEXT_HISTORY_LEN 4
+
+/*
+ * Allocate the history of recent text versions, with space for TEXT_HISTORY_LEN texts of at most
+ * configuration.max_text_length bytes each, in memory shared with the connection handlers.
+ * Must be called before forking the connection handlers. If this fails, the history is not kept.
+ */
+extern void text_history_init(void);
+
+/*
+ * Add the text of len bytes, which has the given hash, to the history unless it is already there. The oldest text is
+ * dropped when the history is full.
+ */
+extern void text_history_add(const char *text, uint32_t len, uint64_t hash);
+
+/*
+ * Get a copy of the text with the given hash from the history.
+ * returns the text, which should be freed by the caller, and sets *len_p to its length, or returns NULL if the text is
+ * not in the history.
+ */
+extern char *text_history_get(uint64_t hash, uint32_t *len_p);
+
+#endif  // UTILS_TEXT_HISTORY_H_
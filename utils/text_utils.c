@@ -0,0 +1,224 @@
+/*
+ * utils/text_utils.c - platform independent UTF-8 validation and line ending conversion
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/text_utils.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+#endif
+
+/*
+ * Function to find the length of the prefix of p, of at most n bytes, that has no byte equal to stop or '\0', and no
+ * byte with the most significant bit set if high is non-zero. These are the bytes that need no special handling, which
+ * are copied as they are.
+ */
+typedef size_t (*plain_len_fn)(const unsigned char *p, size_t n, unsigned char stop, int high);
+
+static size_t _plain_len_scalar(const unsigned char *p, size_t n, unsigned char stop, int high) {
+    const unsigned char high_mask = high ? 0x80 : 0;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        const unsigned char c = p[i];
+        if (c == stop || c == 0 || (c & high_mask)) break;
+    }
+    return i;
+}
+
+#ifdef __SSE2__
+static size_t _plain_len_sse2(const unsigned char *p, size_t n, unsigned char stop, int high) {
+    const __m128i stop_v = _mm_set1_epi8((char)stop);
+    const __m128i zero_v = _mm_setzero_si128();
+    const unsigned high_mask = high ? 0xFFFFU : 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, stop_v), _mm_cmpeq_epi8(v, zero_v));
+        const unsigned mask = (unsigned)_mm_movemask_epi8(special) | ((unsigned)_mm_movemask_epi8(v) & high_mask);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    return i + _plain_len_scalar(p + i, n - i, stop, high);
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2"))) static size_t _plain_len_avx2(const unsigned char *p, size_t n, unsigned char stop,
+                                                                int high) {
+    const __m256i stop_v = _mm256_set1_epi8((char)stop);
+    const __m256i zero_v = _mm256_setzero_si256();
+    const unsigned high_mask = high ? 0xFFFFFFFFU : 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        const __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(v, stop_v), _mm256_cmpeq_epi8(v, zero_v));
+        const unsigned mask =
+            (unsigned)_mm256_movemask_epi8(special) | ((unsigned)_mm256_movemask_epi8(v) & high_mask);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    return i + _plain_len_sse2(p + i, n - i, stop, high);
+}
+#endif
+
+/*
+ * Select the fastest implementation supported by the CPU. The selection is done once.
+ */
+static plain_len_fn _get_plain_len(void) {
+    static plain_len_fn plain_len = NULL;
+    if (plain_len) return plain_len;
+#if defined(HAVE_AVX2_KERNEL)
+    plain_len = __builtin_cpu_supports("avx2") ? &_plain_len_avx2 : &_plain_len_sse2;
+#elif defined(__SSE2__)
+    plain_len = &_plain_len_sse2;
+#else
+    plain_len = &_plain_len_scalar;
+#endif
+    return plain_len;
+}
+
+/*
+ * Get the length of the valid UTF-8 encoded character at p, which has at most n bytes.
+ * returns the length in bytes, or 0 if it is not a valid UTF-8 sequence.
+ */
+static inline size_t _utf8_seq_len(const unsigned char *p, size_t n) {
+    const unsigned char c = p[0];
+    if (c < 0x80) return 1;
+    if (c < 0xC2) return 0;  // continuation byte or overlong 2-byte sequence
+    if (c < 0xE0) {
+        if (n < 2 || (p[1] & 0xC0) != 0x80) return 0;
+        return 2;
+    }
+    if (c < 0xF0) {
+        if (n < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80) return 0;
+        if (c == 0xE0 && p[1] < 0xA0) return 0;   // overlong
+        if (c == 0xED && p[1] >= 0xA0) return 0;  // surrogate
+        return 3;
+    }
+    if (c < 0xF5) {
+        if (n < 4 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80 || (p[3] & 0xC0) != 0x80) return 0;
+        if (c == 0xF0 && p[1] < 0x90) return 0;   // overlong
+        if (c == 0xF4 && p[1] >= 0x90) return 0;  // above U+10FFFF
+        return 4;
+    }
+    return 0;
+}
+
+int utf8_validate(const char *data, size_t len) {
+    const plain_len_fn plain_len = _get_plain_len();
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i = 0;
+    while (i < len) {
+        i += plain_len(p + i, len - i, 0, 1);
+        if (i >= len) break;
+        const size_t seq = _utf8_seq_len(p + i, len - i);
+        if (!seq) return EXIT_FAILURE;
+        i += seq;
+    }
+    return EXIT_SUCCESS;
+}
+
+int64_t text_to_lf(char *str, size_t len, int validate) {
+    const plain_len_fn plain_len = _get_plain_len();
+    // converting to LF shrinks the string. Therefore, the output never overtakes the input
+    unsigned char *buf = (unsigned char *)str;
+    size_t in = 0;
+    size_t out = 0;
+    while (in < len) {
+        const size_t cnt = plain_len(buf + in, len - in, '\r', validate);
+        if (cnt) {
+            if (out != in) memmove(buf + out, buf + in, cnt);
+            in += cnt;
+            out += cnt;
+            if (in >= len) break;
+        }
+        const unsigned char c = buf[in];
+        if (c == 0) {
+            if (validate && utf8_validate(str + in, len - in) != EXIT_SUCCESS) return -1;
+            break;
+        }
+        if (c == '\r') {
+            in++;
+            // drop the \r of \r\n
+            if (in < len && buf[in] == '\n') continue;
+            buf[out++] = c;
+            continue;
+        }
+        // a non-ASCII byte, which stops the scan only if validating
+        const size_t seq = _utf8_seq_len(buf + in, len - in);
+        if (!seq) return -1;
+        for (size_t j = 0; j < seq; j++) buf[out++] = buf[in++];
+    }
+    buf[out] = 0;
+    return (int64_t)out;
+}
+
+int64_t text_to_crlf(char **str_p, size_t len, int validate) {
+    const plain_len_fn plain_len = _get_plain_len();
+    const unsigned char *src = (const unsigned char *)*str_p;
+    size_t end = len;
+    size_t increase = 0;
+    size_t ind = 0;
+    // count the \n not preceded by \r, and validate in the same pass
+    while (ind < len) {
+        ind += plain_len(src + ind, len - ind, '\n', validate);
+        if (ind >= len) break;
+        const unsigned char c = src[ind];
+        if (c == 0) {
+            if (validate && utf8_validate(*str_p + ind, len - ind) != EXIT_SUCCESS) return -1;
+            end = ind;
+            break;
+        }
+        if (c == '\n') {
+            if (ind == 0 || src[ind - 1] != '\r') increase++;
+            ind++;
+            continue;
+        }
+        const size_t seq = _utf8_seq_len(src + ind, len - ind);
+        if (!seq) return -1;
+        ind += seq;
+    }
+    if (!increase) {
+        (*str_p)[end] = 0;
+        return (int64_t)end;
+    }
+
+    const size_t new_len = end + increase;
+    char *dest = malloc(new_len + 1);  // +1 for terminating '\0'
+    if (!dest) return -1;
+    size_t out = 0;
+    ind = 0;
+    while (ind < end) {
+        const size_t cnt = plain_len(src + ind, end - ind, '\n', 0);
+        memcpy(dest + out, src + ind, cnt);
+        ind += cnt;
+        out += cnt;
+        if (ind >= end) break;
+        // add the missing \r before \n
+        if (ind == 0 || src[ind - 1] != '\r') dest[out++] = '\r';
+        dest[out++] = '\n';
+        ind++;
+    }
+    dest[out] = 0;
+    free(*str_p);
+    *str_p = dest;
+    return (int64_t)out;
+}
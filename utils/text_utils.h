@@ -0,0 +1,50 @@
+/*
+ * utils/text_utils.h - header for UTF-8 validation and line ending conversion
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_TEXT_UTILS_H_
+#define UTILS_TEXT_UTILS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Check if len bytes from data are valid UTF-8. Overlong encodings, surrogates, and code points above U+10FFFF are
+ * not valid.
+ * returns EXIT_SUCCESS if valid, or EXIT_FAILURE otherwise.
+ */
+extern int utf8_validate(const char *data, size_t len);
+
+/*
+ * Convert CRLF line endings to LF, in place, in a buffer of len bytes followed by a terminating '\0'.
+ * The conversion stops at the first '\0' in the buffer, and the result is terminated with '\0'.
+ * If validate is non-zero, also checks that all len bytes are valid UTF-8 in the same pass.
+ * returns the length of the converted string without the terminating '\0', or -1 if the data is not valid UTF-8.
+ */
+extern int64_t text_to_lf(char *str, size_t len, int validate);
+
+/*
+ * Convert LF line endings that are not preceded by CR to CRLF, in a buffer of len bytes followed by a terminating
+ * '\0'. The conversion stops at the first '\0' in the buffer, and the result is terminated with '\0'.
+ * If validate is non-zero, also checks that all len bytes are valid UTF-8 in the same pass as finding the line endings.
+ * If the length increases, *str_p is replaced with a new buffer and the old buffer is freed.
+ * returns the length of the converted string without the terminating '\0', or -1 if the data is not valid UTF-8 or
+ * allocating memory failed. *str_p is not freed on failure.
+ */
+extern int64_t text_to_crlf(char **str_p, size_t len, int validate);
+
+#endif  // UTILS_TEXT_UTILS_H_
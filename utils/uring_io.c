@@ -0,0 +1,459 @@
+/*
+ * utils/uring_io.c - transferring files between sockets and disk with io_uring on Linux
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utils/uring_io.h>
+
+// headers older than Linux 5.7 do not have the operations and features used here
+#ifdef IORING_FEAT_FAST_POLL
+
+// number of submission queue entries, which is more than the requests in flight
+#define RING_ENTRIES 16
+
+// kinds of requests, kept in the upper half of the user data. The lower half is the buffer index
+#define REQ_FILE 1
+#define REQ_SOCK 2
+#define REQ_TIMEOUT 3
+
+// fixed file indices of the registered files
+#define FIXED_SOCK 0
+#define FIXED_FILE 1
+
+// support of the kernel, probed once in the listener so that the connection handlers inherit the result
+#define SUPPORT_UNKNOWN 0
+#define SUPPORT_OK 1
+#define SUPPORT_NONE 2
+
+static int uring_support = SUPPORT_UNKNOWN;
+
+static const struct __kernel_timespec sock_timeout = {.tv_sec = URING_SOCK_TIMEOUT_MS / 1000,
+                                                      .tv_nsec = (URING_SOCK_TIMEOUT_MS % 1000) * 1000000L};
+
+typedef struct _ring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *map;
+    size_t map_len;
+    size_t sqes_len;
+    unsigned to_submit;  // number of requests queued but not submitted yet
+    unsigned in_flight;  // number of requests submitted or queued whose completions are not taken yet
+    char *bufs;
+} ring;
+
+/*
+ * Check if the kernel supports all operations used for the transfers.
+ */
+static int _check_ops(int fd) {
+    const unsigned ops_len = 256;
+    struct io_uring_probe *probe = calloc(1, sizeof(struct io_uring_probe) + ops_len * sizeof(struct io_uring_probe_op));
+    if (!probe) return EXIT_FAILURE;
+    int status = EXIT_FAILURE;
+    if (!syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, ops_len)) {
+        const unsigned char needed[] = {IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_LINK_TIMEOUT};
+        status = EXIT_SUCCESS;
+        for (unsigned i = 0; i < sizeof(needed); i++) {
+            if (needed[i] >= probe->ops_len || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    free(probe);
+    return status;
+}
+
+void uring_probe(void) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    const int fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (fd < 0) {
+        __atomic_store_n(&uring_support, SUPPORT_NONE, __ATOMIC_RELAXED);
+        return;
+    }
+    // socket requests must not block the workers of the kernel while waiting for the client
+    const unsigned needed_features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_FAST_POLL;
+    const int supported = (params.features & needed_features) == needed_features && _check_ops(fd) == EXIT_SUCCESS;
+    close(fd);
+    __atomic_store_n(&uring_support, supported ? SUPPORT_OK : SUPPORT_NONE, __ATOMIC_RELAXED);
+}
+
+static void _ring_close(ring *r) {
+    if (r->map) munmap(r->map, r->map_len);
+    if (r->sqes) munmap(r->sqes, r->sqes_len);
+    close(r->fd);
+    if (r->bufs) free(r->bufs);
+}
+
+/*
+ * Set up a ring with the buffers and the socket and file registered.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _ring_open(ring *r, int sock, int file_fd) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    r->fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (r->fd < 0) return EXIT_FAILURE;
+    r->map = NULL;
+    r->sqes = NULL;
+    r->bufs = NULL;
+    r->to_submit = 0;
+    r->in_flight = 0;
+
+    r->entries = params.sq_entries;
+    const size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    r->map_len = sq_len > cq_len ? sq_len : cq_len;
+    void *map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (map == MAP_FAILED) {
+        _ring_close(r);
+        return EXIT_FAILURE;
+    }
+    r->map = map;
+    r->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        _ring_close(r);
+        return EXIT_FAILURE;
+    }
+    r->sqes = sqes;
+    char *base = map;
+    r->sq_head = (unsigned *)(base + params.sq_off.head);
+    r->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    r->sq_mask = (unsigned *)(base + params.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(base + params.sq_off.array);
+    r->cq_head = (unsigned *)(base + params.cq_off.head);
+    r->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    r->cq_mask = (unsigned *)(base + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+    void *bufs;
+    if (posix_memalign(&bufs, 4096, (size_t)URING_BUF_SIZE * URING_BUF_CNT)) {
+        _ring_close(r);
+        return EXIT_FAILURE;
+    }
+    r->bufs = bufs;
+    struct iovec iovs[URING_BUF_CNT];
+    for (unsigned i = 0; i < URING_BUF_CNT; i++) {
+        iovs[i].iov_base = r->bufs + (size_t)i * URING_BUF_SIZE;
+        iovs[i].iov_len = URING_BUF_SIZE;
+    }
+    const int fds[] = {sock, file_fd};
+    // registering the buffers fails if they exceed the limit of locked memory
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iovs, URING_BUF_CNT) ||
+        syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES, fds, 2)) {
+        _ring_close(r);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Queue a request. The request is submitted with the next call to _ring_wait.
+ * returns the submission queue entry, or NULL if the queue is full.
+ */
+static struct io_uring_sqe *_queue_req(ring *r, uint8_t opcode, int fixed_fd, uint64_t user_data) {
+    const unsigned tail = *(r->sq_tail);
+    if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->entries) return NULL;
+    const unsigned ind = tail & *(r->sq_mask);
+    struct io_uring_sqe *sqe = &(r->sqes[ind]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fixed_fd;
+    sqe->user_data = user_data;
+    r->sq_array[ind] = ind;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    r->in_flight++;
+    return sqe;
+}
+
+/*
+ * Queue reading or writing len bytes of the buffer, starting at pos of the buffer, at offset of the file or the
+ * socket. Requests on the socket are linked to a timeout, so that a client that stops responding does not block the
+ * transfer forever.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _queue_rw(ring *r, uint8_t opcode, int kind, unsigned buf_ind, size_t pos, size_t len, int64_t offset) {
+    const int fixed_fd = kind == REQ_SOCK ? FIXED_SOCK : FIXED_FILE;
+    struct io_uring_sqe *sqe = _queue_req(r, opcode, fixed_fd, ((uint64_t)kind << 32) | buf_ind);
+    if (!sqe) return EXIT_FAILURE;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)(r->bufs + (size_t)buf_ind * URING_BUF_SIZE + pos);
+    sqe->len = (uint32_t)len;
+    sqe->off = (uint64_t)offset;
+    sqe->buf_index = (uint16_t)buf_ind;
+    if (kind != REQ_SOCK) return EXIT_SUCCESS;
+    sqe->flags |= IOSQE_IO_LINK;
+    struct io_uring_sqe *timeout = _queue_req(r, IORING_OP_LINK_TIMEOUT, -1, (uint64_t)REQ_TIMEOUT << 32);
+    if (!timeout) return EXIT_FAILURE;
+    timeout->addr = (uint64_t)(uintptr_t)&sock_timeout;
+    timeout->len = 1;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Submit the queued requests, and wait for the next completion, in one system call.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _ring_wait(ring *r, uint64_t *user_data_p, int32_t *res_p) {
+    while (1) {
+        const unsigned head = *(r->cq_head);
+        if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            const struct io_uring_cqe *cqe = &(r->cqes[head & *(r->cq_mask)]);
+            *user_data_p = cqe->user_data;
+            *res_p = cqe->res;
+            __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+            r->in_flight--;
+            return EXIT_SUCCESS;
+        }
+        const long ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return EXIT_FAILURE;
+        }
+        r->to_submit -= (unsigned)ret;
+    }
+}
+
+/*
+ * Wait for the requests in flight to complete, since they may still use the buffers, and close the ring. Requests
+ * queued but not submitted yet are submitted first.
+ */
+static void _ring_finish(ring *r) {
+    uint64_t user_data;
+    int32_t res;
+    while (r->in_flight > 0) {
+        if (_ring_wait(r, &user_data, &res) != EXIT_SUCCESS) {
+            // the kernel may still write to the buffers, so they are not given back
+            r->bufs = NULL;
+            break;
+        }
+    }
+    _ring_close(r);
+}
+
+/*
+ * Set up a ring for transferring between the socket and the file, unless io_uring is known to be unusable. The kernel
+ * is probed here only if uring_probe was not called before.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _start_transfer(ring *r, int sock, FILE *fp, int64_t *offset_p) {
+    if (__atomic_load_n(&uring_support, __ATOMIC_RELAXED) == SUPPORT_UNKNOWN) uring_probe();
+    if (__atomic_load_n(&uring_support, __ATOMIC_RELAXED) != SUPPORT_OK) return EXIT_FAILURE;
+    // the file is read and written directly, so nothing must be buffered in the stream
+    if (fflush(fp)) return EXIT_FAILURE;
+    const off_t offset = ftello(fp);
+    if (offset < 0) return EXIT_FAILURE;
+    if (_ring_open(r, sock, fileno(fp)) != EXIT_SUCCESS) {
+        // setting up a ring can also fail for want of locked memory, which will not be different for later transfers
+        __atomic_store_n(&uring_support, SUPPORT_NONE, __ATOMIC_RELAXED);
+        return EXIT_FAILURE;
+    }
+    *offset_p = (int64_t)offset;
+    return EXIT_SUCCESS;
+}
+
+static inline size_t _chunk_len(uint64_t chunk, int64_t size) {
+    const int64_t left = size - (int64_t)chunk * URING_BUF_SIZE;
+    return left < URING_BUF_SIZE ? (size_t)left : URING_BUF_SIZE;
+}
+
+int uring_send_file(int sock, FILE *fp, int64_t size) {
+    ring r;
+    int64_t offset;
+    if (_start_transfer(&r, sock, fp, &offset) != EXIT_SUCCESS) return URING_UNAVAILABLE;
+    const uint64_t chunks = (uint64_t)(size + URING_BUF_SIZE - 1) / URING_BUF_SIZE;
+    uint64_t buf_chunk[URING_BUF_CNT];  // chunk of the file held by each buffer
+    size_t got[URING_BUF_CNT];          // bytes read into each buffer
+    uint64_t next_read = 0;
+    uint64_t next_send = 0;
+    size_t sent = 0;  // bytes of the chunk next_send already sent
+    int sending = 0;
+    int status = EXIT_SUCCESS;
+    // the file is read ahead into all buffers, while the socket sends one buffer at a time to keep the order
+    for (; next_read < chunks && next_read < URING_BUF_CNT; next_read++) {
+        buf_chunk[next_read] = next_read;
+        got[next_read] = 0;
+        if (_queue_rw(&r, IORING_OP_READ_FIXED, REQ_FILE, (unsigned)next_read, 0, _chunk_len(next_read, size),
+                      offset + (int64_t)next_read * URING_BUF_SIZE) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+        }
+    }
+    while (status == EXIT_SUCCESS && next_send < chunks) {
+        const unsigned send_ind = (unsigned)(next_send % URING_BUF_CNT);
+        const size_t send_len = _chunk_len(next_send, size);
+        if (!sending && got[send_ind] == send_len) {
+            if (_queue_rw(&r, IORING_OP_WRITE_FIXED, REQ_SOCK, send_ind, sent, send_len - sent, 0) != EXIT_SUCCESS) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            sending = 1;
+        }
+        uint64_t user_data;
+        int32_t res;
+        if (_ring_wait(&r, &user_data, &res) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        const int kind = (int)(user_data >> 32);
+        const unsigned ind = (unsigned)(user_data & 0xFFFFFFFFU);
+        if (kind == REQ_TIMEOUT) continue;
+        // a request on the socket that timed out completes with -ECANCELED
+        if (res <= 0) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (kind == REQ_FILE) {
+            got[ind] += (size_t)res;
+            const size_t len = _chunk_len(buf_chunk[ind], size);
+            if (got[ind] < len &&
+                _queue_rw(&r, IORING_OP_READ_FIXED, REQ_FILE, ind, got[ind], len - got[ind],
+                          offset + (int64_t)buf_chunk[ind] * URING_BUF_SIZE + (int64_t)got[ind]) != EXIT_SUCCESS) {
+                status = EXIT_FAILURE;
+            }
+            continue;
+        }
+        sending = 0;
+        sent += (size_t)res;
+        if (sent < send_len) continue;
+        sent = 0;
+        next_send++;
+        if (next_read < chunks) {
+            // the buffer just sent is reused for the next chunk to be read
+            buf_chunk[ind] = next_read;
+            got[ind] = 0;
+            if (_queue_rw(&r, IORING_OP_READ_FIXED, REQ_FILE, ind, 0, _chunk_len(next_read, size),
+                          offset + (int64_t)next_read * URING_BUF_SIZE) != EXIT_SUCCESS) {
+                status = EXIT_FAILURE;
+            }
+            next_read++;
+        }
+    }
+    _ring_finish(&r);
+    if (status == EXIT_SUCCESS && fseeko(fp, (off_t)(offset + size), SEEK_SET)) status = EXIT_FAILURE;
+    return status;
+}
+
+int uring_receive_file(int sock, FILE *fp, int64_t size) {
+    ring r;
+    int64_t offset;
+    if (_start_transfer(&r, sock, fp, &offset) != EXIT_SUCCESS) return URING_UNAVAILABLE;
+    const uint64_t chunks = (uint64_t)(size + URING_BUF_SIZE - 1) / URING_BUF_SIZE;
+    uint64_t buf_chunk[URING_BUF_CNT];  // chunk of the file held by each buffer
+    size_t put[URING_BUF_CNT];          // bytes of each buffer written to the file
+    int busy[URING_BUF_CNT];            // whether each buffer is waiting to be written to the file
+    for (unsigned i = 0; i < URING_BUF_CNT; i++) busy[i] = 0;
+    uint64_t next_recv = 0;
+    size_t received = 0;  // bytes of the chunk next_recv already received
+    int receiving = 0;
+    uint64_t written_chunks = 0;
+    int status = EXIT_SUCCESS;
+    // the socket is received into one buffer at a time to keep the order, while the full buffers are being written
+    while (status == EXIT_SUCCESS && written_chunks < chunks) {
+        const unsigned recv_ind = (unsigned)(next_recv % URING_BUF_CNT);
+        const size_t recv_len = next_recv < chunks ? _chunk_len(next_recv, size) : 0;
+        if (!receiving && next_recv < chunks && !busy[recv_ind]) {
+            if (_queue_rw(&r, IORING_OP_READ_FIXED, REQ_SOCK, recv_ind, received, recv_len - received, 0) !=
+                EXIT_SUCCESS) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            receiving = 1;
+        }
+        uint64_t user_data;
+        int32_t res;
+        if (_ring_wait(&r, &user_data, &res) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        const int kind = (int)(user_data >> 32);
+        const unsigned ind = (unsigned)(user_data & 0xFFFFFFFFU);
+        if (kind == REQ_TIMEOUT) continue;
+        // a request on the socket that timed out completes with -ECANCELED, and a closed socket reads 0 bytes
+        if (res <= 0) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (kind == REQ_FILE) {
+            put[ind] += (size_t)res;
+            const size_t len = _chunk_len(buf_chunk[ind], size);
+            if (put[ind] < len) {
+                if (_queue_rw(&r, IORING_OP_WRITE_FIXED, REQ_FILE, ind, put[ind], len - put[ind],
+                              offset + (int64_t)buf_chunk[ind] * URING_BUF_SIZE + (int64_t)put[ind]) != EXIT_SUCCESS) {
+                    status = EXIT_FAILURE;
+                }
+                continue;
+            }
+            busy[ind] = 0;
+            written_chunks++;
+            continue;
+        }
+        receiving = 0;
+        received += (size_t)res;
+        if (received < recv_len) continue;
+        received = 0;
+        buf_chunk[ind] = next_recv;
+        put[ind] = 0;
+        busy[ind] = 1;
+        if (_queue_rw(&r, IORING_OP_WRITE_FIXED, REQ_FILE, ind, 0, recv_len,
+                      offset + (int64_t)next_recv * URING_BUF_SIZE) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+        }
+        next_recv++;
+    }
+    _ring_finish(&r);
+    if (status == EXIT_SUCCESS && fseeko(fp, (off_t)(offset + size), SEEK_SET)) status = EXIT_FAILURE;
+    return status;
+}
+
+#else
+
+void uring_probe(void) {}
+
+int uring_send_file(int sock, FILE *fp, int64_t size) {
+    (void)sock;
+    (void)fp;
+    (void)size;
+    return URING_UNAVAILABLE;
+}
+
+int uring_receive_file(int sock, FILE *fp, int64_t size) {
+    (void)sock;
+    (void)fp;
+    (void)size;
+    return URING_UNAVAILABLE;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * utils/uring_io.h - header for transferring files between sockets and disk with io_uring
+ * Copyright (C) 2024 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_URING_IO_H_
+#define UTILS_URING_IO_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// returned when io_uring cannot be used, in which case nothing is transferred
+#define URING_UNAVAILABLE -1
+// files smaller than this are not worth setting up a ring for
+#define URING_MIN_FILE_SIZE 1048576
+// size of each buffer registered with the ring
+#define URING_BUF_SIZE 262144
+// number of buffers registered with the ring, which bounds the data in flight
+#define URING_BUF_CNT 8
+// milliseconds to wait for the socket to make progress before the transfer fails, as with the socket timeouts
+#define URING_SOCK_TIMEOUT_MS 500
+
+#ifdef __linux__
+
+/*
+ * Check once if the kernel supports the io_uring features used for the transfers. This should be called before
+ * accepting connections, so that the connection handlers do not probe again. Otherwise, the first transfer probes.
+ */
+extern void uring_probe(void);
+
+/*
+ * Send size bytes of the file opened as fp, from its current position, to the socket sock. The file is read ahead into
+ * the registered buffers while earlier buffers are being sent.
+ * returns EXIT_SUCCESS on success, EXIT_FAILURE on failure, or URING_UNAVAILABLE if io_uring is not supported.
+ */
+extern int uring_send_file(int sock, FILE *fp, int64_t size);
+
+/*
+ * Receive size bytes from the socket sock and write them to the file opened as fp, from its current position. The
+ * buffers already received are written to the file while the socket is read into the next buffers.
+ * returns EXIT_SUCCESS on success, EXIT_FAILURE on failure, or URING_UNAVAILABLE if io_uring is not supported.
+ */
+extern int uring_receive_file(int sock, FILE *fp, int64_t size);
+
+#endif
+
+#endif  // UTILS_URING_IO_H_
@@ -17,6 +17,10 @@
  */
 
 #define _FILE_OFFSET_BITS 64
+#ifdef __linux__
+// for fallocate, SEEK_DATA, and SEEK_HOLE
+#define _GNU_SOURCE
+#endif
 
 #ifdef DEBUG_MODE
 #define __STDC_FORMAT_MACROS
@@ -24,6 +28,8 @@
 #endif
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <globals.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -31,15 +37,29 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <utils/dir_walk.h>
+#include <utils/hash.h>
 #include <utils/list_utils.h>
+#include <utils/text_history.h>
+#include <utils/text_utils.h>
 #include <utils/utils.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/statvfs.h>
+#endif
 #ifdef __linux__
 #include <X11/Xmu/Atoms.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <xclip/xclip.h>
 #include <xscreenshot/xscreenshot.h>
 #endif
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
 #ifdef _WIN32
 #include <direct.h>
+#include <io.h>
 #include <shlobj.h>
 #include <utils/win_image.h>
 #include <windows.h>
@@ -176,6 +196,26 @@ int64_t get_file_size(FILE *fp) {
     return file_size;
 }
 
+int seek_file(FILE *fp, int64_t offset) {
+    if (offset < 0 || fseeko(fp, (off_t)offset, SEEK_SET)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+int advise_read_ahead(FILE *fp, int64_t size) {
+    if (size <= 0) return EXIT_SUCCESS;
+#if defined(__linux__)
+    if (posix_fadvise(fileno(fp), 0, (off_t)size, POSIX_FADV_WILLNEED)) return EXIT_FAILURE;
+#elif defined(__APPLE__)
+    struct radvisory advice = {.ra_offset = 0, .ra_count = size > INT32_MAX ? INT32_MAX : (int)size};
+    if (fcntl(fileno(fp), F_RDADVISE, &advice) == -1) return EXIT_FAILURE;
+#elif defined(_WIN32)
+    // there is no read ahead hint for a file already opened. Opening it has loaded its metadata
+    (void)fp;
+    return EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}
+
 int is_directory(const char *path, int follow_symlinks) {
     if (path[0] == 0) return 0;  // empty path
     struct stat sb;
@@ -203,6 +243,28 @@ int is_directory(const char *path, int follow_symlinks) {
     return 0;
 }
 
+int get_file_stat(const char *path, int64_t *size_p, int64_t *mtime_p) {
+    struct stat sb;
+#if defined(__linux__) || defined(__APPLE__)
+    if (stat(path, &sb)) return EXIT_FAILURE;
+#elif defined(_WIN32)
+    wchar_t *wpath;
+    if (utf8_to_wchar_str(path, &wpath, NULL) != EXIT_SUCCESS) return EXIT_FAILURE;
+    const int stat_result = _wstat64(wpath, &sb);
+    free(wpath);
+    if (stat_result) return EXIT_FAILURE;
+#endif
+    *size_p = (int64_t)sb.st_size;
+#if defined(__linux__)
+    *mtime_p = (int64_t)sb.st_mtim.tv_sec * 1000000000L + (int64_t)sb.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    *mtime_p = (int64_t)sb.st_mtimespec.tv_sec * 1000000000L + (int64_t)sb.st_mtimespec.tv_nsec;
+#else
+    *mtime_p = (int64_t)sb.st_mtime;
+#endif
+    return EXIT_SUCCESS;
+}
+
 void png_mem_write_data(png_structp png_ptr, png_bytep data, png_size_t length) {
     struct mem_file *p = (struct mem_file *)png_get_io_ptr(png_ptr);
     size_t nsize = p->size + length;
@@ -226,76 +288,9 @@ void png_mem_write_data(png_structp png_ptr, png_bytep data, png_size_t length)
     p->size += length;
 }
 
-/*
- * Allocate the required capacity for the string with EOL=CRLF including the terminating '\0'.
- * Assign the realloced string to *str_p and the length after conversion to *len_p without the terminating '\0'.
- * Returns 0 if all \n are preceded by \r (i.e. no conversion needed).
- * Returns 1 if conversion is needed and it will increase the length.
- * Returns -1 if realloc failed.
- */
-static inline int _realloc_for_crlf(char **str_p, uint64_t *len_p) {
-    char *str = *str_p;
-    size_t increase = 0;
-    size_t ind;
-    for (ind = 0; str[ind]; ind++) {
-        if (str[ind] == '\n' && (ind == 0 || str[ind - 1] != '\r')) {
-            // needs increasing
-            increase++;
-        }
-    }
-    if (!increase) {
-        *len_p = ind;
-        return 0;
-    }
-    uint64_t req_len = ind + increase;
-    if (req_len >= 0xFFFFFFFFUL) {
-        free(str);
-        error("realloc size too large");
-        return -1;
-    }
-    char *re_str = realloc(str, req_len + 1);  // +1 for terminating '\0'
-    if (!re_str) {
-        free(str);
-        error("realloc failed");
-        return -1;
-    }
-    *str_p = re_str;
-    *len_p = req_len;
-    return 1;
-}
-
-static inline void _convert_to_crlf(char *str, uint64_t new_len) {
-    // converting to CRLF expands string. Therefore, start from the end to avoid overwriting
-    size_t new_ind = new_len - 1;
-    str[new_len] = 0;  // terminating '\0'
-    for (size_t cur_ind = strnlen(str, new_len + 1) - 1;; cur_ind--) {
-        char c = str[cur_ind];
-        str[new_ind--] = c;
-        if (c == '\n' && (cur_ind == 0 || str[cur_ind - 1] != '\r')) {
-            // add the missing \r before \n
-            str[new_ind--] = '\r';
-        }
-        if (cur_ind == 0) break;
-    }
-}
-
-static inline int64_t _convert_to_lf(char *str) {
-    // converting to CRLF shrinks string. Therefore, start from the begining to avoid overwriting
-    const char *old_ptr = str;
-    char *new_ptr = str;
-    char c;
-    while ((c = *old_ptr)) {
-        old_ptr++;
-        if (c != '\r' || *old_ptr != '\n') {
-            *new_ptr = c;
-            new_ptr++;
-        }
-    }
-    *new_ptr = '\0';
-    return new_ptr - str;
-}
+int64_t convert_eol(char **str_p, int force_lf) { return convert_eol_len(str_p, strlen(*str_p), force_lf, 0); }
 
-int64_t convert_eol(char **str_p, int force_lf) {
+int64_t convert_eol_len(char **str_p, size_t len, int force_lf, int validate) {
     int crlf;
 #if defined(__linux__) || defined(__APPLE__)
     crlf = 0;
@@ -303,16 +298,21 @@ int64_t convert_eol(char **str_p, int force_lf) {
     crlf = 1;
 #endif
     if (force_lf) crlf = 0;
-    // realloc if available capacity is not enough
+    int64_t new_len;
     if (crlf) {
-        uint64_t new_len;
-        int status = _realloc_for_crlf(str_p, &new_len);
-        if (status == 0) return (int64_t)new_len;  // no conversion needed
-        if (status < 0 || !*str_p) return -1;      // realloc failed
-        _convert_to_crlf(*str_p, new_len);
-        return (int64_t)new_len;
+        new_len = text_to_crlf(str_p, len, validate);
+    } else {
+        new_len = text_to_lf(*str_p, len, validate);
+    }
+    if (new_len < 0) {
+#ifdef DEBUG_MODE
+        fputs(validate ? "Invalid UTF-8 or converting EOL failed\n" : "Converting EOL failed\n", stderr);
+#endif
+        free(*str_p);
+        *str_p = NULL;
+        return -1;
     }
-    return _convert_to_lf(*str_p);
+    return new_len;
 }
 
 #if PROTOCOL_MIN <= 1
@@ -428,7 +428,7 @@ list2 *get_copied_files(void) {
 
 #endif  // PROTOCOL_MIN <= 1
 
-#if (PROTOCOL_MIN <= 3) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
 
 /*
  * Try to create the directory at path.
@@ -494,6 +494,230 @@ int mkdirs(const char *dir_path) {
     return EXIT_SUCCESS;
 }
 
+int preallocate_file(FILE *fp, int64_t size) {
+    if (size <= 0) return EXIT_SUCCESS;
+#if defined(__linux__)
+    // unlike posix_fallocate, this fails instead of writing zeros on file systems that do not support it
+    if (fallocate(fileno(fp), FALLOC_FL_KEEP_SIZE, 0, (off_t)size)) return EXIT_FAILURE;
+#elif defined(__APPLE__)
+    fstore_t store = {.fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL,
+                      .fst_posmode = F_PEOFPOSMODE,
+                      .fst_offset = 0,
+                      .fst_length = (off_t)size};
+    if (fcntl(fileno(fp), F_PREALLOCATE, &store) == -1) {
+        // contiguous space is not available. Try to allocate it in parts
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(fileno(fp), F_PREALLOCATE, &store) == -1) return EXIT_FAILURE;
+    }
+#elif defined(_WIN32)
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (handle == INVALID_HANDLE_VALUE) return EXIT_FAILURE;
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = size;
+    if (!SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info))) return EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}
+
+int64_t get_free_space(void) {
+#if defined(__linux__) || defined(__APPLE__)
+    struct statvfs stats;
+    if (statvfs(".", &stats)) return -1;
+    return (int64_t)stats.f_bavail * (int64_t)stats.f_frsize;
+#elif defined(_WIN32)
+    ULARGE_INTEGER available;
+    if (!GetDiskFreeSpaceExW(NULL, &available, NULL, NULL)) return -1;
+    return (int64_t)available.QuadPart;
+#endif
+}
+
+int clone_file(const char *src_path, const char *dest_path) {
+#if defined(__linux__) && defined(FICLONE)
+    const int src_fd = open(src_path, O_RDONLY);
+    if (src_fd < 0) return EXIT_FAILURE;
+    const int dest_fd = open(dest_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (dest_fd < 0) {
+        close(src_fd);
+        return EXIT_FAILURE;
+    }
+    const int cloned = !ioctl(dest_fd, FICLONE, src_fd);
+    close(dest_fd);
+    close(src_fd);
+    if (!cloned) {
+        unlink(dest_path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+#elif defined(__APPLE__)
+    return clonefile(src_path, dest_path, 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+#else
+    (void)src_path;
+    (void)dest_path;
+    return EXIT_FAILURE;
+#endif
+}
+
+int link_file(const char *src_path, const char *dest_path) {
+    if (clone_file(src_path, dest_path) == EXIT_SUCCESS) return EXIT_SUCCESS;
+#if defined(__linux__) || defined(__APPLE__)
+    // the file system does not support cloning files
+    if (link(src_path, dest_path)) return EXIT_FAILURE;
+#elif defined(_WIN32)
+    wchar_t *wsrc;
+    wchar_t *wdest;
+    if (utf8_to_wchar_str(src_path, &wsrc, NULL) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (utf8_to_wchar_str(dest_path, &wdest, NULL) != EXIT_SUCCESS) {
+        free(wsrc);
+        return EXIT_FAILURE;
+    }
+    const BOOL linked = CreateHardLinkW(wdest, wsrc, NULL);
+    free(wsrc);
+    free(wdest);
+    if (!linked) return EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}
+
+void get_data_extent(FILE *fp, int64_t offset, int64_t size, int64_t *start_p, int64_t *end_p) {
+    // without a way to find the holes, the rest of the file is taken as data
+    int64_t start = offset;
+    int64_t end = size;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    const int fd = fileno(fp);
+    // the position of the file descriptor is restored, so that the stream does not lose track of it
+    const off_t pos = lseek(fd, 0, SEEK_CUR);
+    if (pos >= 0) {
+        const off_t data = lseek(fd, (off_t)offset, SEEK_DATA);
+        if (data >= 0) {
+            start = (int64_t)data;
+            const off_t hole = lseek(fd, data, SEEK_HOLE);
+            if (hole > data) end = (int64_t)hole;
+        } else if (errno == ENXIO) {
+            // there is no data after offset
+            start = size;
+        }
+        lseek(fd, pos, SEEK_SET);
+    }
+#elif defined(_WIN32)
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(fp));
+    FILE_ALLOCATED_RANGE_BUFFER query;
+    query.FileOffset.QuadPart = offset;
+    query.Length.QuadPart = size - offset;
+    FILE_ALLOCATED_RANGE_BUFFER range;
+    DWORD returned = 0;
+    // only the first range is needed. The others do not fit in the buffer
+    if (handle != INVALID_HANDLE_VALUE && offset < size &&
+        (DeviceIoControl(handle, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), &range, sizeof(range),
+                         &returned, NULL) ||
+         GetLastError() == ERROR_MORE_DATA)) {
+        if (returned < sizeof(range)) {
+            start = size;
+        } else {
+            start = (int64_t)range.FileOffset.QuadPart;
+            end = start + (int64_t)range.Length.QuadPart;
+        }
+    }
+#else
+    (void)fp;
+#endif
+    // allocated ranges may start before offset, and the file may have changed since its size was taken
+    if (start < offset) start = offset;
+    if (start > size) start = size;
+    if (end > size || end <= start) end = size;
+    *start_p = start;
+    *end_p = end;
+}
+
+int set_sparse_file(FILE *fp) {
+#ifdef _WIN32
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (handle == INVALID_HANDLE_VALUE) return EXIT_FAILURE;
+    DWORD returned;
+    if (!DeviceIoControl(handle, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL)) return EXIT_FAILURE;
+#else
+    // ranges that are never written are holes by default on Linux and macOS
+    (void)fp;
+#endif
+    return EXIT_SUCCESS;
+}
+
+int set_file_size(FILE *fp, int64_t size) {
+    if (fflush(fp)) return EXIT_FAILURE;
+#if defined(__linux__) || defined(__APPLE__)
+    if (ftruncate(fileno(fp), (off_t)size)) return EXIT_FAILURE;
+#elif defined(_WIN32)
+    if (_chsize_s(_fileno(fp), size)) return EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}
+
+struct _received_dir {
+#if defined(__linux__) || defined(__APPLE__)
+    int fd;
+#elif defined(_WIN32)
+    char *path;
+#endif
+};
+
+received_dir *open_received_dir(const char *path) {
+    received_dir *dir = malloc(sizeof(received_dir));
+    if (!dir) return NULL;
+#if defined(__linux__) || defined(__APPLE__)
+    dir->fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (dir->fd < 0) {
+        free(dir);
+        return NULL;
+    }
+#elif defined(_WIN32)
+    dir->path = strdup(path);
+    if (!dir->path) {
+        free(dir);
+        return NULL;
+    }
+#endif
+    return dir;
+}
+
+int move_received_entry(received_dir *dir, const char *name, const char *new_path) {
+#if defined(__linux__) || defined(__APPLE__)
+#if defined(__linux__) && defined(__NR_renameat2) && defined(RENAME_NOREPLACE)
+    if (!syscall(__NR_renameat2, dir->fd, name, AT_FDCWD, new_path, RENAME_NOREPLACE)) return EXIT_SUCCESS;
+    if (errno == EEXIST) return MOVE_EXISTS;
+    if (errno != EINVAL && errno != ENOSYS) return EXIT_FAILURE;
+#elif defined(__APPLE__) && defined(RENAME_EXCL)
+    if (!renameatx_np(dir->fd, name, AT_FDCWD, new_path, RENAME_EXCL)) return EXIT_SUCCESS;
+    if (errno == EEXIST) return MOVE_EXISTS;
+    if (errno != EINVAL && errno != ENOTSUP) return EXIT_FAILURE;
+#endif
+    // the file system does not support renaming without replacing. A file created after this check is replaced
+    struct stat statbuf;
+    if (!fstatat(AT_FDCWD, new_path, &statbuf, AT_SYMLINK_NOFOLLOW)) return MOVE_EXISTS;
+    if (renameat(dir->fd, name, AT_FDCWD, new_path)) return EXIT_FAILURE;
+#elif defined(_WIN32)
+    const size_t old_len = strlen(dir->path) + strlen(name) + 2;
+    char *old_path = malloc(old_len);
+    if (!old_path) return EXIT_FAILURE;
+    if (snprintf_check(old_path, old_len, "%s%c%s", dir->path, PATH_SEP, name)) {
+        free(old_path);
+        return EXIT_FAILURE;
+    }
+    // unlike on Linux and macOS, renaming does not replace an existing file on Windows
+    const int renamed = !rename_file(old_path, new_path);
+    free(old_path);
+    if (!renamed) return file_exists(new_path) ? MOVE_EXISTS : EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}
+
+void close_received_dir(received_dir *dir) {
+#if defined(__linux__) || defined(__APPLE__)
+    close(dir->fd);
+#elif defined(_WIN32)
+    free(dir->path);
+#endif
+    free(dir);
+}
+
 list2 *list_dir(const char *dirname) {
 #if defined(__linux__) || defined(__APPLE__)
     DIR *d = opendir(dirname);
@@ -541,83 +765,12 @@ list2 *list_dir(const char *dirname) {
 
 #if defined(__linux__) || defined(__APPLE__)
 
-/*
- * Check if the path is a file or a directory.
- * If the path is a directory, calls _recurse_dir() on that.
- * Otherwise, appends the path to the list
- */
-static void _process_path(const char *path, list2 *lst, int depth, int include_leaf_dirs);
-
-/*
- * Recursively append all file paths in the directory and its subdirectories
- * to the list.
- * maximum recursion depth is limited to MAX_RECURSE_DEPTH
- */
-static void _recurse_dir(const char *_path, list2 *lst, int depth, int include_leaf_dirs);
-
-static void _process_path(const char *path, list2 *lst, int depth, int include_leaf_dirs) {
-    struct stat sb;
-    if (lstat(path, &sb) != 0) return;
-    if (S_ISDIR(sb.st_mode)) {
-        _recurse_dir(path, lst, depth + 1, include_leaf_dirs);
-    } else if (S_ISREG(sb.st_mode)) {
-        append(lst, strdup(path));
-    }
-}
-
-static void _recurse_dir(const char *_path, list2 *lst, int depth, int include_leaf_dirs) {
-    if (depth > MAX_RECURSE_DEPTH) return;
-    DIR *d = opendir(_path);
-    if (!d) {
-#ifdef DEBUG_MODE
-        printf("Error opening directory %s", _path);
-#endif
-        return;
-    }
-    size_t p_len = strnlen(_path, 2050);
-    if (p_len > 2048) {
-        error("Too long file name.");
-        (void)closedir(d);
-        return;
-    }
-    char path[p_len + 2];
-    strncpy(path, _path, p_len + 1);
-    path[p_len + 1] = 0;
-    if (path[p_len - 1] != PATH_SEP) {
-        path[p_len++] = PATH_SEP;
-        path[p_len] = '\0';
-    }
-    const struct dirent *dir;
-    int is_empty = 1;
-    while ((dir = readdir(d)) != NULL) {
-        const char *filename = dir->d_name;
-        if (!(strcmp(filename, ".") && strcmp(filename, ".."))) continue;
-        is_empty = 0;
-        const size_t _fname_len = strnlen(filename, sizeof(dir->d_name));
-        if (_fname_len + p_len > 2048) {
-            error("Too long file name.");
-            (void)closedir(d);
-            return;
-        }
-        char pathname[_fname_len + p_len + 1];
-        strncpy(pathname, path, p_len);
-        strncpy(pathname + p_len, filename, _fname_len + 1);
-        pathname[p_len + _fname_len] = 0;
-        _process_path(pathname, lst, depth, include_leaf_dirs);
-    }
-    if (include_leaf_dirs && is_empty) {
-        append(lst, strdup(path));
-    }
-    (void)closedir(d);
-}
-
-void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
-    dfiles_p->lst = NULL;
-    dfiles_p->path_len = 0;
+int walk_copied_dirs_files(int include_leaf_dirs, size_t *path_len_p, path_callback callback, void *arg) {
+    *path_len_p = 0;
     int offset = 0;
     char *fnames = get_copied_files_as_str(&offset);
     if (!fnames) {
-        return;
+        return EXIT_FAILURE;
     }
     char *file_path = fnames + offset;
 
@@ -630,15 +783,17 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
     }
     if (file_cnt > 0xFFFFFFFFUL) {
         free(fnames);
-        return;
+        return EXIT_FAILURE;
     }
 
-    list2 *lst = init_list((uint32_t)file_cnt);
-    if (!lst) {
+    // copied directories are walked together after the loop, so that they are read in parallel
+    const char **dirs = malloc(file_cnt * sizeof(char *));
+    if (!dirs) {
         free(fnames);
-        return;
+        return EXIT_FAILURE;
     }
-    dfiles_p->lst = lst;
+    size_t dir_cnt = 0;
+    int status = EXIT_SUCCESS;
     char *fname = file_path;
     for (size_t i = 0; i < file_cnt; i++) {
         const size_t off = strnlen(fname, 2047) + 1;
@@ -649,7 +804,7 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
             if (fname[fname_len - 1] == PATH_SEP) fname[fname_len - 1] = 0;  // if directory, remove ending /
             const char *sep_ptr = strrchr(fname, PATH_SEP);
             if (sep_ptr > fname) {
-                dfiles_p->path_len = (size_t)sep_ptr - (size_t)fname + 1;
+                *path_len_p = (size_t)sep_ptr - (size_t)fname + 1;
             }
         }
 
@@ -662,14 +817,40 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
             continue;
         }
         if (S_ISDIR(statbuf.st_mode)) {
-            _recurse_dir(fname, lst, 1, include_leaf_dirs);
+            dirs[dir_cnt++] = fname;
             fname += off;
         } else if (S_ISREG(statbuf.st_mode)) {
-            append(lst, strdup(fname));
+            char *path = strdup(fname);
+            if (path && callback(arg, path) != EXIT_SUCCESS) {
+                status = EXIT_FAILURE;
+                break;
+            }
             fname += off;
         }
     }
+    if (status == EXIT_SUCCESS) {
+        status = walk_dirs(dirs, dir_cnt, MAX_RECURSE_DEPTH, include_leaf_dirs, callback, arg);
+    }
+    free(dirs);
     free(fnames);
+    return status;
+}
+
+static int _append_path(void *arg, char *path) {
+    append((list2 *)arg, path);
+    return EXIT_SUCCESS;
+}
+
+void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
+    dfiles_p->path_len = 0;
+    dfiles_p->lst = init_list(16);
+    if (!dfiles_p->lst) return;
+    if (walk_copied_dirs_files(include_leaf_dirs, &(dfiles_p->path_len), &_append_path, dfiles_p->lst) !=
+        EXIT_SUCCESS) {
+        free_list(dfiles_p->lst);
+        dfiles_p->lst = NULL;
+        dfiles_p->path_len = 0;
+    }
 }
 
 #elif defined(_WIN32)
@@ -806,6 +987,23 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
     CloseClipboard();
 }
 
+int walk_copied_dirs_files(int include_leaf_dirs, size_t *path_len_p, path_callback callback, void *arg) {
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, include_leaf_dirs);
+    *path_len_p = copied_dir_files.path_len;
+    list2 *lst = copied_dir_files.lst;
+    if (!lst) return EXIT_FAILURE;
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < lst->len && status == EXIT_SUCCESS; i++) {
+        char *path = (char *)lst->array[i];
+        // the callback takes the ownership of the path
+        lst->array[i] = NULL;
+        status = callback(arg, path);
+    }
+    free_list(lst);
+    return status;
+}
+
 int rename_file(const char *old_name, const char *new_name) {
     wchar_t *wold;
     wchar_t *wnew;
@@ -830,7 +1028,68 @@ int remove_directory(const char *path) {
 
 #endif
 
-#endif  // (PROTOCOL_MIN <= 3) && (2 <= PROTOCOL_MAX)
+#endif  // (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+
+/*
+ * Pass len bytes of data to the writer in parts of at most IMAGE_CHUNK_SIZE bytes.
+ */
+static int _write_in_chunks(const char *data, size_t len, chunk_writer writer, void *arg) {
+    while (len > 0) {
+        size_t cnt = len < IMAGE_CHUNK_SIZE ? len : IMAGE_CHUNK_SIZE;
+        if (writer(arg, data, cnt) != EXIT_SUCCESS) return EXIT_FAILURE;
+        data += cnt;
+        len -= cnt;
+    }
+    return EXIT_SUCCESS;
+}
+
+#if defined(_WIN32) || defined(__APPLE__)
+
+int get_copied_image_native(int formats, int *format_p, char **buf_ptr, uint32_t *len_ptr) {
+    *buf_ptr = NULL;
+    *len_ptr = 0;
+    // copied images are available only as PNG on these platforms
+    if (!(formats & IMG_FORMAT_PNG) || get_image(buf_ptr, len_ptr, IMG_COPIED_ONLY, 0) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    *format_p = IMG_FORMAT_PNG;
+    return EXIT_SUCCESS;
+}
+
+int get_image_chunked(int mode, uint16_t disp, const capture_region *region, chunk_writer writer, void *arg) {
+    char *buf = NULL;
+    uint32_t len = 0;
+    int status;
+    if (region) {
+        status = get_screenshot_region(disp, region, &buf, &len);
+    } else {
+        status = get_image(&buf, &len, mode, disp);
+    }
+    if (status != EXIT_SUCCESS || len == 0) {
+        if (buf) free(buf);
+        return EXIT_FAILURE;
+    }
+    status = _write_in_chunks(buf, len, writer, arg);
+    free(buf);
+    return status;
+}
+
+int get_screenshot_if_changed(uint16_t disp, uint64_t known_hash, uint64_t *hash_p, chunk_writer writer,
+                              void *arg) {
+    char *buf = NULL;
+    uint32_t len = 0;
+    if (get_image(&buf, &len, IMG_SCRN_ONLY, disp) != EXIT_SUCCESS || len == 0) {
+        if (buf) free(buf);
+        return EXIT_FAILURE;
+    }
+    *hash_p = hash64(buf, len, 0);
+    int status = EXIT_SUCCESS;
+    if (known_hash == 0 || *hash_p != known_hash) status = _write_in_chunks(buf, len, writer, arg);
+    free(buf);
+    return status;
+}
+
+#endif
 
 #if defined(__linux__) || defined(__APPLE__)
 
@@ -930,6 +1189,136 @@ int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
     return EXIT_FAILURE;
 }
 
+int get_copied_image_native(int formats, int *format_p, char **buf_ptr, uint32_t *len_ptr) {
+    // in the order of preference
+    static const struct {
+        int format;
+        const char *target;
+    } image_targets[] = {{IMG_FORMAT_JPEG, "image/jpeg"},
+                         {IMG_FORMAT_WEBP, "image/webp"},
+                         {IMG_FORMAT_PNG, "image/png"},
+                         {IMG_FORMAT_BMP, "image/bmp"}};
+    const unsigned target_cnt = sizeof(image_targets) / sizeof(image_targets[0]);
+
+    *buf_ptr = NULL;
+    *len_ptr = 0;
+    char *targets = NULL;
+    uint32_t targets_len = 0;
+    if (xclip_util(XCLIP_OUT, "TARGETS", &targets_len, &targets) || targets_len <= 0) {  // do not change the order
+#ifdef DEBUG_MODE
+        printf("xclip read TARGETS. len = %" PRIu32 "\n", targets_len);
+#endif
+        if (targets) free(targets);
+        return EXIT_FAILURE;
+    }
+    int offered = 0;
+    char *copy = targets;
+    const char *token;
+    while ((token = strsep(&copy, "\n"))) {
+        for (unsigned i = 0; i < target_cnt; i++) {
+            if (!strcmp(token, image_targets[i].target)) offered |= image_targets[i].format;
+        }
+    }
+    free(targets);
+
+    for (unsigned i = 0; i < target_cnt; i++) {
+        if (!(offered & formats & image_targets[i].format)) continue;
+        if (xclip_util(XCLIP_OUT, image_targets[i].target, len_ptr, buf_ptr) == EXIT_SUCCESS &&
+            *len_ptr > 8) {  // do not change the order
+            *format_p = image_targets[i].format;
+            return EXIT_SUCCESS;
+        }
+#ifdef DEBUG_MODE
+        printf("xclip failed to get %s. len = %" PRIu32 "\n", image_targets[i].target, *len_ptr);
+#endif
+        if (*buf_ptr) free(*buf_ptr);
+        *buf_ptr = NULL;
+        *len_ptr = 0;
+    }
+    return EXIT_FAILURE;
+}
+
+int get_image_chunked(int mode, uint16_t disp, const capture_region *region, chunk_writer writer, void *arg) {
+    // Try to get copied image unless the mode is screenshot only or a region of the screen is requested
+    if (!region && mode != IMG_SCRN_ONLY) {
+        char *buf = NULL;
+        uint32_t len = 0;
+        if (xclip_util(XCLIP_OUT, "image/png", &len, &buf) == EXIT_SUCCESS && len > 8) {  // do not change the order
+            int status = _write_in_chunks(buf, len, writer, arg);
+            free(buf);
+            return status;
+        }
+        if (buf) free(buf);
+#ifdef DEBUG_MODE
+        printf("xclip failed to get image/png. len = %" PRIu32 "\nCapturing screenshot ...\n", len);
+#endif
+    }
+    if (mode == IMG_COPIED_ONLY) return EXIT_FAILURE;
+
+    if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
+    if (screenshot_chunked_util(disp, region, writer, arg) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        fputs("Get screenshot failed\n", stderr);
+#endif
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int get_screenshot_if_changed(uint16_t disp, uint64_t known_hash, uint64_t *hash_p, chunk_writer writer,
+                              void *arg) {
+    if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
+    if (screenshot_if_changed_util(disp, known_hash, hash_p, writer, arg) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        fputs("Get screenshot failed\n", stderr);
+#endif
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int get_screenshot_delta(uint16_t disp, uint64_t base_frame, screenshot_delta *delta) {
+    if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
+    if (screenshot_delta_util(disp, base_frame, delta) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        fputs("Get screenshot delta failed\n", stderr);
+#endif
+        delta->tiles = NULL;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int get_screenshot_region(uint16_t disp, const capture_region *region, char **buf_ptr, uint32_t *len_ptr) {
+    if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
+    if (screenshot_region_util(disp, region, len_ptr, buf_ptr) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        fputs("Get screenshot region failed\n", stderr);
+#endif
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+screen_stream *start_screen_stream(uint16_t disp, uint32_t max_fps) {
+    if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
+    return screenshot_stream_start(disp, max_fps);
+}
+
+int get_stream_frame(screen_stream *stream, char **buf_ptr, uint32_t *len_ptr) {
+    return screenshot_stream_next(stream, len_ptr, buf_ptr);
+}
+
+void stop_screen_stream(screen_stream *stream) { screenshot_stream_stop(stream); }
+
+list2 *get_displays(void) { return screenshot_list_monitors(); }
+
+void init_server_state(void) {
+    screenshot_init_shared();
+    screenshot_watch_monitors();
+    text_history_init();
+}
+
 char *get_copied_files_as_str(int *offset) {
     const char *const expected_target = "x-special/gnome-copied-files";
     char *targets;
@@ -1211,6 +1600,42 @@ int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
     return EXIT_FAILURE;
 }
 
+int get_screenshot_delta(uint16_t disp, uint64_t base_frame, screenshot_delta *delta) {
+    (void)disp;
+    (void)base_frame;
+    delta->tiles = NULL;
+    return EXIT_FAILURE;
+}
+
+int get_screenshot_region(uint16_t disp, const capture_region *region, char **buf_ptr, uint32_t *len_ptr) {
+    (void)disp;
+    (void)region;
+    *buf_ptr = NULL;
+    *len_ptr = 0;
+    return EXIT_FAILURE;
+}
+
+screen_stream *start_screen_stream(uint16_t disp, uint32_t max_fps) {
+    (void)disp;
+    (void)max_fps;
+    return NULL;
+}
+
+int get_stream_frame(screen_stream *stream, char **buf_ptr, uint32_t *len_ptr) {
+    (void)stream;
+    *buf_ptr = NULL;
+    *len_ptr = 0;
+    return EXIT_FAILURE;
+}
+
+void stop_screen_stream(screen_stream *stream) { (void)stream; }
+
+list2 *get_displays(void) { return NULL; }
+
+void init_server_state(void) {
+    text_history_init();
+}
+
 int set_clipboard_cut_files(const list2 *paths) {
     if (paths->len == 0) return EXIT_SUCCESS;
 
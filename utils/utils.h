@@ -36,6 +36,19 @@
 #define IMG_COPIED_ONLY 1
 #define IMG_SCRN_ONLY 2
 
+// encoded image formats. These are bit flags so that a set of formats can be given as a bit mask
+#define IMG_FORMAT_PNG 1
+#define IMG_FORMAT_JPEG 2
+#define IMG_FORMAT_WEBP 4
+#define IMG_FORMAT_BMP 8
+
+// maximum size of a part of an image passed to a chunk_writer
+#define IMAGE_CHUNK_SIZE 65536
+// width and height of a tile in a screenshot delta, in pixels
+#define SCREENSHOT_TILE_SIZE 64
+// maximum length of the name of a display, in bytes
+#define MAX_DISPLAY_NAME_LEN 63
+
 /*
  * In-memory file to write png image
  */
@@ -53,6 +66,71 @@ typedef struct _dir_files {
     list2 *lst;
 } dir_files;
 
+/*
+ * A PNG encoded tile of a screenshot. col and row are the tile coordinates in units of SCREENSHOT_TILE_SIZE.
+ */
+typedef struct _img_tile {
+    uint32_t col;
+    uint32_t row;
+    uint32_t len;
+    char data[];
+} img_tile;
+
+/*
+ * Tiles of a screenshot that changed since the base frame.
+ * base_id is 0 if the base frame was not known, in which case tiles has all the tiles of the frame.
+ */
+typedef struct _screenshot_delta {
+    uint64_t frame_id;
+    uint64_t base_id;
+    uint32_t width;
+    uint32_t height;
+    list2 *tiles;
+} screenshot_delta;
+
+/*
+ * A rectangle of a display to capture, relative to the top-left corner of the display, and the maximum dimensions of
+ * the captured image. A width or height of 0 extends the rectangle to the edge of the display. A max_width or
+ * max_height of 0 does not limit the image in that dimension. Larger images are downscaled preserving the aspect ratio.
+ */
+typedef struct _capture_region {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t max_width;
+    uint32_t max_height;
+} capture_region;
+
+/*
+ * A display that can be captured. x and y are the position of its top-left corner on the screen.
+ */
+typedef struct _display_info {
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+    int primary;
+    char name[MAX_DISPLAY_NAME_LEN + 1];
+} display_info;
+
+/*
+ * Callback to receive data in parts. It is called with consecutive parts of the data in order.
+ * Should return EXIT_SUCCESS on success, or EXIT_FAILURE to stop producing the data.
+ */
+typedef int (*chunk_writer)(void *arg, const char *data, size_t len);
+
+/*
+ * Callback to receive paths one at a time. The path is allocated with malloc, and the callee takes its ownership.
+ * Should return EXIT_SUCCESS on success, or EXIT_FAILURE to stop producing paths.
+ */
+typedef int (*path_callback)(void *arg, char *path);
+
+/*
+ * A session that captures a display continuously
+ */
+typedef struct _screen_stream screen_stream;
+
 /*
  * A wrapper for snprintf.
  * returns 1 if snprintf failed or truncated
@@ -112,6 +190,90 @@ extern int put_clipboard_text(char *data, uint32_t len);
  */
 extern int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp);
 
+/*
+ * Get the copied image in the format it is offered by the clipboard, without converting it, if that format is one of
+ * the formats in the bit mask formats. If the image is offered in several accepted formats, the most compact format is
+ * chosen. Sets the chosen IMG_FORMAT_* value at format_p.
+ * Places the image data in a buffer and sets the buf_ptr to point the buffer, similar to get_image.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int get_copied_image_native(int formats, int *format_p, char **buf_ptr, uint32_t *len_ptr);
+
+/*
+ * Similar to get_image, but passes the image to the writer in parts of at most IMAGE_CHUNK_SIZE bytes instead of
+ * placing it in a buffer. A screenshot is passed to the writer while it is being encoded, where supported.
+ * If region is not NULL, a screenshot is taken of that region of the display as in get_screenshot_region.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure. The writer may have been called before a failure.
+ */
+extern int get_image_chunked(int mode, uint16_t disp, const capture_region *region, chunk_writer writer, void *arg);
+
+/*
+ * Get a screenshot as the tiles that changed since the frame given by base_frame.
+ * If disp is positive and configuration.client_selects_display is set, use disp as display number instead of default or
+ * configured value.
+ * Sets the id of the new frame, the id of the base frame used, the image dimensions, and the list of img_tile in delta.
+ * If base_frame is 0 or is not known, all tiles are included and base_id is set to 0. Caller should free delta->tiles
+ * with free_list after using. On failure, delta->tiles is set to NULL.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int get_screenshot_delta(uint16_t disp, uint64_t base_frame, screenshot_delta *delta);
+
+/*
+ * Get a screenshot and set a hash of its content at hash_p. If the hash is not known_hash, the screenshot is passed to
+ * the writer as a PNG image, similar to get_image_chunked. Otherwise, the writer is not called. A known_hash of 0 means
+ * that the caller has no screenshot, and it never matches.
+ * If disp is positive and configuration.client_selects_display is set, use disp as display number instead of default or
+ * configured value.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure. The writer may have been called before a failure.
+ */
+extern int get_screenshot_if_changed(uint16_t disp, uint64_t known_hash, uint64_t *hash_p, chunk_writer writer,
+                                     void *arg);
+
+/*
+ * Get a screenshot of a rectangle of a display as a PNG image, downscaled to fit the maximum dimensions given in region.
+ * If disp is positive and configuration.client_selects_display is set, use disp as display number instead of default or
+ * configured value.
+ * Places the image data in a buffer and sets the buf_ptr to point the buffer. Caller should free the buffer after
+ * using. Places data length in the memory location pointed to by len_ptr. On failure, buffer is set to NULL.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int get_screenshot_region(uint16_t disp, const capture_region *region, char **buf_ptr, uint32_t *len_ptr);
+
+/*
+ * Start capturing screenshots of a display continuously at a rate of at most max_fps frames per second.
+ * If disp is positive and configuration.client_selects_display is set, use disp as display number instead of default or
+ * configured value.
+ * returns the stream on success, or NULL if streaming is not supported or on failure.
+ */
+extern screen_stream *start_screen_stream(uint16_t disp, uint32_t max_fps);
+
+/*
+ * Get the latest frame of the stream as a PNG image. Waits until a new frame is captured. Frames captured since the
+ * previous call, other than the latest one, are dropped.
+ * Places the image data in a buffer and sets the buf_ptr to point the buffer. Caller should free the buffer after
+ * using. Places data length in the memory location pointed to by len_ptr. On failure, buffer is set to NULL.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int get_stream_frame(screen_stream *stream, char **buf_ptr, uint32_t *len_ptr);
+
+/*
+ * Stop the stream and free its resources.
+ */
+extern void stop_screen_stream(screen_stream *stream);
+
+/*
+ * Get the displays that can be captured, as a list of display_info. The display number of a display is its index in
+ * the list plus 1.
+ * returns the list on success, or NULL on failure. Caller should free the list with free_list after using.
+ */
+extern list2 *get_displays(void);
+
+/*
+ * Initialize the state shared among the connection handlers of a server. This should be called once before accepting
+ * connections.
+ */
+extern void init_server_state(void);
+
 /*
  * Cut the files given by paths to clipboard. Another application may paste them.
  * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
@@ -124,6 +286,19 @@ extern int set_clipboard_cut_files(const list2 *paths);
  */
 extern int64_t get_file_size(FILE *fp);
 
+/*
+ * Set the position of the file opened as fp to offset bytes from the start of the file.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int seek_file(FILE *fp, int64_t offset);
+
+/*
+ * Ask the operating system to start reading the first size bytes of the file opened as fp into the page cache in the
+ * background, so that reading them later does not wait on the disk. This is only a hint to the operating system.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if the read ahead was not started.
+ */
+extern int advise_read_ahead(FILE *fp, int64_t size);
+
 /*
  * Check if a file exists at the path given by file_name.
  * returns 1 if a file or directory or other special file type exists or 0 otherwise.
@@ -136,6 +311,13 @@ extern int file_exists(const char *file_name);
  */
 extern int is_directory(const char *path, int follow_symlinks);
 
+/*
+ * Get the size and the last modification time of the file at path. The modification time is in nanoseconds where the
+ * platform provides it, and in seconds otherwise. Symbolic links are followed.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int get_file_stat(const char *path, int64_t *size_p, int64_t *mtime_p);
+
 /*
  * The function to be used as png write data function in libpng to write the
  * image into a memory buffer instead of a file. This will allocate memory for
@@ -153,6 +335,15 @@ void png_mem_write_data(png_structp png_ptr, png_bytep data, png_size_t length);
  */
 extern int64_t convert_eol(char **str_p, int force_lf);
 
+/*
+ * Similar to convert_eol, but *str_p has len bytes followed by a terminating '\0'. The conversion stops at the first
+ * '\0' in the buffer.
+ * If validate is non-zero, also checks that all len bytes are valid UTF-8 while converting, and fails if not.
+ * Returns the length of the new string without the terminating '\0'.
+ * If an error occured or the string is not valid UTF-8, this will free() the *str_p and return -1.
+ */
+extern int64_t convert_eol_len(char **str_p, size_t len, int force_lf, int validate);
+
 #if defined(__linux__) || defined(__APPLE__)
 
 #define open_file(filename, mode) fopen(filename, mode)
@@ -210,7 +401,7 @@ extern list2 *get_copied_files(void);
 
 #endif
 
-#if (PROTOCOL_MIN <= 3) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
 
 /*
  * Creates the directory given by the path and all its parent directories if missing.
@@ -234,6 +425,88 @@ extern list2 *list_dir(const char *dirname);
  */
 extern void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs);
 
+/*
+ * Get copied files and directories from the clipboard as in get_copied_dirs_files, but pass each path to the callback
+ * as soon as it is found instead of collecting them in a list. Sets the length of the path name of the directory which
+ * the files are copied at path_len_p before the first call to the callback.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if there are no copied files or the callback stopped the enumeration.
+ */
+extern int walk_copied_dirs_files(int include_leaf_dirs, size_t *path_len_p, path_callback callback, void *arg);
+
+/*
+ * Reserve disk space for size bytes of the file opened as fp, without changing its size, so that the file system can
+ * place the file contiguously before it is written. This is only a hint to the file system.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if the space was not reserved.
+ */
+extern int preallocate_file(FILE *fp, int64_t size);
+
+/*
+ * Get the disk space available to the server on the file system of the current working directory.
+ * returns the available space in bytes on success, or -1 on failure.
+ */
+extern int64_t get_free_space(void);
+
+/*
+ * Create a file at dest_path that is a clone of the file at src_path, sharing the data until either file is modified.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure, including when the file system does not support clones.
+ */
+extern int clone_file(const char *src_path, const char *dest_path);
+
+/*
+ * Create a file at dest_path with the contents of the file at src_path without copying them. The new file is a clone of
+ * the file on file systems that support it, and a hard link to it otherwise. Writing to either of the hard links
+ * changes the other.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int link_file(const char *src_path, const char *dest_path);
+
+/*
+ * Find the first range of data in the file opened as fp, which has size bytes, at or after offset, skipping the holes
+ * of a sparse file. The range is [*start_p, *end_p). If there is no data after offset, both are set to size. The
+ * whole rest of the file is taken as data where holes cannot be found. The position of fp is not changed.
+ */
+extern void get_data_extent(FILE *fp, int64_t offset, int64_t size, int64_t *start_p, int64_t *end_p);
+
+/*
+ * Mark the file opened as fp as sparse, so that the ranges of it that are never written do not take disk space. Files
+ * are sparse without this on Linux and macOS.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int set_sparse_file(FILE *fp);
+
+/*
+ * Flush the file opened as fp and set its size, truncating it or extending it with a hole.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int set_file_size(FILE *fp, int64_t size);
+
+// returned by move_received_entry if the new path is taken
+#define MOVE_EXISTS 2
+
+/*
+ * A directory of received files, of which the entries are moved out with move_received_entry. On Linux and macOS, it is
+ * used through a file descriptor, so that its path is resolved only once.
+ */
+typedef struct _received_dir received_dir;
+
+/*
+ * Open the directory at path to move the entries in it.
+ * returns the directory, which should be closed with close_received_dir, or NULL on failure.
+ */
+extern received_dir *open_received_dir(const char *path);
+
+/*
+ * Move the file or directory named name in dir to new_path, relative to the working directory, without replacing an
+ * existing file. The check and the move are a single step where the file system supports it.
+ * returns EXIT_SUCCESS on success, MOVE_EXISTS if new_path exists, and EXIT_FAILURE on other failures.
+ */
+extern int move_received_entry(received_dir *dir, const char *name, const char *new_path);
+
+/*
+ * Close the directory opened with open_received_dir, without removing it.
+ */
+extern void close_received_dir(received_dir *dir);
+
 #if defined(__linux__) || defined(__APPLE__)
 
 #define rename_file(old_name, new_name) rename(old_name, new_name)
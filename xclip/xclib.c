@@ -158,9 +158,9 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
             /* compute the size of the data buffer we received */
             pty_machsize = pty_items * mach_itemsize(pty_format);
 
-            /* copy the buffer to the pointer for returned data */
+            /* copy the buffer to the pointer for returned data, with a spare byte for a terminating '\0' */
             if (pty_machsize > 0) {
-                ltxt = (unsigned char *)xcmalloc(pty_machsize);
+                ltxt = (unsigned char *)xcmalloc(pty_machsize + 1);
                 memcpy(ltxt, buffer, pty_machsize);
             } else {
                 ltxt = NULL;
@@ -218,14 +218,14 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
             /* compute the size of the data buffer we received */
             pty_machsize = pty_items * mach_itemsize(pty_format);
 
-            /* allocate memory to accommodate data in *txt */
+            /* allocate memory to accommodate data in *txt, with a spare byte for a terminating '\0' */
             if (pty_machsize > 0) {
                 if (*len_p == 0) {
                     *len_p = pty_machsize;
-                    ltxt = (unsigned char *)xcmalloc(*len_p);
+                    ltxt = (unsigned char *)xcmalloc(*len_p + 1);
                 } else {
                     *len_p += pty_machsize;
-                    ltxt = (unsigned char *)xcrealloc(ltxt, *len_p);
+                    ltxt = (unsigned char *)xcrealloc(ltxt, *len_p + 1);
                 }
 
                 /* add data to ltxt */
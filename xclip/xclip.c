@@ -39,18 +39,14 @@ typedef struct _xclip_options {
 } xclip_options;
 
 static int doIn(Window win, unsigned long len, const char *buf, xclip_options *options) {
-    unsigned char *sel_buf = NULL; /* buffer for selection data */
-    unsigned long sel_len = len;   /* length of sel_buf */
-    XEvent evt;                    /* X Event Structures */
-
-    /* in mode */
-    sel_buf = xcmalloc(sel_len * sizeof(char));
-    memcpy(sel_buf, buf, sel_len);
+    /* serve the caller's buffer directly. It outlives this function, which returns only after losing the selection */
+    const unsigned char *sel_buf = (const unsigned char *)buf; /* buffer for selection data */
+    unsigned long sel_len = len;                               /* length of sel_buf */
+    XEvent evt;                                                /* X Event Structures */
 
     /* Handle cut buffer if needed */
     if (options->sseln == XA_STRING) {
-        XStoreBuffer(options->dpy, (char *)sel_buf, (int)sel_len, 0);
-        free(sel_buf);
+        XStoreBuffer(options->dpy, buf, (int)sel_len, 0);
         return EXIT_SUCCESS;
     }
 
@@ -62,7 +58,6 @@ static int doIn(Window win, unsigned long len, const char *buf, xclip_options *o
 
     /* Avoid making the current directory in use, in case it will need to be umounted */
     if (chdir("/") == -1) {
-        free(sel_buf);
         return EXIT_FAILURE;
     }
 
@@ -86,7 +81,6 @@ static int doIn(Window win, unsigned long len, const char *buf, xclip_options *o
             if (evt.type == SelectionClear) clear = 1;
 
             if ((context == XCLIB_XCIN_NONE) && clear) {
-                free(sel_buf);
                 return EXIT_SUCCESS;
             }
 
@@ -157,16 +151,12 @@ static int doOut(Window win, unsigned long *len_ptr, char **buf_ptr, xclip_optio
         if (context == XCLIB_XCOUT_NONE) break;
     }
 
+    /* hand over the buffer filled by xcout(), which has a spare byte for the terminating '\0', without copying */
     *len_ptr = sel_len;
     if (sel_len > 0) {
-        *buf_ptr = xcmalloc(sel_len + 1);
-        memcpy(*buf_ptr, sel_buf, sel_len);
-        (*buf_ptr)[sel_len] = 0;
-    }
-
-    if (options->sseln == XA_STRING) {
-        XFree(sel_buf);
-    } else {
+        sel_buf[sel_len] = 0;
+        *buf_ptr = (char *)sel_buf;
+    } else if (sel_buf) {
         free(sel_buf);
     }
 
@@ -1,29 +1,88 @@
 /* see LICENSE / README for more info */
 /*
- * 2022-2023 Modified by H. Thevindu J. Wijesekera
+ * 2022-2024 Modified by H. Thevindu J. Wijesekera
  */
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <errno.h>
 #include <png.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <utils/hash.h>
 #include <utils/utils.h>
 #include <xcb/randr.h>
 #include <xcb/xcb.h>
 #include <xscreenshot/xscreenshot.h>
 
-/* LSBFirst: BGRA -> RGBA */
-static void convertrow_lsb(unsigned char *drow, const unsigned char *srow, const XImage *img) {
-    const int bytes_per_line = img->bytes_per_line;
-    const unsigned char bytes_per_pixel = (unsigned char)(img->bits_per_pixel / 8);
-    int sx;
-    int dx;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TILE_SIZE SCREENSHOT_TILE_SIZE
+// number of recent frames remembered per display
+#define TILE_HISTORY 4
+// enough for a 7680x4320 display with 64x64 tiles
+#define MAX_TILES 8192
+// tile hashes are kept only for displays 1 to MAX_TILE_DISPLAYS
+#define MAX_TILE_DISPLAYS 8
+// smallest limit on the width or height of a downscaled image. This keeps the box filter sums within 32 bits
+#define MIN_SCALED_SIZE 32
+// maximum number of monitors kept in the monitor table
+#define MAX_MONITORS 16
+// time in milliseconds for which the hash of a capture is reused to answer conditional requests
+#define CAPTURE_HASH_TTL_MS 100
+
+/*
+ * Tile hashes of a captured frame
+ */
+typedef struct _frame_tiles {
+    uint64_t id;
+    uint32_t width;
+    uint32_t height;
+    uint64_t hashes[MAX_TILES];
+} frame_tiles;
+
+/*
+ * Recent frames of a display. This is placed in memory shared among the connection handler processes.
+ */
+typedef struct _display_tiles {
+    pthread_mutex_t lock;
+    uint64_t last_id;
+    uint32_t next_slot;
+    // hash of the latest full capture and its monotonic time in milliseconds. 0 time means no capture yet
+    uint64_t capture_hash;
+    uint64_t capture_ms;
+    frame_tiles frames[TILE_HISTORY];
+} display_tiles;
+
+static display_tiles *tile_store = NULL;
 
-    for (sx = 0, dx = 0; sx + 3 <= bytes_per_line; sx += bytes_per_pixel) {
+/*
+ * Monitors of the X screen, refreshed by the monitor watcher thread when the RandR configuration changes. This is
+ * placed in memory shared among the connection handler processes.
+ */
+typedef struct _monitor_table {
+    pthread_mutex_t lock;
+    int valid;
+    uint32_t count;
+    display_info monitors[MAX_MONITORS];
+} monitor_table;
+
+static monitor_table *monitor_store = NULL;
+
+/* LSBFirst: BGRA -> RGBA */
+static void convertrow_lsb(unsigned char *drow, const unsigned char *srow, unsigned char bytes_per_pixel,
+                           unsigned int width) {
+    size_t sx = 0;
+    size_t dx = 0;
+    for (unsigned int i = 0; i < width; i++, sx += bytes_per_pixel) {
         drow[dx++] = srow[sx + 2]; /* B -> R */
         drow[dx++] = srow[sx + 1]; /* G -> G */
         drow[dx++] = srow[sx];     /* R -> B */
@@ -31,93 +90,377 @@ static void convertrow_lsb(unsigned char *drow, const unsigned char *srow, const
 }
 
 /* MSBFirst: ARGB -> RGBA */
-static void convertrow_msb(unsigned char *drow, const unsigned char *srow, const XImage *img) {
-    const int bytes_per_line = img->bytes_per_line;
-    const unsigned char bytes_per_pixel = (unsigned char)(img->bits_per_pixel / 8);
-    int sx;
-    int dx;
-
-    for (sx = 0, dx = 0; sx + 3 <= bytes_per_line; sx += bytes_per_pixel) {
+static void convertrow_msb(unsigned char *drow, const unsigned char *srow, unsigned char bytes_per_pixel,
+                           unsigned int width) {
+    size_t sx = 0;
+    size_t dx = 0;
+    for (unsigned int i = 0; i < width; i++, sx += bytes_per_pixel) {
         drow[dx++] = srow[sx + 1]; /* G -> R */
         drow[dx++] = srow[sx + 2]; /* B -> G */
         drow[dx++] = srow[sx + 3]; /* A -> B */
     }
 }
 
-static int png_write_buf(XImage *img, char **buf_ptr, size_t *len) {
+/*
+ * Encode the width x height region of the image, starting from (x0, y0), as a PNG image.
+ * The encoded data is written with write_fn, which gets io_ptr from the png struct.
+ */
+static int _png_write(const XImage *img, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height,
+                      png_rw_ptr write_fn, void *io_ptr) {
     png_structp png_write_p;
     png_infop png_info_p;
-    unsigned char *drow = NULL;
+    unsigned char *drow;
     const unsigned char *srow;
+    const unsigned char bytes_per_pixel = (unsigned char)(img->bits_per_pixel / 8);
 
+    if (bytes_per_pixel < 3) return EXIT_FAILURE;
+    // allocated before setjmp so that it can be freed if the write function raises an error
+    drow = malloc((size_t)width * 4); /* output RGBA */
+    if (!drow) return EXIT_FAILURE;
     png_write_p = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png_write_p) {
-        *len = 0;
+        free(drow);
         return EXIT_FAILURE;
     }
 
     png_info_p = png_create_info_struct(png_write_p);
     if (!png_info_p || setjmp(png_jmpbuf(png_write_p))) {
-        png_destroy_write_struct(&png_write_p, NULL);
-        *len = 0;
+        png_destroy_write_struct(&png_write_p, &png_info_p);
+        free(drow);
         return EXIT_FAILURE;
     }
 
-    struct mem_file fake_file;
-    fake_file.buffer = NULL;
-    fake_file.capacity = 0;
-    fake_file.size = 0;
-    png_init_io(png_write_p, (png_FILE_p)&fake_file);
-    png_set_write_fn(png_write_p, &fake_file, &png_mem_write_data, NULL);
-    png_set_IHDR(png_write_p, png_info_p, (png_uint_32)(img->width), (png_uint_32)(img->height), 8, PNG_COLOR_TYPE_RGB,
+    png_init_io(png_write_p, (png_FILE_p)io_ptr);
+    png_set_write_fn(png_write_p, io_ptr, write_fn, NULL);
+    png_set_IHDR(png_write_p, png_info_p, (png_uint_32)width, (png_uint_32)height, 8, PNG_COLOR_TYPE_RGB,
                  PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
     png_write_info(png_write_p, png_info_p);
 
-    srow = (unsigned char *)img->data;
-    drow = malloc((size_t)(img->width) * 4); /* output RGBA */
-    if (!drow) {
-        png_destroy_write_struct(&png_write_p, &png_info_p);
-        *len = 0;
-        return EXIT_FAILURE;
-    }
+    srow = (const unsigned char *)img->data + (size_t)y0 * (size_t)img->bytes_per_line + (size_t)x0 * bytes_per_pixel;
 
-    void (*convert)(unsigned char *, const unsigned char *, const XImage *);
+    void (*convert)(unsigned char *, const unsigned char *, unsigned char, unsigned int);
     if (img->byte_order == LSBFirst)
         convert = convertrow_lsb;
     else
         convert = convertrow_msb;
 
-    for (int h = 0; h < img->height; h++) {
-        convert(drow, srow, img);
+    for (unsigned int h = 0; h < height; h++) {
+        convert(drow, srow, bytes_per_pixel, width);
         srow += img->bytes_per_line;
         png_write_row(png_write_p, (png_const_bytep)drow);
     }
     png_write_end(png_write_p, NULL);
     free(drow);
 
+    png_free_data(png_write_p, png_info_p, PNG_FREE_ALL, -1);
+    png_destroy_write_struct(&png_write_p, &png_info_p);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Encode the width x height region of the image, starting from (x0, y0), as a PNG image in a memory buffer.
+ */
+static int png_write_buf(const XImage *img, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height,
+                         char **buf_ptr, size_t *len) {
+    struct mem_file fake_file;
+    fake_file.buffer = NULL;
+    fake_file.capacity = 0;
+    fake_file.size = 0;
+
+    *len = 0;
+    if (_png_write(img, x0, y0, width, height, &png_mem_write_data, &fake_file) != EXIT_SUCCESS) {
+        if (fake_file.buffer) free(fake_file.buffer);
+        return EXIT_FAILURE;
+    }
+
     char *new_buf = realloc(fake_file.buffer, fake_file.size);
     if (new_buf) fake_file.buffer = new_buf;
     *buf_ptr = fake_file.buffer;
     *len = fake_file.size;
-    png_free_data(png_write_p, png_info_p, PNG_FREE_ALL, -1);
-    png_destroy_write_struct(&png_write_p, &png_info_p);
     return EXIT_SUCCESS;
 }
 
-int screenshot_util(int display, uint32_t *len_p, char **buf_p) {
-    XImage *img;
-    Display *dpy;
-    Window win;
+/*
+ * Buffer of IMAGE_CHUNK_SIZE bytes to pass the PNG image to a chunk_writer in parts
+ */
+typedef struct _chunk_buffer {
+    chunk_writer writer;
+    void *arg;
+    size_t len;
+    char data[IMAGE_CHUNK_SIZE];
+} chunk_buffer;
 
-    *len_p = 0;
+static void _png_chunk_write_data(png_structp png_ptr, png_bytep data, png_size_t length) {
+    chunk_buffer *buf = (chunk_buffer *)png_get_io_ptr(png_ptr);
+    while (length > 0) {
+        size_t cnt = IMAGE_CHUNK_SIZE - buf->len;
+        if (cnt > length) cnt = length;
+        memcpy(buf->data + buf->len, data, cnt);
+        buf->len += cnt;
+        data += cnt;
+        length -= cnt;
+        if (buf->len < IMAGE_CHUNK_SIZE) break;
+        if (buf->writer(buf->arg, buf->data, buf->len) != EXIT_SUCCESS) png_error(png_ptr, "Write Error");
+        buf->len = 0;
+    }
+}
+
+/*
+ * Encode the image as a PNG image and pass it to the writer in parts of at most IMAGE_CHUNK_SIZE bytes, while it is
+ * being encoded.
+ */
+static int png_write_chunked(const XImage *img, chunk_writer writer, void *arg) {
+    chunk_buffer *buf = malloc(sizeof(chunk_buffer));
+    if (!buf) return EXIT_FAILURE;
+    buf->writer = writer;
+    buf->arg = arg;
+    buf->len = 0;
+    int status = _png_write(img, 0, 0, (unsigned int)img->width, (unsigned int)img->height, &_png_chunk_write_data,
+                            buf);
+    if (status == EXIT_SUCCESS && buf->len > 0) status = writer(arg, buf->data, buf->len);
+    free(buf);
+    return status;
+}
+
+/*
+ * Lock the monitor table. Since readers do not modify the table, it is still consistent if the owner died while
+ * holding the lock.
+ */
+static int _lock_monitor_table(void) {
+    int status = pthread_mutex_lock(&(monitor_store->lock));
+    if (status == EOWNERDEAD) {
+        pthread_mutex_consistent(&(monitor_store->lock));
+        status = 0;
+    }
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Query the active monitors of the X screen, including their names, into monitors.
+ * returns the number of monitors on success, or -1 on failure.
+ */
+static int _query_monitors(xcb_connection_t *conn, xcb_window_t root, display_info *monitors) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waggregate-return"
+    xcb_randr_get_monitors_cookie_t cookie = xcb_randr_get_monitors(conn, root, 1);
+#pragma GCC diagnostic pop
+    xcb_randr_get_monitors_reply_t *reply = xcb_randr_get_monitors_reply(conn, cookie, NULL);
+    if (!reply) return -1;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waggregate-return"
+    xcb_randr_monitor_info_iterator_t itr = xcb_randr_get_monitors_monitors_iterator(reply);
+#pragma GCC diagnostic pop
+    xcb_get_atom_name_cookie_t name_cookies[MAX_MONITORS];
+    int cnt = 0;
+    // send all the atom name requests before waiting for any reply
+    while (itr.rem && cnt < MAX_MONITORS) {
+        const xcb_randr_monitor_info_t *info = itr.data;
+        display_info *monitor = monitors + cnt;
+        monitor->x = info->x;
+        monitor->y = info->y;
+        monitor->width = info->width;
+        monitor->height = info->height;
+        monitor->primary = info->primary ? 1 : 0;
+        monitor->name[0] = 0;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waggregate-return"
+        name_cookies[cnt] = xcb_get_atom_name(conn, info->name);
+#pragma GCC diagnostic pop
+        cnt++;
+        xcb_randr_monitor_info_next(&itr);
+    }
+    free(reply);
+
+    for (int i = 0; i < cnt; i++) {
+        xcb_get_atom_name_reply_t *name_reply = xcb_get_atom_name_reply(conn, name_cookies[i], NULL);
+        if (!name_reply) continue;
+        int len = xcb_get_atom_name_name_length(name_reply);
+        if (len > MAX_DISPLAY_NAME_LEN) len = MAX_DISPLAY_NAME_LEN;
+        if (len > 0) memcpy(monitors[i].name, xcb_get_atom_name_name(name_reply), (size_t)len);
+        monitors[i].name[len > 0 ? len : 0] = 0;
+        free(name_reply);
+    }
+    return cnt;
+}
+
+/*
+ * Query the monitors and replace the content of the monitor table with them.
+ */
+static void _refresh_monitors(xcb_connection_t *conn, xcb_window_t root) {
+    display_info monitors[MAX_MONITORS];
+    int cnt = _query_monitors(conn, root, monitors);
+    if (_lock_monitor_table() != EXIT_SUCCESS) return;
+    if (cnt >= 0) {
+        memcpy(monitor_store->monitors, monitors, sizeof(display_info) * (size_t)cnt);
+        monitor_store->count = (uint32_t)cnt;
+        monitor_store->valid = 1;
+    } else {
+        monitor_store->valid = 0;
+    }
+    pthread_mutex_unlock(&(monitor_store->lock));
+}
+
+/*
+ * Keep the monitor table up to date until the connection to the X server is lost.
+ */
+static void *_watch_monitors(void *arg) {
+    xcb_connection_t *conn = (xcb_connection_t *)arg;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waggregate-return"
+    xcb_window_t root = xcb_setup_roots_iterator(xcb_get_setup(conn)).data->root;
+#pragma GCC diagnostic pop
+    const xcb_query_extension_reply_t *randr = xcb_get_extension_data(conn, &xcb_randr_id);
+    if (randr && randr->present) {
+        const uint8_t screen_change = (uint8_t)(randr->first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY);
+        const uint8_t notify = (uint8_t)(randr->first_event + XCB_RANDR_NOTIFY);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waggregate-return"
+        xcb_randr_select_input(conn, root,
+                               XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE | XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE |
+                                   XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE);
+#pragma GCC diagnostic pop
+        xcb_flush(conn);
+        // query after selecting the events so that no change is missed in between
+        _refresh_monitors(conn, root);
+
+        xcb_generic_event_t *event;
+        while ((event = xcb_wait_for_event(conn))) {
+            const uint8_t type = event->response_type & 0x7F;
+            free(event);
+            if (type != screen_change && type != notify) continue;
+            // a single change usually comes as several events. refresh once for all of them
+            while ((event = xcb_poll_for_event(conn))) free(event);
+            _refresh_monitors(conn, root);
+        }
+    }
+    // the table can no longer be kept up to date. monitors will be queried on each capture
+    if (_lock_monitor_table() == EXIT_SUCCESS) {
+        monitor_store->valid = 0;
+        pthread_mutex_unlock(&(monitor_store->lock));
+    }
+    xcb_disconnect(conn);
+    return NULL;
+}
+
+void screenshot_watch_monitors(void) {
+    if (monitor_store) return;
+    void *mem = mmap(NULL, sizeof(monitor_table), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        error("Failed allocating shared memory for monitors");
+        return;
+    }
+    monitor_table *table = (monitor_table *)mem;
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr) || pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) ||
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) || pthread_mutex_init(&(table->lock), &attr)) {
+        pthread_mutexattr_destroy(&attr);
+        munmap(mem, sizeof(monitor_table));
+        return;
+    }
+    pthread_mutexattr_destroy(&attr);
+    table->valid = 0;
+    table->count = 0;
+
+    xcb_connection_t *conn = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(conn)) {
+        xcb_disconnect(conn);
+        pthread_mutex_destroy(&(table->lock));
+        munmap(mem, sizeof(monitor_table));
+        return;
+    }
+    monitor_store = table;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &_watch_monitors, conn)) {
+        monitor_store = NULL;
+        xcb_disconnect(conn);
+        pthread_mutex_destroy(&(table->lock));
+        munmap(mem, sizeof(monitor_table));
+        return;
+    }
+    pthread_detach(thread);
+}
+
+/*
+ * Find the geometry of the display given by the display number from the monitor table.
+ * returns 1 if the display is found, 0 if the display does not exist, or -1 if the monitor table is not available.
+ */
+static int _cached_geometry(int display, int *x_p, int *y_p, unsigned int *width_p, unsigned int *height_p) {
+    if (!monitor_store || _lock_monitor_table() != EXIT_SUCCESS) return -1;
+    int status = -1;
+    if (monitor_store->valid) {
+        status = 0;
+        if (display > 0 && (uint32_t)display <= monitor_store->count) {
+            const display_info *monitor = monitor_store->monitors + (display - 1);
+            *x_p = monitor->x;
+            *y_p = monitor->y;
+            *width_p = monitor->width;
+            *height_p = monitor->height;
+            status = 1;
+        }
+    }
+    pthread_mutex_unlock(&(monitor_store->lock));
+    return status;
+}
+
+list2 *screenshot_list_monitors(void) {
+    display_info monitors[MAX_MONITORS];
+    int cnt = -1;
+    if (monitor_store && _lock_monitor_table() == EXIT_SUCCESS) {
+        if (monitor_store->valid) {
+            cnt = (int)monitor_store->count;
+            memcpy(monitors, monitor_store->monitors, sizeof(display_info) * (size_t)cnt);
+        }
+        pthread_mutex_unlock(&(monitor_store->lock));
+    }
+    if (cnt < 0) {
+        // the monitor table is not available. query the X server directly
+        xcb_connection_t *conn = xcb_connect(NULL, NULL);
+        if (!xcb_connection_has_error(conn)) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waggregate-return"
+            xcb_window_t root = xcb_setup_roots_iterator(xcb_get_setup(conn)).data->root;
+#pragma GCC diagnostic pop
+            cnt = _query_monitors(conn, root, monitors);
+        }
+        xcb_disconnect(conn);
+        if (cnt < 0) return NULL;
+    }
+    list2 *lst = init_list((uint32_t)cnt);
+    if (!lst) return NULL;
+    for (int i = 0; i < cnt; i++) {
+        display_info *monitor = malloc(sizeof(display_info));
+        if (!monitor) {
+            free_list(lst);
+            return NULL;
+        }
+        memcpy(monitor, monitors + i, sizeof(display_info));
+        append(lst, monitor);
+    }
+    return lst;
+}
+
+/*
+ * Open a connection to the X server and find the geometry of the display given by the display number.
+ * returns the connection on success, or NULL on failure.
+ */
+static Display *_open_display(int display, int *x_p, int *y_p, unsigned int *width_p, unsigned int *height_p) {
+    Display *dpy;
     if (!(dpy = XOpenDisplay(NULL))) {
-        return EXIT_FAILURE;
+        return NULL;
+    }
+
+    const int cached = _cached_geometry(display, x_p, y_p, width_p, height_p);
+    if (cached == 1) return dpy;
+    if (cached == 0) {
+        XCloseDisplay(dpy);
+        return NULL;
     }
 
     xcb_connection_t *dsp = xcb_connect(NULL, NULL);
     if (xcb_connection_has_error(dsp)) {
         XCloseDisplay(dpy);
-        return EXIT_FAILURE;
+        return NULL;
     }
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Waggregate-return"
@@ -130,7 +473,7 @@ int screenshot_util(int display, uint32_t *len_p, char **buf_p) {
         free(reply);
         xcb_disconnect(dsp);
         XCloseDisplay(dpy);
-        return EXIT_FAILURE;
+        return NULL;
     }
 
 #pragma GCC diagnostic push
@@ -158,19 +501,164 @@ int screenshot_util(int display, uint32_t *len_p, char **buf_p) {
     xcb_disconnect(dsp);
     if (width == 0 || height == 0) {
         XCloseDisplay(dpy);
-        return EXIT_FAILURE;
+        return NULL;
+    }
+    *x_p = x;
+    *y_p = y;
+    *width_p = width;
+    *height_p = height;
+    return dpy;
+}
+
+/*
+ * Capture the image of the display given by the display number.
+ * returns the captured image on success, or NULL on failure.
+ */
+static XImage *_capture_display(int display) {
+    int x;
+    int y;
+    unsigned int width;
+    unsigned int height;
+    Display *dpy = _open_display(display, &x, &y, &width, &height);
+    if (!dpy) {
+        return NULL;
     }
 
-    win = RootWindow(dpy, 0);
-    img = XGetImage(dpy, win, x, y, width, height, AllPlanes, ZPixmap);
+    Window win = RootWindow(dpy, 0);
+    XImage *img = XGetImage(dpy, win, x, y, width, height, AllPlanes, ZPixmap);
 
     XCloseDisplay(dpy);
+    return img;
+}
+
+/*
+ * Capture the rectangle given by region from the display given by the display number. The rectangle is clipped to
+ * the bounds of the display.
+ * returns the captured image on success, or NULL on failure.
+ */
+static XImage *_capture_region(int display, const capture_region *region) {
+    int x;
+    int y;
+    unsigned int width;
+    unsigned int height;
+    Display *dpy = _open_display(display, &x, &y, &width, &height);
+    if (!dpy) {
+        return NULL;
+    }
+    if (region->x >= width || region->y >= height) {
+        XCloseDisplay(dpy);
+        return NULL;
+    }
+    unsigned int reg_width = width - region->x;
+    unsigned int reg_height = height - region->y;
+    if (region->width && region->width < reg_width) reg_width = region->width;
+    if (region->height && region->height < reg_height) reg_height = region->height;
+
+    Window win = RootWindow(dpy, 0);
+    XImage *img = XGetImage(dpy, win, x + (int)region->x, y + (int)region->y, reg_width, reg_height, AllPlanes,
+                            ZPixmap);
+
+    XCloseDisplay(dpy);
+    return img;
+}
 
+/*
+ * Add the channel values of count consecutive pixels, starting from src, to the 4 sums in acc.
+ */
+static inline void _sum_pixels(const unsigned char *src, unsigned int count, unsigned int bytes_per_pixel,
+                               uint32_t *acc) {
+#ifdef __SSE2__
+    if (bytes_per_pixel == 4) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = _mm_loadu_si128((const __m128i *)acc);
+        unsigned int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128i pixels = _mm_loadu_si128((const __m128i *)(src + i * 4));
+            // widen to 16 bits and add pixels 0, 1 to pixels 2, 3
+            const __m128i pairs = _mm_add_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero));
+            // widen to 32 bits and add the two pairs
+            sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_unpacklo_epi16(pairs, zero), _mm_unpackhi_epi16(pairs, zero)));
+        }
+        for (; i < count; i++) {
+            int pixel;
+            memcpy(&pixel, src + i * 4, sizeof(pixel));
+            sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero));
+        }
+        _mm_storeu_si128((__m128i *)acc, sum);
+        return;
+    }
+#endif
+    const unsigned int channels = (bytes_per_pixel < 4) ? bytes_per_pixel : 4;
+    for (unsigned int i = 0; i < count; i++, src += bytes_per_pixel) {
+        for (unsigned int c = 0; c < channels; c++) acc[c] += src[c];
+    }
+}
+
+/*
+ * Downscale the image to dst_width x dst_height with a box filter. Each destination pixel is the average of the
+ * source pixels it covers. dst_width and dst_height must not be larger than the source dimensions.
+ * Sets dst to an image of 4 bytes per pixel with the same channel order as src. Only the image data of dst is
+ * allocated, which should be freed with free() by the caller. dst must not be passed to Xlib functions.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _downscale(const XImage *src, unsigned int dst_width, unsigned int dst_height, XImage *dst) {
+    const unsigned int src_width = (unsigned int)src->width;
+    const unsigned int src_height = (unsigned int)src->height;
+    const unsigned int bytes_per_pixel = (unsigned int)(src->bits_per_pixel / 8);
+    unsigned char *data = malloc((size_t)dst_width * dst_height * 4);
+    unsigned int *x_map = malloc(sizeof(unsigned int) * (dst_width + 1));
+    uint32_t *acc = malloc(sizeof(uint32_t) * 4 * dst_width);
+    if (!data || !x_map || !acc) {
+        if (data) free(data);
+        if (x_map) free(x_map);
+        if (acc) free(acc);
+        return EXIT_FAILURE;
+    }
+    for (unsigned int dx = 0; dx <= dst_width; dx++) {
+        x_map[dx] = (unsigned int)((uint64_t)dx * src_width / dst_width);
+    }
+    for (unsigned int dy = 0; dy < dst_height; dy++) {
+        const unsigned int y0 = (unsigned int)((uint64_t)dy * src_height / dst_height);
+        const unsigned int y1 = (unsigned int)((uint64_t)(dy + 1) * src_height / dst_height);
+        memset(acc, 0, sizeof(uint32_t) * 4 * dst_width);
+        for (unsigned int y = y0; y < y1; y++) {
+            const unsigned char *row = (const unsigned char *)src->data + (size_t)y * (size_t)src->bytes_per_line;
+            for (unsigned int dx = 0; dx < dst_width; dx++) {
+                _sum_pixels(row + (size_t)x_map[dx] * bytes_per_pixel, x_map[dx + 1] - x_map[dx], bytes_per_pixel,
+                            acc + dx * 4);
+            }
+        }
+        unsigned char *out = data + (size_t)dy * dst_width * 4;
+        for (unsigned int dx = 0; dx < dst_width; dx++) {
+            const uint32_t area = (x_map[dx + 1] - x_map[dx]) * (y1 - y0);
+            for (unsigned int c = 0; c < 4; c++) {
+                out[dx * 4 + c] = (unsigned char)((acc[dx * 4 + c] + area / 2) / area);
+            }
+        }
+    }
+    free(x_map);
+    free(acc);
+
+    *dst = *src;
+    dst->width = (int)dst_width;
+    dst->height = (int)dst_height;
+    dst->xoffset = 0;
+    dst->bitmap_pad = 32;
+    dst->depth = (src->depth > 24) ? src->depth : 24;
+    dst->bits_per_pixel = 32;
+    dst->bytes_per_line = (int)(dst_width * 4);
+    dst->data = (char *)data;
+    return EXIT_SUCCESS;
+}
+
+int screenshot_util(int display, uint32_t *len_p, char **buf_p) {
+    *len_p = 0;
+    XImage *img = _capture_display(display);
     if (!img) {
         return EXIT_FAILURE;
     }
     size_t len;
-    png_write_buf(img, buf_p, &len);
+    png_write_buf(img, 0, 0, (unsigned int)img->width, (unsigned int)img->height, buf_p, &len);
     XDestroyImage(img);
 
     if (len < 8 || len > 0xFFFFFFFFUL) {
@@ -182,3 +670,450 @@ int screenshot_util(int display, uint32_t *len_p, char **buf_p) {
     *len_p = (uint32_t)len;
     return EXIT_SUCCESS;
 }
+
+/*
+ * Downscale the image with _downscale, if needed, to fit in the maximum dimensions given in region.
+ * Sets *out_p to the image to be encoded, which is either img or scaled. If it is scaled, the caller should free
+ * scaled->data after using.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _fit_image(XImage *img, const capture_region *region, XImage *scaled, XImage **out_p) {
+    const unsigned int width = (unsigned int)img->width;
+    const unsigned int height = (unsigned int)img->height;
+    unsigned int max_width = region->max_width ? region->max_width : width;
+    unsigned int max_height = region->max_height ? region->max_height : height;
+    if (max_width < MIN_SCALED_SIZE) max_width = MIN_SCALED_SIZE;
+    if (max_height < MIN_SCALED_SIZE) max_height = MIN_SCALED_SIZE;
+
+    if ((width <= max_width && height <= max_height) || img->bits_per_pixel < 24) {
+        *out_p = img;
+        return EXIT_SUCCESS;
+    }
+    // fit into max_width x max_height, preserving the aspect ratio
+    unsigned int dst_width;
+    unsigned int dst_height;
+    if ((uint64_t)width * max_height > (uint64_t)height * max_width) {
+        dst_width = max_width;
+        dst_height = (unsigned int)(((uint64_t)height * max_width + width / 2) / width);
+    } else {
+        dst_height = max_height;
+        dst_width = (unsigned int)(((uint64_t)width * max_height + height / 2) / height);
+    }
+    if (dst_width == 0) dst_width = 1;
+    if (dst_height == 0) dst_height = 1;
+    if (_downscale(img, dst_width, dst_height, scaled) != EXIT_SUCCESS) return EXIT_FAILURE;
+    *out_p = scaled;
+    return EXIT_SUCCESS;
+}
+
+int screenshot_region_util(int display, const capture_region *region, uint32_t *len_p, char **buf_p) {
+    *len_p = 0;
+    *buf_p = NULL;
+    XImage *img = _capture_region(display, region);
+    if (!img) {
+        return EXIT_FAILURE;
+    }
+    size_t len = 0;
+    XImage scaled;
+    XImage *out;
+    if (_fit_image(img, region, &scaled, &out) == EXIT_SUCCESS) {
+        png_write_buf(out, 0, 0, (unsigned int)out->width, (unsigned int)out->height, buf_p, &len);
+        if (out != img) free(scaled.data);
+    }
+    XDestroyImage(img);
+
+    if (len < 8 || len > 0xFFFFFFFFUL) {
+        if (*buf_p) free(*buf_p);
+        *buf_p = NULL;
+        return EXIT_FAILURE;
+    }
+    *len_p = (uint32_t)len;
+    return EXIT_SUCCESS;
+}
+
+int screenshot_chunked_util(int display, const capture_region *region, chunk_writer writer, void *arg) {
+    XImage *img = region ? _capture_region(display, region) : _capture_display(display);
+    if (!img) {
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_FAILURE;
+    XImage scaled;
+    XImage *out = img;
+    if (!region || _fit_image(img, region, &scaled, &out) == EXIT_SUCCESS) {
+        status = png_write_chunked(out, writer, arg);
+        if (out != img) free(scaled.data);
+    }
+    XDestroyImage(img);
+    return status;
+}
+
+void screenshot_init_shared(void) {
+    if (tile_store) return;
+    void *mem = mmap(NULL, sizeof(display_tiles) * MAX_TILE_DISPLAYS, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        error("Failed allocating shared memory for screenshot tiles");
+        return;
+    }
+    display_tiles *store = (display_tiles *)mem;
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr) || pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) ||
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST)) {
+        munmap(mem, sizeof(display_tiles) * MAX_TILE_DISPLAYS);
+        return;
+    }
+    // frame ids are started from a time dependent value to avoid matching ids from a previous run of the server
+    const uint64_t id_base = (uint64_t)time(NULL) << 20;
+    for (unsigned i = 0; i < MAX_TILE_DISPLAYS; i++) {
+        if (pthread_mutex_init(&(store[i].lock), &attr)) {
+            pthread_mutexattr_destroy(&attr);
+            munmap(mem, sizeof(display_tiles) * MAX_TILE_DISPLAYS);
+            return;
+        }
+        store[i].last_id = id_base + ((uint64_t)i << 16);
+        store[i].next_slot = 0;
+        store[i].capture_ms = 0;
+        for (unsigned j = 0; j < TILE_HISTORY; j++) store[i].frames[j].id = 0;
+    }
+    pthread_mutexattr_destroy(&attr);
+    tile_store = store;
+}
+
+/*
+ * Compute the hash of each tile of the image. Tiles are ordered row by row.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _hash_tiles(const XImage *img, unsigned int cols, uint64_t *hashes) {
+    const size_t bytes_per_pixel = (size_t)(img->bits_per_pixel / 8);
+    const unsigned int width = (unsigned int)img->width;
+    const unsigned int height = (unsigned int)img->height;
+    // one state per tile in a row of tiles, so that the image is scanned line by line
+    hash64_state *states = malloc(sizeof(hash64_state) * cols);
+    if (!states) return EXIT_FAILURE;
+    for (unsigned int y0 = 0, tile_row = 0; y0 < height; y0 += TILE_SIZE, tile_row++) {
+        for (unsigned int c = 0; c < cols; c++) hash64_init(&(states[c]), 0);
+        const unsigned int y_end = (y0 + TILE_SIZE < height) ? y0 + TILE_SIZE : height;
+        for (unsigned int y = y0; y < y_end; y++) {
+            const char *row = img->data + (size_t)y * (size_t)img->bytes_per_line;
+            for (unsigned int c = 0; c < cols; c++) {
+                const unsigned int x0 = c * TILE_SIZE;
+                const unsigned int tile_w = (x0 + TILE_SIZE < width) ? TILE_SIZE : width - x0;
+                hash64_update(&(states[c]), row + x0 * bytes_per_pixel, tile_w * bytes_per_pixel);
+            }
+        }
+        for (unsigned int c = 0; c < cols; c++) hashes[tile_row * cols + c] = hash64_digest(&(states[c]));
+    }
+    free(states);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Lock the tile history of a display. If a process died while holding the lock, the history is cleared.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _lock_display_tiles(display_tiles *dtiles) {
+    int status = pthread_mutex_lock(&(dtiles->lock));
+    if (status == EOWNERDEAD) {
+        for (unsigned j = 0; j < TILE_HISTORY; j++) dtiles->frames[j].id = 0;
+        dtiles->capture_ms = 0;
+        pthread_mutex_consistent(&(dtiles->lock));
+        return EXIT_SUCCESS;
+    }
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static uint64_t _monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000U + (uint64_t)now.tv_nsec / 1000000U;
+}
+
+/*
+ * Get the display tiles of the display if it is within the tile store.
+ * returns NULL if the display has no tile history.
+ */
+static display_tiles *_get_display_tiles(int display) {
+    if (!tile_store || display <= 0 || display > MAX_TILE_DISPLAYS) return NULL;
+    return &(tile_store[display - 1]);
+}
+
+/*
+ * Check if the latest capture of the display is recent enough and has the given hash.
+ * returns 1 if so, or 0 otherwise.
+ */
+static int _recent_capture_matches(int display, uint64_t known_hash) {
+    display_tiles *dtiles = _get_display_tiles(display);
+    if (!dtiles || _lock_display_tiles(dtiles) != EXIT_SUCCESS) return 0;
+    const uint64_t now_ms = _monotonic_ms();
+    const int matches = dtiles->capture_ms && now_ms - dtiles->capture_ms < CAPTURE_HASH_TTL_MS &&
+                        dtiles->capture_hash == known_hash;
+    pthread_mutex_unlock(&(dtiles->lock));
+    return matches;
+}
+
+static void _remember_capture_hash(int display, uint64_t hash) {
+    display_tiles *dtiles = _get_display_tiles(display);
+    if (!dtiles || _lock_display_tiles(dtiles) != EXIT_SUCCESS) return;
+    dtiles->capture_hash = hash;
+    dtiles->capture_ms = _monotonic_ms();
+    pthread_mutex_unlock(&(dtiles->lock));
+}
+
+int screenshot_if_changed_util(int display, uint64_t known_hash, uint64_t *hash_p, chunk_writer writer, void *arg) {
+    // the hash 0 is reserved for a client that has no screenshot. It never matches
+    if (known_hash != 0 && _recent_capture_matches(display, known_hash)) {
+        *hash_p = known_hash;
+        return EXIT_SUCCESS;
+    }
+    XImage *img = _capture_display(display);
+    if (!img) {
+        return EXIT_FAILURE;
+    }
+    const size_t row_len = (size_t)img->width * (size_t)(img->bits_per_pixel / 8);
+    hash64_state state;
+    // the dimensions are part of the hash, so that the same pixels arranged differently do not match
+    hash64_init(&state, ((uint64_t)(unsigned int)img->width << 32) | (uint64_t)(unsigned int)img->height);
+    // hash only the pixels of each row, since the padding at the end of a row may not be initialized
+    for (int y = 0; y < img->height; y++) {
+        hash64_update(&state, img->data + (size_t)y * (size_t)img->bytes_per_line, row_len);
+    }
+    *hash_p = hash64_digest(&state);
+    _remember_capture_hash(display, *hash_p);
+    int status = EXIT_SUCCESS;
+    if (known_hash == 0 || *hash_p != known_hash) status = png_write_chunked(img, writer, arg);
+    XDestroyImage(img);
+    return status;
+}
+
+/*
+ * Compare the tile hashes with the frame given by base_frame and record them as a new frame.
+ * Sets changed[i] to 1 if the i-th tile differs from the base frame. If the base frame is not known, all tiles are
+ * marked as changed and *base_p is set to 0.
+ * returns the id of the new frame, or 0 if the frame could not be recorded.
+ */
+static uint64_t _record_frame(int display, uint32_t width, uint32_t height, const uint64_t *hashes,
+                              uint32_t tile_cnt, unsigned char *changed, uint64_t *base_p) {
+    memset(changed, 1, tile_cnt);
+    const uint64_t base_frame = *base_p;
+    *base_p = 0;
+    if (!tile_store || display <= 0 || display > MAX_TILE_DISPLAYS || tile_cnt > MAX_TILES) return 0;
+    display_tiles *dtiles = &(tile_store[display - 1]);
+    if (_lock_display_tiles(dtiles) != EXIT_SUCCESS) return 0;
+
+    if (base_frame) {
+        for (unsigned j = 0; j < TILE_HISTORY; j++) {
+            const frame_tiles *frame = &(dtiles->frames[j]);
+            if (frame->id != base_frame || frame->width != width || frame->height != height) continue;
+            for (uint32_t i = 0; i < tile_cnt; i++) changed[i] = (frame->hashes[i] != hashes[i]);
+            *base_p = base_frame;
+            break;
+        }
+    }
+
+    frame_tiles *frame = &(dtiles->frames[dtiles->next_slot]);
+    dtiles->next_slot = (dtiles->next_slot + 1) % TILE_HISTORY;
+    frame->id = ++(dtiles->last_id);
+    frame->width = width;
+    frame->height = height;
+    memcpy(frame->hashes, hashes, sizeof(uint64_t) * tile_cnt);
+    const uint64_t frame_id = frame->id;
+    pthread_mutex_unlock(&(dtiles->lock));
+    return frame_id;
+}
+
+int screenshot_delta_util(int display, uint64_t base_frame, screenshot_delta *delta) {
+    delta->tiles = NULL;
+    XImage *img = _capture_display(display);
+    if (!img) {
+        return EXIT_FAILURE;
+    }
+    const uint32_t width = (uint32_t)img->width;
+    const uint32_t height = (uint32_t)img->height;
+    const uint32_t cols = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t tile_cnt = cols * rows;
+    uint64_t *hashes = malloc(sizeof(uint64_t) * tile_cnt);
+    unsigned char *changed = malloc(tile_cnt);
+    list2 *tiles = init_list(16);
+    if (!hashes || !changed || !tiles || img->bits_per_pixel < 24 || _hash_tiles(img, cols, hashes) != EXIT_SUCCESS) {
+        if (hashes) free(hashes);
+        if (changed) free(changed);
+        if (tiles) free_list(tiles);
+        XDestroyImage(img);
+        return EXIT_FAILURE;
+    }
+    uint64_t base = base_frame;
+    delta->frame_id = _record_frame(display, width, height, hashes, tile_cnt, changed, &base);
+    delta->base_id = base;
+    delta->width = width;
+    delta->height = height;
+    free(hashes);
+
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < tile_cnt; i++) {
+        if (!changed[i]) continue;
+        const uint32_t col = i % cols;
+        const uint32_t row = i / cols;
+        const uint32_t x0 = col * TILE_SIZE;
+        const uint32_t y0 = row * TILE_SIZE;
+        const uint32_t tile_w = (x0 + TILE_SIZE < width) ? TILE_SIZE : width - x0;
+        const uint32_t tile_h = (y0 + TILE_SIZE < height) ? TILE_SIZE : height - y0;
+        char *png = NULL;
+        size_t len;
+        if (png_write_buf(img, x0, y0, tile_w, tile_h, &png, &len) != EXIT_SUCCESS || len < 8 ||
+            len > 0xFFFFFFFFUL) {
+            if (png) free(png);
+            status = EXIT_FAILURE;
+            break;
+        }
+        img_tile *tile = malloc(sizeof(img_tile) + len);
+        if (!tile) {
+            free(png);
+            status = EXIT_FAILURE;
+            break;
+        }
+        tile->col = col;
+        tile->row = row;
+        tile->len = (uint32_t)len;
+        memcpy(tile->data, png, len);
+        free(png);
+        append(tiles, tile);
+    }
+    free(changed);
+    XDestroyImage(img);
+    if (status != EXIT_SUCCESS) {
+        free_list(tiles);
+        return EXIT_FAILURE;
+    }
+    delta->tiles = tiles;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * A screen capture session. The capture thread keeps the latest captured frame until it is taken by the consumer.
+ */
+struct _screen_stream {
+    Display *dpy;
+    int x;
+    int y;
+    unsigned int width;
+    unsigned int height;
+    long interval_ns;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    XImage *latest;
+    int stop;
+    int failed;
+};
+
+static void *_stream_capture(void *arg) {
+    screen_stream *stream = (screen_stream *)arg;
+    Window win = RootWindow(stream->dpy, 0);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    pthread_mutex_lock(&(stream->lock));
+    while (!stream->stop) {
+        pthread_mutex_unlock(&(stream->lock));
+        XImage *img = XGetImage(stream->dpy, win, stream->x, stream->y, stream->width, stream->height, AllPlanes,
+                                ZPixmap);
+        pthread_mutex_lock(&(stream->lock));
+        if (!img) {
+            stream->failed = 1;
+            pthread_cond_broadcast(&(stream->cond));
+            break;
+        }
+        // the previous frame was not taken by the consumer. drop it
+        if (stream->latest) XDestroyImage(stream->latest);
+        stream->latest = img;
+        pthread_cond_broadcast(&(stream->cond));
+
+        next.tv_nsec += stream->interval_ns;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec += next.tv_nsec / 1000000000L;
+            next.tv_nsec %= 1000000000L;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+            next = now;  // capturing is slower than the frame rate. do not try to catch up
+        }
+        int wait_status = 0;
+        while (!stream->stop && wait_status != ETIMEDOUT) {
+            wait_status = pthread_cond_timedwait(&(stream->cond), &(stream->lock), &next);
+        }
+    }
+    pthread_mutex_unlock(&(stream->lock));
+    return NULL;
+}
+
+screen_stream *screenshot_stream_start(int display, uint32_t max_fps) {
+    if (max_fps == 0) return NULL;
+    screen_stream *stream = malloc(sizeof(screen_stream));
+    if (!stream) return NULL;
+    stream->dpy = _open_display(display, &(stream->x), &(stream->y), &(stream->width), &(stream->height));
+    if (!stream->dpy) {
+        free(stream);
+        return NULL;
+    }
+    stream->interval_ns = 1000000000L / (long)max_fps;
+    stream->latest = NULL;
+    stream->stop = 0;
+    stream->failed = 0;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int status = pthread_cond_init(&(stream->cond), &attr);
+    pthread_condattr_destroy(&attr);
+    if (status || pthread_mutex_init(&(stream->lock), NULL)) {
+        if (!status) pthread_cond_destroy(&(stream->cond));
+        XCloseDisplay(stream->dpy);
+        free(stream);
+        return NULL;
+    }
+    if (pthread_create(&(stream->thread), NULL, &_stream_capture, stream)) {
+        pthread_mutex_destroy(&(stream->lock));
+        pthread_cond_destroy(&(stream->cond));
+        XCloseDisplay(stream->dpy);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+int screenshot_stream_next(screen_stream *stream, uint32_t *len_p, char **buf_p) {
+    *len_p = 0;
+    *buf_p = NULL;
+    pthread_mutex_lock(&(stream->lock));
+    while (!stream->latest && !stream->failed) pthread_cond_wait(&(stream->cond), &(stream->lock));
+    XImage *img = stream->latest;
+    stream->latest = NULL;
+    // let the capture thread start capturing the next frame while this frame is encoded and sent
+    pthread_mutex_unlock(&(stream->lock));
+    if (!img) return EXIT_FAILURE;
+
+    size_t len;
+    png_write_buf(img, 0, 0, (unsigned int)img->width, (unsigned int)img->height, buf_p, &len);
+    XDestroyImage(img);
+    if (len < 8 || len > 0xFFFFFFFFUL) {
+        if (*buf_p) free(*buf_p);
+        *buf_p = NULL;
+        return EXIT_FAILURE;
+    }
+    *len_p = (uint32_t)len;
+    return EXIT_SUCCESS;
+}
+
+void screenshot_stream_stop(screen_stream *stream) {
+    pthread_mutex_lock(&(stream->lock));
+    stream->stop = 1;
+    pthread_cond_broadcast(&(stream->cond));
+    pthread_mutex_unlock(&(stream->lock));
+    pthread_join(stream->thread, NULL);
+    if (stream->latest) XDestroyImage(stream->latest);
+    pthread_mutex_destroy(&(stream->lock));
+    pthread_cond_destroy(&(stream->cond));
+    XCloseDisplay(stream->dpy);
+    free(stream);
+}
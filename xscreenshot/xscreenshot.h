@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <utils/utils.h>
 
 /*
  * Get a screenshot and save it to a memory buffer
@@ -13,4 +14,75 @@
  */
 extern int screenshot_util(int display, uint32_t *len_p, char **buf_p);
 
+/*
+ * Get a screenshot of a rectangle of the display, downscaled with a box filter to fit the maximum dimensions given in
+ * region, and save it to a memory buffer as a PNG image.
+ * Allocates a memory buffer and set the pointer to *buf_p. Sets the size of the buffer in bytes to *len_p.
+ * Returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int screenshot_region_util(int display, const capture_region *region, uint32_t *len_p, char **buf_p);
+
+/*
+ * Get a screenshot of the display, or of a rectangle of it if region is not NULL, encoded as a PNG image.
+ * The image is passed to the writer in parts of at most IMAGE_CHUNK_SIZE bytes while it is being encoded.
+ * Returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int screenshot_chunked_util(int display, const capture_region *region, chunk_writer writer, void *arg);
+
+/*
+ * Get a screenshot of the display, and set the hash of its pixels at hash_p. If the hash is not known_hash, the
+ * screenshot is encoded as a PNG image and passed to the writer as in screenshot_chunked_util. Otherwise, it is not
+ * encoded and the writer is not called. A known_hash of 0 never matches. The hash of a recent capture of the display
+ * may be reused instead of capturing again.
+ * Returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int screenshot_if_changed_util(int display, uint64_t known_hash, uint64_t *hash_p, chunk_writer writer,
+                                      void *arg);
+
+/*
+ * Allocate the tile history of recent screenshots in memory shared with child processes.
+ * Must be called before forking the connection handlers.
+ */
+extern void screenshot_init_shared(void);
+
+/*
+ * Start keeping a table of the monitors, in memory shared with child processes, which is refreshed when the RandR
+ * configuration changes. Captures use this table instead of querying the monitors each time.
+ * Must be called before forking the connection handlers.
+ */
+extern void screenshot_watch_monitors(void);
+
+/*
+ * Get the active monitors as a list of display_info, in the order of display numbers.
+ * returns the list on success, or NULL on failure.
+ */
+extern list2 *screenshot_list_monitors(void);
+
+/*
+ * Get a screenshot of the display as the PNG encoded tiles that changed since the frame given by base_frame.
+ * Records the tile hashes of the new frame to be used as a base frame for later calls.
+ * Returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int screenshot_delta_util(int display, uint64_t base_frame, screenshot_delta *delta);
+
+/*
+ * Start capturing the display continuously, at most max_fps frames per second, in a separate thread.
+ * The connection to the X server is kept open until the stream is stopped.
+ * Returns the stream on success, or NULL on failure.
+ */
+extern screen_stream *screenshot_stream_start(int display, uint32_t max_fps);
+
+/*
+ * Wait for the next captured frame of the stream and encode it as a PNG image in a memory buffer.
+ * Frames captured before the previous call that were not taken are dropped.
+ * Allocates a memory buffer and set the pointer to *buf_p. Sets the size of the buffer in bytes to *len_p.
+ * Returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int screenshot_stream_next(screen_stream *stream, uint32_t *len_p, char **buf_p);
+
+/*
+ * Stop capturing and free the stream.
+ */
+extern void screenshot_stream_stop(screen_stream *stream);
+
 #endif  // XSCREENSHOT_XSCREENSHOT_H_